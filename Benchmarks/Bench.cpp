@@ -0,0 +1,109 @@
+//***************************************************************************************
+// Bench.cpp
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace
+{
+	struct Suite
+	{
+		const char* Name;
+		void (*Run)();
+	};
+
+	const Suite Suites[] =
+	{
+		{ "fused", RunFusedBench },
+		{ "kernels", RunKernelTests },
+		{ "streams", RunStreamBench },
+		{ "octahedral", RunOctahedralTests },
+		{ "sampling", RunSampleBench },
+		{ "geometry", RunGeometryBench },
+		{ "domain", RunDomainTests },
+		{ "scaling", RunScalingBench },
+	};
+
+	int FailedChecks = 0;
+
+	std::atomic<std::size_t> AllocationCount(0);
+}
+
+// Every heap allocation of the process goes through here, so suites can count them.
+void* operator new(std::size_t size)
+{
+	++AllocationCount;
+	if(void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+double Bench::MillisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void Bench::Check(bool condition, const char* what)
+{
+	if(condition)
+		return;
+
+	std::printf("  FAILED: %s\n", what);
+	++FailedChecks;
+}
+
+std::size_t Bench::Allocations()
+{
+	return AllocationCount.load();
+}
+
+bool Bench::SameSolution(const Waves& a, const Waves& b)
+{
+	if(a.VertexCount() != b.VertexCount() ||
+		std::memcmp(a.Heights(), b.Heights(), a.VertexCount()*sizeof(float)) != 0)
+	{
+		return false;
+	}
+
+	for(int v = 0; v < a.VertexCount(); ++v)
+	{
+		const DirectX::XMFLOAT3 na = a.Normal(v), nb = b.Normal(v);
+		const DirectX::XMFLOAT3 ta = a.TangentX(v), tb = b.TangentX(v);
+		if(std::memcmp(&na, &nb, sizeof(na)) != 0 || std::memcmp(&ta, &tb, sizeof(ta)) != 0)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	for(const Suite& suite : Suites)
+	{
+		bool selected = argc < 2;
+		for(int a = 1; a < argc; ++a)
+			selected = selected || std::strcmp(argv[a], suite.Name) == 0;
+
+		if(!selected)
+			continue;
+
+		std::printf("[%s]\n", suite.Name);
+		suite.Run();
+		std::printf("\n");
+	}
+
+	if(FailedChecks > 0)
+		std::printf("%d check(s) failed\n", FailedChecks);
+
+	return FailedChecks > 0 ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// Bench.h
+//
+// Headless benchmarks and checks for the mesh and water code.  They run from the
+// console with no window and no device.  Each suite is one function in a file of its
+// own; main runs the suites named on the command line (all of them by default) and
+// exits with 1 if any check failed.
+//***************************************************************************************
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+
+class Waves;
+
+namespace Bench
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start);
+
+	// Fastest of repeats runs of fn, in milliseconds.
+	template<typename Fn>
+	double BestOf(int repeats, Fn fn)
+	{
+		double best = 0.0;
+		for(int r = 0; r < repeats; ++r)
+		{
+			const Clock::time_point start = Clock::now();
+			fn();
+			const double ms = MillisecondsSince(start);
+			if(r == 0 || ms < best)
+				best = ms;
+		}
+		return best;
+	}
+
+	// Reports what failed if condition is false and fails the run.
+	void Check(bool condition, const char* what);
+
+	// Heap allocations (calls to the global operator new) made so far.
+	std::size_t Allocations();
+
+	// True if both grids hold the same heights, normals and tangents, bit for bit.
+	bool SameSolution(const Waves& a, const Waves& b);
+}
+
+// The suites.
+void RunFusedBench();
+void RunKernelTests();
+void RunStreamBench();
+void RunOctahedralTests();
+void RunSampleBench();
+void RunGeometryBench();
+void RunDomainTests();
+void RunScalingBench();
+
+#endif // BENCH_H
@@ -0,0 +1,127 @@
+//***************************************************************************************
+// DomainTests.cpp
+//
+// WavesDomain against a single Waves stepping the whole grid.  The slabs run on
+// threads of this process over an ordinary allocation, the in-process stand-in for
+// worker processes over shared memory, with impulses queued every few steps; the
+// gathered solution must match the dense grid bit for bit after every batch.  Covers
+// one slab, two slabs and one slab per interior row.  Also checks that a domain
+// stopped in the middle of a batch leaves the view and the step count alone.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include "../GAME3111_FinalProject/WavesDomain.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const int Rows = 97;
+	const int Cols = 83;
+
+	void RunDomain(int slabCount)
+	{
+		Waves reference(Rows, Cols, 0.5f, 0.03f, 3.25f, 0.4f);
+		Waves view(Rows, Cols, 0.5f, 0.03f, 3.25f, 0.4f);
+
+		std::vector<unsigned char> region(WavesDomain::RegionSize(Rows, Cols, slabCount));
+		WavesDomain domain(&view, slabCount, region.data(), region.size());
+
+		std::vector<std::thread> slabs;
+		std::vector<char> accepted(domain.SlabCount(), 0);
+		for(int s = 0; s < domain.SlabCount(); ++s)
+		{
+			slabs.emplace_back([&region, &accepted, s]()
+			{
+				WavesSlab slab(region.data(), region.size(), s);
+				accepted[s] = slab.Run() ? 1 : 0;
+			});
+		}
+
+		// Batches of one to four steps, each starting with a few impulses: inside the
+		// grid, on the boundary, and straddling the slab seams.
+		bool same = true;
+		bool placed = true;
+		for(int batch = 0; batch < 60 && same; ++batch)
+		{
+			for(int k = 0; k < batch % 3; ++k)
+			{
+				Waves::Impulse impulse;
+				impulse.Row = (float)((batch*37 + k*53) % (Rows + 4)) - 2.0f;
+				impulse.Col = (float)((batch*29 + k*41) % (Cols + 4)) - 2.0f + 0.25f;
+				impulse.Magnitude = (batch + k) % 2 == 0 ? 0.5f : -0.4f;
+				impulse.Radius = 1.0f + (float)((batch + k) % 4);
+				impulse.Shape = (Waves::ImpulseShape)((batch + k) % 3);
+
+				placed = placed && reference.Disturb(impulse) == domain.Disturb(impulse);
+			}
+
+			const int steps = 1 + batch % 4;
+			reference.Replay(nullptr, 0, steps);
+			domain.Step(steps);
+
+			same = domain.StepIndex() == reference.StepIndex() && Bench::SameSolution(reference, view);
+		}
+
+		domain.Stop();
+		for(std::thread& slab : slabs)
+			slab.join();
+
+		bool allAccepted = true;
+		for(char a : accepted)
+			allAccepted = allAccepted && a != 0;
+
+		Bench::Check(allAccepted, "a slab refused its region");
+		Bench::Check(placed, "the domain placed an impulse differently from the grid");
+		Bench::Check(same, "the gathered solution differs from the dense grid");
+
+		std::printf("%5d slab(s): %s after %llu steps\n", domain.SlabCount(),
+			same ? "bit-exact" : "DIFFERENT", (unsigned long long)domain.StepIndex());
+	}
+
+	void StopMidBatch()
+	{
+		Waves view(Rows, Cols, 0.5f, 0.03f, 3.25f, 0.4f);
+		view.Disturb(Rows / 2, Cols / 2, 0.5f);
+		view.Replay(nullptr, 0, 3);
+		const std::vector<float> before(view.Heights(), view.Heights() + view.VertexCount());
+
+		// Only slab 0 runs, so the batch can never finish; stop it from another thread.
+		std::vector<unsigned char> region(WavesDomain::RegionSize(Rows, Cols, 2));
+		WavesDomain domain(&view, 2, region.data(), region.size());
+		std::thread slab([&region]()
+		{
+			WavesSlab slab(region.data(), region.size(), 0);
+			slab.Run();
+		});
+		std::thread stopper([&domain]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			domain.Stop();
+		});
+
+		domain.Step(5);
+		stopper.join();
+		slab.join();
+
+		const bool untouched = domain.StepIndex() == 0 &&
+			std::memcmp(view.Heights(), before.data(), before.size()*sizeof(float)) == 0;
+		Bench::Check(untouched, "a stopped batch changed the view or the step count");
+		std::printf("stopped mid-batch: %s\n", untouched ? "view untouched" : "VIEW CHANGED");
+	}
+}
+
+void RunDomainTests()
+{
+	std::printf("%d x %d grid\n", Rows, Cols);
+
+	const int slabCounts[] = { 1, 2, Rows - 2 };
+	for(int slabCount : slabCounts)
+		RunDomain(slabCount);
+
+	StopMidBatch();
+}
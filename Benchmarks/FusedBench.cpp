@@ -0,0 +1,59 @@
+//***************************************************************************************
+// FusedBench.cpp
+//
+// Dense wave steps with the fused height/normal pass against the two-pass update.
+// Memory traffic per interior cell and step, by counting the planes each pass streams:
+//   two-pass  12 B height update + 4 B height re-read + 20 B normals and tangents = 36 B
+//   fused     12 B height update + 20 B normals and tangents                      = 32 B
+// (the fused pass also redoes two rows per band).  Grids that fit in the last level
+// cache show no difference; the gap opens once they do not.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../Common/ThreadPool.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <cstdio>
+
+void RunFusedBench()
+{
+	std::printf("%u threads\n", ThreadPool::Default().Concurrency());
+
+	// Both modes give the same bits, odd sizes and disturbances included.
+	{
+		Waves fused(131, 134, 1.0f, 0.03f, 4.0f, 0.2f);
+		Waves twoPass(131, 134, 1.0f, 0.03f, 4.0f, 0.2f);
+		twoPass.SetUpdateMode(Waves::UpdateMode::TwoPass);
+		for(int s = 0; s < 60; ++s)
+		{
+			if(s % 7 == 0)
+			{
+				fused.Disturb(5 + s, 6, 0.4f);
+				twoPass.Disturb(5 + s, 6, 0.4f);
+			}
+			fused.Replay(nullptr, 0, 1);
+			twoPass.Replay(nullptr, 0, 1);
+		}
+		Bench::Check(Bench::SameSolution(fused, twoPass), "fused and two-pass solutions differ");
+	}
+
+	const int steps = 20;
+	std::printf("%-6s %-9s %10s %12s %8s\n", "grid", "mode", "ms/step", "MB/step", "GB/s");
+	for(int n : { 512, 1024, 2048 })
+	{
+		for(Waves::UpdateMode mode : { Waves::UpdateMode::TwoPass, Waves::UpdateMode::Fused })
+		{
+			Waves waves(n, n, 1.0f, 0.03f, 4.0f, 0.2f);
+			waves.SetUpdateMode(mode);
+			waves.Disturb(n / 2, n / 2, 1.0f);
+			waves.Replay(nullptr, 0, 2);
+
+			const double ms = Bench::BestOf(3, [&waves] { waves.Replay(nullptr, 0, steps); }) / steps;
+
+			const bool fused = mode == Waves::UpdateMode::Fused;
+			const double cells = (double)(n - 2)*(n - 2);
+			const double bytes = cells*(fused ? 32.0 : 36.0);
+			std::printf("%-6d %-9s %10.3f %12.1f %8.2f\n", n, fused ? "fused" : "two-pass",
+				ms, bytes / (1024.0*1024.0), bytes / (ms*1.0e6));
+		}
+	}
+}
@@ -0,0 +1,128 @@
+//***************************************************************************************
+// GeometryBench.cpp
+//
+// Cost of generating thousands of meshes at several tessellation levels, each set a
+// sphere, cylinder, torus, geosphere and box.  Each Create* that returns a MeshData
+// allocates its two arrays once at the exact size; writing the same set into a
+// MeshArena that has held it before allocates nothing at all.  Also checks that every
+// MeshData has the size its *Counts function gives, that the arena holds the same
+// bits, and counts the heap allocations of the arena path.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../Common/GeometryGenerator.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	typedef GeometryGenerator::uint32 uint32;
+
+	const int ShapeCount = 5;
+
+	struct Level
+	{
+		uint32 Tessellation;	// slices, stacks and cross sections
+		uint32 Subdivisions;	// geosphere and box
+	};
+
+	void CountsOf(const Level& level, GeometryGenerator::MeshCounts counts[ShapeCount])
+	{
+		counts[0] = GeometryGenerator::SphereCounts(level.Tessellation, level.Tessellation);
+		counts[1] = GeometryGenerator::CylinderCounts(level.Tessellation, level.Tessellation);
+		counts[2] = GeometryGenerator::TorusCounts(level.Tessellation, level.Tessellation);
+		counts[3] = GeometryGenerator::GeosphereCounts(level.Subdivisions);
+		counts[4] = GeometryGenerator::BoxCounts(level.Subdivisions);
+	}
+
+	void CreateSet(GeometryGenerator& geoGen, const Level& level, GeometryGenerator::MeshData meshes[ShapeCount])
+	{
+		const uint32 t = level.Tessellation;
+		meshes[0] = geoGen.CreateSphere(1.0f, t, t);
+		meshes[1] = geoGen.CreateCylinder(1.0f, 0.5f, 2.0f, t, t);
+		meshes[2] = geoGen.CreateTorus(1.0f, 0.25f, t, t);
+		meshes[3] = geoGen.CreateGeosphere(1.0f, level.Subdivisions);
+		meshes[4] = geoGen.CreateBox(1.0f, 1.0f, 1.0f, level.Subdivisions);
+	}
+
+	void CreateSet(GeometryGenerator& geoGen, const Level& level,
+		const GeometryGenerator::MeshCounts counts[ShapeCount], GeometryGenerator::MeshArena& arena)
+	{
+		const uint32 t = level.Tessellation;
+		arena.Reset();
+		geoGen.CreateSphere(1.0f, t, t, arena.Allocate(counts[0]));
+		geoGen.CreateCylinder(1.0f, 0.5f, 2.0f, t, t, arena.Allocate(counts[1]));
+		geoGen.CreateTorus(1.0f, 0.25f, t, t, arena.Allocate(counts[2]));
+		geoGen.CreateGeosphere(1.0f, level.Subdivisions, arena.Allocate(counts[3]));
+		geoGen.CreateBox(1.0f, 1.0f, 1.0f, level.Subdivisions, arena.Allocate(counts[4]));
+	}
+}
+
+void RunGeometryBench()
+{
+	const Level levels[] = { { 8, 1 }, { 16, 2 }, { 32, 3 }, { 64, 4 } };
+
+	GeometryGenerator geoGen;
+
+	std::printf("%-10s %6s %9s %9s %14s %14s\n", "tess/sub", "sets", "vertices", "indices", "MeshData us", "arena us");
+
+	for(const Level& level : levels)
+	{
+		GeometryGenerator::MeshCounts counts[ShapeCount];
+		CountsOf(level, counts);
+
+		uint32 vertexCount = 0;
+		uint32 indexCount = 0;
+		for(const GeometryGenerator::MeshCounts& c : counts)
+		{
+			vertexCount += c.VertexCount;
+			indexCount += c.IndexCount;
+		}
+
+		GeometryGenerator::MeshData meshes[ShapeCount];
+		CreateSet(geoGen, level, meshes);
+
+		GeometryGenerator::MeshArena arena(vertexCount, indexCount);
+		CreateSet(geoGen, level, counts, arena);
+
+		bool exact = arena.VertexCount() == vertexCount && arena.IndexCount() == indexCount;
+		bool same = exact;
+		uint32 baseVertex = 0;
+		uint32 startIndex = 0;
+		for(int s = 0; s < ShapeCount && exact; ++s)
+		{
+			exact = meshes[s].Vertices.size() == counts[s].VertexCount &&
+				meshes[s].Indices32.size() == counts[s].IndexCount;
+			same = exact &&
+				std::memcmp(arena.Vertices() + baseVertex, meshes[s].Vertices.data(),
+					counts[s].VertexCount*sizeof(GeometryGenerator::Vertex)) == 0 &&
+				std::memcmp(arena.Indices() + startIndex, meshes[s].Indices32.data(),
+					counts[s].IndexCount*sizeof(uint32)) == 0;
+			baseVertex += counts[s].VertexCount;
+			startIndex += counts[s].IndexCount;
+		}
+		Bench::Check(exact, "a generated mesh differs in size from its *Counts");
+		Bench::Check(same, "a mesh written into the arena differs from its MeshData");
+
+		const std::size_t allocations = Bench::Allocations();
+		CreateSet(geoGen, level, counts, arena);
+		Bench::Check(Bench::Allocations() == allocations, "writing into a warmed-up arena allocated");
+
+		// About the same number of vertices per level: fewer sets as the meshes grow.
+		const int sets = 16000 / (int)level.Tessellation;
+
+		const double meshDataMs = Bench::BestOf(3, [&]
+		{
+			for(int r = 0; r < sets; ++r)
+				CreateSet(geoGen, level, meshes);
+		});
+		const double arenaMs = Bench::BestOf(3, [&]
+		{
+			for(int r = 0; r < sets; ++r)
+				CreateSet(geoGen, level, counts, arena);
+		});
+
+		std::printf("%4u/%-5u %6d %9u %9u %14.2f %14.2f\n", level.Tessellation, level.Subdivisions, sets,
+			vertexCount, indexCount, meshDataMs*1000.0 / sets, arenaMs*1000.0 / sets);
+	}
+}
@@ -0,0 +1,186 @@
+//***************************************************************************************
+// KernelTests.cpp
+//
+// Every SIMD level of WavesKernels must give the same bits as the scalar reference.
+// Each kernel is run on random rows over column ranges that start and end off the
+// vector width, then a whole simulation is stepped at every level and compared.
+// Levels the CPU cannot run are skipped.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include "../GAME3111_FinalProject/WavesKernels.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const int Cols = 203;
+
+	template<typename T>
+	bool SameBits(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0;
+	}
+
+	std::vector<float> RandomRow(std::mt19937& rng, int count, float scale)
+	{
+		std::uniform_real_distribution<float> u(-scale, scale);
+		std::vector<float> row(count);
+		for(float& x : row)
+			x = u(rng);
+		return row;
+	}
+
+	void CheckKernels(const WavesKernels& ref, const WavesKernels& k, int j0, int j1)
+	{
+		const std::string level = WavesKernels::LevelName(k.Level);
+		std::mt19937 rng(j0*1000 + j1);
+
+		const std::vector<float> curr = RandomRow(rng, Cols, 1.0f);
+		const std::vector<float> up = RandomRow(rng, Cols, 1.0f);
+		const std::vector<float> down = RandomRow(rng, Cols, 1.0f);
+		const std::vector<float> prev = RandomRow(rng, Cols, 1.0f);
+		const std::vector<float> prevUp = RandomRow(rng, Cols, 1.0f);
+		const std::vector<float> prevDown = RandomRow(rng, Cols, 1.0f);
+
+		{
+			std::vector<float> a = prev, b = prev;
+			ref.UpdateRow(a.data(), curr.data(), up.data(), down.data(), j0, j1, -0.98f, 1.23f, 0.19f);
+			k.UpdateRow(b.data(), curr.data(), up.data(), down.data(), j0, j1, -0.98f, 1.23f, 0.19f);
+			Bench::Check(SameBits(a, b), (level + " UpdateRow").c_str());
+		}
+
+		{
+			std::vector<float> a[5], b[5];
+			for(int p = 0; p < 5; ++p)
+			{
+				a[p].assign(Cols, 0.0f);
+				b[p].assign(Cols, 0.0f);
+			}
+			ref.NormalRow(curr.data(), up.data(), down.data(), j0, j1, 2.0f,
+				a[0].data(), a[1].data(), a[2].data(), a[3].data(), a[4].data());
+			k.NormalRow(curr.data(), up.data(), down.data(), j0, j1, 2.0f,
+				b[0].data(), b[1].data(), b[2].data(), b[3].data(), b[4].data());
+			bool same = true;
+			for(int p = 0; p < 5; ++p)
+				same = same && SameBits(a[p], b[p]);
+			Bench::Check(same, (level + " NormalRow").c_str());
+
+			std::vector<std::uint32_t> pa(Cols, 0), pb(Cols, 0);
+			std::vector<float> ta(Cols, 0.0f), tb(Cols, 0.0f), sa(Cols, 0.0f), sb(Cols, 0.0f);
+			ref.NormalRowOct(curr.data(), up.data(), down.data(), j0, j1, 2.0f, pa.data(), ta.data(), sa.data());
+			k.NormalRowOct(curr.data(), up.data(), down.data(), j0, j1, 2.0f, pb.data(), tb.data(), sb.data());
+			Bench::Check(SameBits(pa, pb) && SameBits(ta, tb) && SameBits(sa, sb), (level + " NormalRowOct").c_str());
+
+			std::vector<std::uint32_t> wa(2*Cols, 0), wb(2*Cols, 0);
+			ref.PackRow(curr.data(), a[0].data(), a[1].data(), a[2].data(), j0, j1, wa.data());
+			k.PackRow(curr.data(), a[0].data(), a[1].data(), a[2].data(), j0, j1, wb.data());
+			Bench::Check(SameBits(wa, wb), (level + " PackRow").c_str());
+		}
+
+		{
+			std::vector<float> a(Cols, 0.0f), b(Cols, 0.0f);
+			ref.ImplicitRhsRow(curr.data(), up.data(), down.data(), prev.data(), prevUp.data(), prevDown.data(),
+				j0, j1, 0.99f, 0.07f, 0.98f, a.data());
+			k.ImplicitRhsRow(curr.data(), up.data(), down.data(), prev.data(), prevUp.data(), prevDown.data(),
+				j0, j1, 0.99f, 0.07f, 0.98f, b.data());
+			Bench::Check(SameBits(a, b), (level + " ImplicitRhsRow").c_str());
+
+			a = prev;
+			b = prev;
+			ref.SweepRow(a.data(), curr.data(), j0, j1, 0.3f, 0.7f);
+			k.SweepRow(b.data(), curr.data(), j0, j1, 0.3f, 0.7f);
+			Bench::Check(SameBits(a, b), (level + " SweepRow").c_str());
+		}
+	}
+
+	void CheckSample(const WavesKernels& ref, const WavesKernels& k)
+	{
+		const std::string level = WavesKernels::LevelName(k.Level);
+		std::mt19937 rng(17);
+
+		const int rows = 37;
+		const std::vector<float> h = RandomRow(rng, rows*Cols, 1.0f);
+
+		// Points over the grid and past every edge; an odd count leaves a vector tail.
+		const int count = 1001;
+		std::uniform_real_distribution<float> x(-110.0f, 110.0f);
+		std::uniform_real_distribution<float> z(-25.0f, 25.0f);
+		std::vector<float> xz(2*count);
+		for(int p = 0; p < count; ++p)
+		{
+			xz[2*p + 0] = x(rng);
+			xz[2*p + 1] = z(rng);
+		}
+
+		std::vector<float> a[4], b[4];
+		for(int p = 0; p < 4; ++p)
+		{
+			a[p].assign(count, 0.0f);
+			b[p].assign(count, 0.0f);
+		}
+		ref.Sample(h.data(), rows, Cols, -101.0f, 18.0f, 1.0f, xz.data(), count,
+			a[0].data(), a[1].data(), a[2].data(), a[3].data());
+		k.Sample(h.data(), rows, Cols, -101.0f, 18.0f, 1.0f, xz.data(), count,
+			b[0].data(), b[1].data(), b[2].data(), b[3].data());
+
+		bool same = true;
+		for(int p = 0; p < 4; ++p)
+			same = same && SameBits(a[p], b[p]);
+		Bench::Check(same, (level + " Sample").c_str());
+	}
+}
+
+void RunKernelTests()
+{
+	const SimdLevel best = WavesKernels::DetectSimdLevel();
+	std::printf("detected %s\n", WavesKernels::LevelName(best));
+
+	const WavesKernels& ref = WavesKernels::Get(SimdLevel::Scalar);
+	for(int l = (int)SimdLevel::SSE2; l < (int)SimdLevel::Count; ++l)
+	{
+		const SimdLevel level = (SimdLevel)l;
+		if(l > (int)best)
+		{
+			std::printf("%-8s skipped\n", WavesKernels::LevelName(level));
+			continue;
+		}
+
+		const WavesKernels& k = WavesKernels::Get(level);
+		const int ranges[][2] = { { 1, Cols - 1 }, { 0, Cols }, { 3, 4 }, { 5, 22 }, { 17, 150 }, { 31, 31 } };
+		for(const auto& range : ranges)
+			CheckKernels(ref, k, range[0], range[1]);
+		CheckSample(ref, k);
+
+		// A whole run, explicit and implicit, both normal formats.
+		for(int config = 0; config < 4; ++config)
+		{
+			Waves reference(131, 137, 1.0f, 0.03f, 4.0f, 0.2f);
+			Waves tested(131, 137, 1.0f, 0.03f, 4.0f, 0.2f);
+			Waves* waves[2] = { &reference, &tested };
+			for(int w = 0; w < 2; ++w)
+			{
+				waves[w]->SetSimdLevel(w == 0 ? SimdLevel::Scalar : level);
+				if(config & 1)
+					waves[w]->SetIntegrator(Waves::Integrator::Implicit);
+				if(config & 2)
+					waves[w]->SetNormalFormat(Waves::NormalFormat::Octahedral);
+
+				std::mt19937 rng(5);
+				for(int s = 0; s < 200; ++s)
+				{
+					if(s % 5 == 0)
+						waves[w]->Disturb(4 + (int)(rng() % 122), 4 + (int)(rng() % 128), (rng() % 100) / 200.0f);
+					waves[w]->Replay(nullptr, 0, 1);
+				}
+			}
+			Bench::Check(Bench::SameSolution(reference, tested), (std::string(WavesKernels::LevelName(level)) + " simulation").c_str());
+		}
+
+		std::printf("%-8s checked\n", WavesKernels::LevelName(level));
+	}
+}
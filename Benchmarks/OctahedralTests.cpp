@@ -0,0 +1,114 @@
+//***************************************************************************************
+// OctahedralTests.cpp
+//
+// Error bounds of the octahedral normal encoding (Waves::NormalFormat::Octahedral).
+// Two 16-bit snorm components leave a worst angular error of about 0.004 degrees; the
+// checks allow 0.01.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	const double MaxErrorDegrees = 0.01;
+
+	double AngleDegrees(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		const double dot = (double)a.x*b.x + (double)a.y*b.y + (double)a.z*b.z;
+		const double la = std::sqrt((double)a.x*a.x + (double)a.y*a.y + (double)a.z*a.z);
+		const double lb = std::sqrt((double)b.x*b.x + (double)b.y*b.y + (double)b.z*b.z);
+		return std::acos(std::min(std::max(dot / (la*lb), -1.0), 1.0))*57.29577951308232;
+	}
+
+	double Length(const DirectX::XMFLOAT3& v)
+	{
+		return std::sqrt((double)v.x*v.x + (double)v.y*v.y + (double)v.z*v.z);
+	}
+}
+
+void RunOctahedralTests()
+{
+	// Round trip of random unit vectors over the whole sphere.
+	{
+		std::mt19937 rng(1);
+		std::normal_distribution<float> normal;
+
+		double maxError = 0.0;
+		double maxLengthError = 0.0;
+		for(int k = 0; k < 2000000; ++k)
+		{
+			DirectX::XMFLOAT3 n(normal(rng), normal(rng), normal(rng));
+			const float length = (float)Length(n);
+			if(length < 1.0e-6f)
+				continue;
+			n.x /= length;
+			n.y /= length;
+			n.z /= length;
+
+			const DirectX::XMFLOAT3 d = Waves::DecodeOctahedral(Waves::EncodeOctahedral(n.x, n.y, n.z));
+			maxError = std::max(maxError, AngleDegrees(d, n));
+			maxLengthError = std::max(maxLengthError, std::fabs(Length(d) - 1.0));
+		}
+
+		std::printf("sphere round trip: max %.5f deg, max |length - 1| %.2e\n", maxError, maxLengthError);
+		Bench::Check(maxError <= MaxErrorDegrees, "octahedral round trip error above bound");
+		Bench::Check(maxLengthError <= 1.0e-6, "decoded normals are not unit length");
+	}
+
+	// The six axes land on corners or the center of the octahedron and come back exactly.
+	{
+		const DirectX::XMFLOAT3 axes[] =
+		{
+			{ 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+			{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+		};
+
+		bool exact = true;
+		for(const DirectX::XMFLOAT3& a : axes)
+		{
+			const DirectX::XMFLOAT3 d = Waves::DecodeOctahedral(Waves::EncodeOctahedral(a.x, a.y, a.z));
+			exact = exact && d.x == a.x && d.y == a.y && d.z == a.z;
+		}
+		std::printf("axes: %s\n", exact ? "exact" : "not exact");
+		Bench::Check(exact, "octahedral axis round trip is not exact");
+	}
+
+	// A simulation stored octahedrally against the same one stored as floats: the heights
+	// are untouched and the normals stay within the bound.
+	{
+		Waves float3(512, 512, 1.0f, 0.03f, 4.0f, 0.2f);
+		Waves packed(512, 512, 1.0f, 0.03f, 4.0f, 0.2f);
+		packed.SetNormalFormat(Waves::NormalFormat::Octahedral);
+		float3.SetSparseTiles(true);
+		packed.SetSparseTiles(true);
+
+		for(int k = 0; k < 60; ++k)
+		{
+			if(k % 5 == 0)
+			{
+				float3.Disturb(50 + k*6, 200, 0.5f);
+				packed.Disturb(50 + k*6, 200, 0.5f);
+			}
+			float3.Replay(nullptr, 0, 1);
+			packed.Replay(nullptr, 0, 1);
+		}
+
+		double maxError = 0.0;
+		int heightDiffs = 0;
+		for(int v = 0; v < float3.VertexCount(); ++v)
+		{
+			maxError = std::max(maxError, AngleDegrees(float3.Normal(v), packed.Normal(v)));
+			heightDiffs += float3.Height(v) != packed.Height(v);
+		}
+
+		std::printf("simulation: max normal difference %.5f deg, %d height differences\n", maxError, heightDiffs);
+		Bench::Check(maxError <= MaxErrorDegrees, "octahedral simulation normals off by more than the bound");
+		Bench::Check(heightDiffs == 0, "normal format changed the heights");
+	}
+}
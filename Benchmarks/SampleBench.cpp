@@ -0,0 +1,81 @@
+//***************************************************************************************
+// SampleBench.cpp
+//
+// Per-query cost of Waves::SampleHeights and Waves::SampleNormals for a batch of 10k
+// random points, at every SIMD level the CPU supports.  Every level must return the
+// same bits as the scalar one, and a sample taken at a grid point must equal the
+// height stored there.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+void RunSampleBench()
+{
+	const int rows = 200;
+	const int cols = 160;
+	Waves waves(rows, cols, 0.5f, 0.03f, 3.25f, 0.4f);
+	for(int f = 0; f < 50; ++f)
+	{
+		waves.Disturb(Waves::Impulse{ 100.0f + f, 80.0f, 1.0f, 6.0f, Waves::ImpulseShape::Gaussian });
+		waves.Replay(nullptr, 0, 1);
+	}
+
+	bool exact = true;
+	for(int i = 0; i < rows; i += 7)
+	{
+		for(int j = 0; j < cols; j += 5)
+		{
+			const XMFLOAT3 p = waves.Position(i*cols + j);
+			const XMFLOAT2 xz(p.x, p.z);
+			float h;
+			waves.SampleHeights(&xz, 1, &h);
+			exact = exact && h == p.y;
+		}
+	}
+	Bench::Check(exact, "sampled height at a grid point differs from the stored height");
+
+	// Points over the grid (79.5 x 99.5 units); those past its left and right edges clamp.
+	const int count = 10000;
+	std::vector<XMFLOAT2> points(count);
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> u(-45.0f, 45.0f);
+	for(XMFLOAT2& p : points)
+		p = XMFLOAT2(u(rng), u(rng));
+
+	std::vector<float> refHeights(count), heights(count);
+	std::vector<XMFLOAT3> refNormals(count), normals(count);
+
+	std::printf("%d queries on a %d x %d grid\n", count, rows, cols);
+	std::printf("%-8s %14s %14s\n", "level", "heights ns/q", "normals ns/q");
+
+	const SimdLevel best = WavesKernels::DetectSimdLevel();
+	for(int l = 0; l <= (int)best; ++l)
+	{
+		waves.SetSimdLevel((SimdLevel)l);
+
+		const double heightMs = Bench::BestOf(200, [&] { waves.SampleHeights(points.data(), count, heights.data()); });
+		const double normalMs = Bench::BestOf(200, [&] { waves.SampleNormals(points.data(), count, normals.data()); });
+
+		if(l == 0)
+		{
+			refHeights = heights;
+			refNormals = normals;
+		}
+		else
+		{
+			const bool same = std::memcmp(heights.data(), refHeights.data(), count*sizeof(float)) == 0 &&
+				std::memcmp(normals.data(), refNormals.data(), count*sizeof(XMFLOAT3)) == 0;
+			Bench::Check(same, "SIMD samples differ from the scalar ones");
+		}
+
+		std::printf("%-8s %14.2f %14.2f\n", WavesKernels::LevelName((SimdLevel)l),
+			heightMs*1.0e6 / count, normalMs*1.0e6 / count);
+	}
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// ScalingBench.cpp
+//
+// How dense wave steps scale with the thread count: for every count from one to the
+// number of hardware threads, a ThreadPool of that concurrency runs the row sweeps of
+// a large grid.  Reports ms/step and the speedup over one thread, and checks that the
+// solution does not depend on the thread count.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../Common/ThreadPool.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+void RunScalingBench()
+{
+	const int n = 2048;
+	const int steps = 10;
+	const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::printf("%d x %d grid, 1 to %u threads\n", n, n, maxThreads);
+	std::printf("%-8s %10s %9s %11s\n", "threads", "ms/step", "speedup", "efficiency");
+
+	// Every pool's solution is compared with the one-thread run.
+	std::unique_ptr<Waves> single;
+	double singleMs = 0.0;
+
+	for(unsigned threads = 1; threads <= maxThreads; ++threads)
+	{
+		ThreadPool pool(threads > 1 ? threads - 1 : ThreadPool::NoWorkers);
+		Bench::Check(pool.Concurrency() == threads, "a pool has the wrong concurrency");
+
+		std::unique_ptr<Waves> waves = std::make_unique<Waves>(n, n, 1.0f, 0.03f, 4.0f, 0.2f);
+		waves->SetThreadPool(&pool);
+		waves->Disturb(n / 2, n / 2, 1.0f);
+		waves->Disturb(n / 3, 2*n / 3, -0.6f);
+		waves->Replay(nullptr, 0, 2);
+
+		const double ms = Bench::BestOf(3, [&waves] { waves->Replay(nullptr, 0, steps); }) / steps;
+
+		// Leave the grid with a pool that outlives this iteration.
+		waves->SetThreadPool(&ThreadPool::Default());
+
+		if(threads == 1)
+		{
+			single = std::move(waves);
+			singleMs = ms;
+		}
+		else
+		{
+			Bench::Check(Bench::SameSolution(*single, *waves), "the solution depends on the thread count");
+		}
+
+		const double speedup = singleMs / ms;
+		std::printf("%-8u %10.3f %8.2fx %10.0f%%\n", threads, ms, speedup, 100.0*speedup / threads);
+	}
+}
@@ -0,0 +1,79 @@
+//***************************************************************************************
+// StreamBench.cpp
+//
+// Bytes and time of the per-frame water upload: the interleaved Vertex stream
+// (WriteVertices, VertexStride bytes per vertex) against the dynamic stream of the
+// static/dynamic split (WriteDynamicVertices, DynamicVertexStride bytes), for both
+// normal formats.  The static stream is written once and is not counted per frame.
+// Also checks that the two streams carry the same heights and grid coordinates.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "../GAME3111_FinalProject/Waves.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+void RunStreamBench()
+{
+	const int n = 1024;
+	Waves waves(n, n, 1.0f, 0.03f, 4.0f, 0.2f);
+	for(int k = 0; k < 30; ++k)
+	{
+		waves.Disturb(100 + k*20, n / 2, 0.5f);
+		waves.Replay(nullptr, 0, 1);
+	}
+
+	std::vector<int> patches(waves.PatchCount());
+	for(int p = 0; p < waves.PatchCount(); ++p)
+		patches[p] = p;
+
+	const std::size_t vertexCount = waves.PatchVertexCount();
+	std::vector<float> interleaved(vertexCount*Waves::VertexStride / sizeof(float));
+	std::vector<float> stat(vertexCount*Waves::StaticVertexStride / sizeof(float));
+	std::vector<std::uint32_t> dynamic(vertexCount*Waves::DynamicVertexStride / sizeof(std::uint32_t));
+
+	const double interleavedMs = Bench::BestOf(10, [&]
+	{
+		waves.WriteVertices(interleaved.data(), patches.data(), (int)patches.size());
+	});
+
+	// The two layouts describe the same vertices: position (x, y, z), normal, uv against
+	// (x, z, u, v) + (height, packed normal).
+	waves.WriteStaticVertices(stat.data());
+	waves.WriteDynamicVertices(dynamic.data(), patches.data(), (int)patches.size());
+	bool same = true;
+	for(std::size_t v = 0; v < vertexCount && same; ++v)
+	{
+		const float* full = &interleaved[v*8];
+		float height;
+		std::memcpy(&height, &dynamic[v*2], sizeof(height));
+		same = height == full[1] && stat[v*4 + 0] == full[0] && stat[v*4 + 1] == full[2] &&
+			stat[v*4 + 2] == full[6] && stat[v*4 + 3] == full[7];
+	}
+	Bench::Check(same, "static and dynamic streams disagree with the interleaved vertices");
+
+	const double interleavedBytes = (double)vertexCount*Waves::VertexStride;
+	const double dynamicBytes = (double)vertexCount*Waves::DynamicVertexStride;
+
+	std::printf("%d x %d grid, %zu patch-major vertices, full rewrite\n", n, n, vertexCount);
+	std::printf("%-22s %14s %8s %10s\n", "stream", "bytes/frame", "share", "ms/frame");
+	std::printf("%-22s %14.0f %7.0f%% %10.3f\n", "interleaved", interleavedBytes, 100.0, interleavedMs);
+
+	for(Waves::NormalFormat format : { Waves::NormalFormat::Float3, Waves::NormalFormat::Octahedral })
+	{
+		waves.SetNormalFormat(format);
+		waves.Replay(nullptr, 0, 1);
+
+		const double ms = Bench::BestOf(10, [&]
+		{
+			waves.WriteDynamicVertices(dynamic.data(), patches.data(), (int)patches.size());
+		});
+
+		std::printf("%-22s %14.0f %7.0f%% %10.3f\n",
+			format == Waves::NormalFormat::Float3 ? "dynamic (rgba8 normal)" : "dynamic (octahedral)",
+			dynamicBytes, 100.0*dynamicBytes / interleavedBytes, ms);
+	}
+
+	std::printf("%-22s %14.0f\n", "static (once)", (double)vertexCount*Waves::StaticVertexStride);
+}
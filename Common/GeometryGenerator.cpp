@@ -4,13 +4,133 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <cassert>
 
 using namespace DirectX;
 
+// Appends vertices and indices to a MeshSpan in order, like push_back into a MeshData
+// that already has the right capacity.
+struct GeometryGenerator::MeshWriter
+{
+	explicit MeshWriter(const MeshSpan& out) : Out(out) {}
+
+	void AddVertex(const Vertex& v)
+	{
+		assert(VertexCount < Out.VertexCount);
+		Out.Vertices[VertexCount++] = v;
+	}
+
+	void AddIndex(uint32 i)
+	{
+		assert(IndexCount < Out.IndexCount);
+		Out.Indices[IndexCount++] = i;
+	}
+
+	// True once the span is exactly full.
+	bool Complete()const
+	{
+		return VertexCount == Out.VertexCount && IndexCount == Out.IndexCount;
+	}
+
+	const MeshSpan& Out;
+	uint32 VertexCount = 0;
+	uint32 IndexCount = 0;
+};
+
+GeometryGenerator::MeshArena::MeshArena(uint32 vertexCapacity, uint32 indexCapacity)
+	: mVertices(vertexCapacity), mIndices(indexCapacity)
+{
+}
+
+GeometryGenerator::MeshSpan GeometryGenerator::MeshArena::Allocate(const MeshCounts& counts)
+{
+	MeshSpan span;
+	if(counts.VertexCount > mVertices.size() - mVertexCount ||
+	   counts.IndexCount > mIndices.size() - mIndexCount)
+		return span;
+
+	span.Vertices = mVertices.data() + mVertexCount;
+	span.Indices = mIndices.data() + mIndexCount;
+	span.VertexCount = counts.VertexCount;
+	span.IndexCount = counts.IndexCount;
+	span.Edges = &mEdges;
+
+	mVertexCount += counts.VertexCount;
+	mIndexCount += counts.IndexCount;
+	return span;
+}
+
+void GeometryGenerator::MeshArena::Reset()
+{
+	mVertexCount = 0;
+	mIndexCount = 0;
+}
+
+GeometryGenerator::uint32 GeometryGenerator::MeshArena::VertexCount()const
+{
+	return mVertexCount;
+}
+
+GeometryGenerator::uint32 GeometryGenerator::MeshArena::IndexCount()const
+{
+	return mIndexCount;
+}
+
+const GeometryGenerator::Vertex* GeometryGenerator::MeshArena::Vertices()const
+{
+	return mVertices.data();
+}
+
+const GeometryGenerator::uint32* GeometryGenerator::MeshArena::Indices()const
+{
+	return mIndices.data();
+}
+
+GeometryGenerator::MeshSpan GeometryGenerator::Allocate(MeshData& meshData, const MeshCounts& counts)
+{
+	meshData.Vertices.resize(counts.VertexCount);
+	meshData.Indices32.resize(counts.IndexCount);
+
+	MeshSpan span;
+	span.Vertices = meshData.Vertices.data();
+	span.Indices = meshData.Indices32.data();
+	span.VertexCount = counts.VertexCount;
+	span.IndexCount = counts.IndexCount;
+	return span;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::SubdividedCounts(uint32 vertexCount, uint32 edgeCount, uint32 triCount, uint32 numSubdivisions)
+{
+	// Each round adds one vertex per edge, splits every edge in two, and adds three
+	// inner edges to every triangle it splits into four.
+	for(uint32 i = 0; i < numSubdivisions; ++i)
+	{
+		vertexCount += edgeCount;
+		edgeCount = 2*edgeCount + 3*triCount;
+		triCount *= 4;
+	}
+
+	MeshCounts counts;
+	counts.VertexCount = vertexCount;
+	counts.IndexCount = 3*triCount;
+	return counts;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
-    MeshData meshData;
+	MeshData meshData;
+	CreateBox(width, height, depth, numSubdivisions, Allocate(meshData, BoxCounts(numSubdivisions)));
+	return meshData;
+}
 
+GeometryGenerator::MeshCounts GeometryGenerator::BoxCounts(uint32 numSubdivisions)
+{
+	// Each face is a quad of two triangles: four sides and a diagonal.
+	return SubdividedCounts(24, 6*5, 12, std::min<uint32>(numSubdivisions, 6u));
+}
+
+void GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out)
+{
     //
 	// Create the vertices.
 	//
@@ -57,7 +177,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
 	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
 
-	meshData.Vertices.assign(&v[0], &v[24]);
  
 	//
 	// Create the indices.
@@ -89,20 +208,26 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	i[30] = 20; i[31] = 21; i[32] = 22;
 	i[33] = 20; i[34] = 22; i[35] = 23;
 
-	meshData.Indices32.assign(&i[0], &i[36]);
-
     // Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
-
-    return meshData;
+    SubdivideInto(v, 24, i, 12, numSubdivisions, out);
 }
 GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float height, float depth, uint32 numSubdivisions)
 {
 	MeshData meshData;
+	CreatePyramid(width, height, depth, numSubdivisions, Allocate(meshData, PyramidCounts(numSubdivisions)));
+	return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::PyramidCounts(uint32 numSubdivisions)
+{
+	// The base quad has five edges; the four sides share none.
+	return SubdividedCounts(16, 5 + 4*3, 6, std::min<uint32>(numSubdivisions, 6u));
+}
 
+void GeometryGenerator::CreatePyramid(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out)
+{
 	//Create vertices
 	Vertex v[16];
 
@@ -137,7 +262,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float
 	v[15] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
 
-	meshData.Vertices.assign(&v[0], &v[16]);
 
 	//
 	// Create the indices.
@@ -162,20 +286,26 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float
 	i[15] = 13; i[16] = 14; i[17] = 15;
 
 
-	meshData.Indices32.assign(&i[0], &i[18]);
-
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
-
-	return meshData;
+	SubdivideInto(v, 16, i, 6, numSubdivisions, out);
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float width, float height, float depth, uint32 numSubdivisions)
 {
 	MeshData meshData;
+	CreateDiamond(width, height, depth, numSubdivisions, Allocate(meshData, DiamondCounts(numSubdivisions)));
+	return meshData;
+}
 
+GeometryGenerator::MeshCounts GeometryGenerator::DiamondCounts(uint32 numSubdivisions)
+{
+	// The triangles of each half share only their apex, so no edge is shared.
+	return SubdividedCounts(18, 8*3, 8, std::min<uint32>(numSubdivisions, 6u));
+}
+
+void GeometryGenerator::CreateDiamond(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out)
+{
 	//Create vertices
 	Vertex v[18];
 
@@ -218,7 +348,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float width, float
 	v[16] = Vertex(-w2, 0, +d2, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 	v[17] = Vertex(-w2, 0, -d2, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.assign(&v[0], &v[18]);
 
 	//
 	// Create the indices.
@@ -251,19 +380,31 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float width, float
 	i[21] = 9; i[22] = 16; i[23] = 17;
 
 
-	meshData.Indices32.assign(&i[0], &i[24]);
-
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
-
-	return meshData;
+	SubdivideInto(v, 18, i, 8, numSubdivisions, out);
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float bottomRadius, float topRadius, float height, uint32 stackCount)
 {
 	MeshData meshData;
+	CreateTriangularPrism(bottomRadius, topRadius, height, stackCount, Allocate(meshData, TriangularPrismCounts(stackCount)));
+	return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::TriangularPrismCounts(uint32 stackCount)
+{
+	// Three slices: stackCount + 1 rings of four vertices and two triangles per quad,
+	// plus a four-vertex ring and one triangle for each cap.
+	MeshCounts counts;
+	counts.VertexCount = (stackCount + 1)*4 + 2*4;
+	counts.IndexCount = stackCount*3*6 + 2*3;
+	return counts;
+}
+
+void GeometryGenerator::CreateTriangularPrism(float bottomRadius, float topRadius, float height, uint32 stackCount, const MeshSpan& out)
+{
+	MeshWriter writer(out);
 	uint32 sliceCount = 3;
 
 	//
@@ -327,7 +468,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float botto
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			writer.AddVertex(vertex);
 		}
 	}
 
@@ -340,13 +481,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float botto
 	{
 		for (uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j + 1);
 
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j + 1);
 		}
 	}
 
@@ -367,12 +508,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float botto
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		writer.AddVertex(Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
 	}
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-	meshData.Indices32.push_back(baseIndex - 1);
-	meshData.Indices32.push_back(baseIndex - 2);
-	meshData.Indices32.push_back(baseIndex - 3);
+	uint32 baseIndex = writer.VertexCount;
+	writer.AddIndex(baseIndex - 1);
+	writer.AddIndex(baseIndex - 2);
+	writer.AddIndex(baseIndex - 3);
 
 	// 
 	// Build bottom cap.
@@ -386,19 +527,34 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float botto
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, -y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		writer.AddVertex(Vertex(x, -y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
 	}
 
-	baseIndex = (uint32)meshData.Vertices.size();
-	meshData.Indices32.push_back(baseIndex - 3);
-	meshData.Indices32.push_back(baseIndex - 2);
-	meshData.Indices32.push_back(baseIndex - 1);
+	baseIndex = writer.VertexCount;
+	writer.AddIndex(baseIndex - 3);
+	writer.AddIndex(baseIndex - 2);
+	writer.AddIndex(baseIndex - 1);
 
-	return meshData;
+	assert(writer.Complete());
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float radius, float crossRadius, uint32 sliceCount, uint32 crossCount)
 {
 	MeshData meshData;
+	CreateTorus(radius, crossRadius, sliceCount, crossCount, Allocate(meshData, TorusCounts(sliceCount, crossCount)));
+	return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::TorusCounts(uint32 sliceCount, uint32 crossCount)
+{
+	MeshCounts counts;
+	counts.VertexCount = (sliceCount + 1)*(crossCount + 1);
+	counts.IndexCount = sliceCount*crossCount*6;
+	return counts;
+}
+
+void GeometryGenerator::CreateTorus(float radius, float crossRadius, uint32 sliceCount, uint32 crossCount, const MeshSpan& out)
+{
+	MeshWriter writer(out);
 
 	// The steps for each of the separate rotations
 	float thetaStep = 2.0f * XM_PI / sliceCount; // the steps around the ring
@@ -434,32 +590,43 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float radius, float c
 			v.TexC.x = theta / XM_2PI;
 			v.TexC.y = phi / XM_PI;
 
-			meshData.Vertices.push_back(v);
+			writer.AddVertex(v);
 		}
 	}
 
-	uint32 baseIndex = 0;
-	uint32 ringVertexCount = sliceCount + 1;
+	// Each slice is a ring of crossCount + 1 vertices.
+	uint32 ringVertexCount = crossCount + 1;
 	for (uint32 i = 0; i < sliceCount; ++i)
 	{
 		for (uint32 j = 0; j < crossCount; ++j)
 		{
-			meshData.Indices32.push_back(i * (sliceCount + 1) + (j + 1));
-			meshData.Indices32.push_back(i * (sliceCount + 1) + j);
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + j);
+			writer.AddIndex(i * ringVertexCount + (j + 1));
+			writer.AddIndex(i * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j);
 
-			meshData.Indices32.push_back(i * (sliceCount + 1) + (j + 1));
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + j);
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + (j + 1));
+			writer.AddIndex(i * ringVertexCount + (j + 1));
+			writer.AddIndex((i + 1) * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + (j + 1));
 		}
 	}
 
-	return meshData;
+	assert(writer.Complete());
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth, uint32 numSubdivisions)
 {
 	MeshData meshData;
+	CreateWedge(width, height, depth, numSubdivisions, Allocate(meshData, WedgeCounts(numSubdivisions)));
+	return meshData;
+}
 
+GeometryGenerator::MeshCounts GeometryGenerator::WedgeCounts(uint32 numSubdivisions)
+{
+	// Three quads of five edges and two separate triangles.
+	return SubdividedCounts(18, 3*5 + 2*3, 8, std::min<uint32>(numSubdivisions, 6u));
+}
+
+void GeometryGenerator::CreateWedge(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out)
+{
 	//Create vertices
 	Vertex v[18];
 
@@ -496,7 +663,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 	v[17] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 
 
-	meshData.Vertices.assign(&v[0], &v[18]);
 
 	//
 	// Create the indices.
@@ -523,19 +689,31 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 	i[21] = 14; i[22] = 16; i[23] = 17;
 
 
-	meshData.Indices32.assign(&i[0], &i[24]);
-
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
-
-	return meshData;
+	SubdivideInto(v, 18, i, 8, numSubdivisions, out);
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
 	MeshData meshData;
+	CreateCone(bottomRadius, height, sliceCount, stackCount, Allocate(meshData, ConeCounts(sliceCount, stackCount)));
+	return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::ConeCounts(uint32 sliceCount, uint32 stackCount)
+{
+	// stackCount rings (the apex is a single vertex), a fan to the apex and the
+	// bottom cap (a ring plus its center).
+	MeshCounts counts;
+	counts.VertexCount = stackCount*(sliceCount + 1) + 1 + (sliceCount + 2);
+	counts.IndexCount = (stackCount - 1)*sliceCount*6 + sliceCount*3 + sliceCount*3;
+	return counts;
+}
+
+void GeometryGenerator::CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out)
+{
+	MeshWriter writer(out);
 
 	//
 	// Build Stacks.
@@ -581,7 +759,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, fl
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			writer.AddVertex(vertex);
 		}
 	}
 
@@ -594,43 +772,60 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, fl
 	{
 		for (uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j + 1);
 
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j);
+			writer.AddIndex((i + 1) * ringVertexCount + j + 1);
+			writer.AddIndex(i * ringVertexCount + j + 1);
 		}
 	}
 
-	BuildConeTopCap(height, sliceCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, 0, height, sliceCount, stackCount, meshData);
+	BuildConeTopCap(height, sliceCount, writer);
+	BuildCylinderBottomCap(bottomRadius, 0, height, sliceCount, stackCount, writer);
 
-	return meshData;
+	assert(writer.Complete());
 }
-void GeometryGenerator::BuildConeTopCap(float height, uint32 sliceCount, MeshData& meshData)
+void GeometryGenerator::BuildConeTopCap(float height, uint32 sliceCount, MeshWriter& writer)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size() - (sliceCount + 1);
+	uint32 baseIndex = writer.VertexCount - (sliceCount + 1);
 
 	float y = 0.5f * height;
 
 	//Create top vertex
-	meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.0f));
+	writer.AddVertex(Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.0f));
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size() - 1;
+	uint32 centerIndex = writer.VertexCount - 1;
 
 	for (uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i + 1);
-		meshData.Indices32.push_back(baseIndex + i);
+		writer.AddIndex(centerIndex);
+		writer.AddIndex(baseIndex + i + 1);
+		writer.AddIndex(baseIndex + i);
 	}
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    CreateSphere(radius, sliceCount, stackCount, Allocate(meshData, SphereCounts(sliceCount, stackCount)));
+    return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::SphereCounts(uint32 sliceCount, uint32 stackCount)
+{
+	// Two poles and stackCount - 1 rings; a fan at each pole and two triangles per quad
+	// in between.
+	MeshCounts counts;
+	counts.VertexCount = 2 + (stackCount - 1)*(sliceCount + 1);
+	counts.IndexCount = 2*sliceCount*3 + (stackCount - 2)*sliceCount*6;
+	return counts;
+}
+
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshSpan& out)
+{
+    MeshWriter writer(out);
 
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
@@ -642,7 +837,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	writer.AddVertex( topVertex );
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
@@ -678,11 +873,11 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 			v.TexC.x = theta / XM_2PI;
 			v.TexC.y = phi / XM_PI;
 
-			meshData.Vertices.push_back( v );
+			writer.AddVertex( v );
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	writer.AddVertex( bottomVertex );
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
@@ -691,9 +886,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		writer.AddIndex(0);
+		writer.AddIndex(i+1);
+		writer.AddIndex(i);
 	}
 	
 	//
@@ -708,13 +903,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j);
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j);
+			writer.AddIndex(baseIndex + i*ringVertexCount + j+1);
+			writer.AddIndex(baseIndex + (i+1)*ringVertexCount + j+1);
 		}
 	}
 
@@ -724,30 +919,66 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	//
 
 	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 southPoleIndex = writer.VertexCount-1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		writer.AddIndex(southPoleIndex);
+		writer.AddIndex(baseIndex+i);
+		writer.AddIndex(baseIndex+i+1);
 	}
 
-    return meshData;
+    assert(writer.Complete());
 }
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+	uint32 vertexCount = (uint32)meshData.Vertices.size();
+	uint32 numTris = (uint32)meshData.Indices32.size()/3;
 
+	// At most one new vertex per edge, and so at most three per triangle.
+	meshData.Vertices.resize(vertexCount + 3*numTris);
+	meshData.Indices32.resize(numTris*12);
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+	EdgeTable edges;
+	vertexCount = SubdivideLevel(meshData.Vertices.data(), vertexCount, meshData.Indices32.data(), numTris, edges);
+	meshData.Vertices.resize(vertexCount);
+}
 
+void GeometryGenerator::SubdivideInto(const Vertex* vertices, uint32 vertexCount, const uint32* indices, uint32 triCount,
+									  uint32 numSubdivisions, const MeshSpan& out)
+{
+	std::copy(vertices, vertices + vertexCount, out.Vertices);
+	std::copy(indices, indices + 3*triCount, out.Indices);
+
+	EdgeTable localEdges;
+	EdgeTable& edges = out.Edges ? *out.Edges : localEdges;
+	if(numSubdivisions > 0)
+	{
+		uint32 lastTriCount = triCount;
+		for(uint32 level = 1; level < numSubdivisions; ++level)
+			lastTriCount *= 4;
+
+		const std::size_t size = EdgeTableSize(3*lastTriCount);
+		edges.Keys.reserve(size);
+		edges.Midpoints.reserve(size);
+	}
+
+	for(uint32 level = 0; level < numSubdivisions; ++level)
+	{
+		vertexCount = SubdivideLevel(out.Vertices, vertexCount, out.Indices, triCount, edges);
+		triCount *= 4;
+	}
+
+	assert(vertexCount == out.VertexCount && 3*triCount == out.IndexCount);
+}
+
+GeometryGenerator::uint32 GeometryGenerator::SubdivideLevel(Vertex* vertices, uint32 vertexCount, uint32* indices, uint32 triCount,
+														   EdgeTable& edges)
+{
 	//       v1
 	//       *
 	//      / \
@@ -758,48 +989,233 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+	ResetEdgeTable(edges, 3*triCount);
+
+	//
+	// Generate the midpoints, one per edge, in triangle order.
+	//
+
+	for(uint32 i = 0; i < triCount; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
-
-		//
-		// Generate the midpoints.
-		//
-
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		const uint32 v0 = indices[i*3+0];
+		const uint32 v1 = indices[i*3+1];
+		const uint32 v2 = indices[i*3+2];
+
+		FindOrAddMidpoint(edges, vertices, vertexCount, v0, v1);
+		FindOrAddMidpoint(edges, vertices, vertexCount, v1, v2);
+		FindOrAddMidpoint(edges, vertices, vertexCount, v0, v2);
+	}
+
+	//
+	// Add the new triangles.  They are written last triangle first: triangle i writes
+	// indices [12i, 12i + 12), which only overlaps triangles already read.
+	//
+
+	for(uint32 i = triCount; i-- > 0; )
+	{
+		const uint32 v0 = indices[i*3+0];
+		const uint32 v1 = indices[i*3+1];
+		const uint32 v2 = indices[i*3+2];
+
+		const uint32 m0 = FindMidpoint(edges, v0, v1);
+		const uint32 m1 = FindMidpoint(edges, v1, v2);
+		const uint32 m2 = FindMidpoint(edges, v0, v2);
+
+		uint32* k = indices + i*12;
+		k[0] = v0; k[1]  = m0; k[2]  = m2;
+		k[3] = m0; k[4]  = m1; k[5]  = m2;
+		k[6] = m2; k[7]  = m1; k[8]  = v2;
+		k[9] = m0; k[10] = v1; k[11] = m1;
+	}
+
+	return vertexCount;
+}
+
+namespace
+{
+	const std::uint64_t EmptyEdge = ~0ull;
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+	std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+	{
+		// Either direction of an edge gives the same key.
+		return a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+	}
+
+	std::size_t EdgeSlot(std::uint64_t key, std::size_t mask)
+	{
+		return (std::size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	}
+}
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+std::size_t GeometryGenerator::EdgeTableSize(uint32 edgeCount)
+{
+	// At most half full.
+	std::size_t size = 16;
+	while(size < 2*(std::size_t)edgeCount)
+		size *= 2;
+	return size;
+}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+void GeometryGenerator::ResetEdgeTable(EdgeTable& edges, uint32 edgeCount)
+{
+	// Within the reserved capacity, neither call allocates.
+	const std::size_t size = EdgeTableSize(edgeCount);
+	edges.Keys.assign(size, EmptyEdge);
+	edges.Midpoints.resize(size);
+}
+
+GeometryGenerator::uint32 GeometryGenerator::FindOrAddMidpoint(EdgeTable& edges, Vertex* vertices, uint32& vertexCount, uint32 a, uint32 b)
+{
+	const std::uint64_t key = EdgeKey(a, b);
+	const std::size_t mask = edges.Keys.size() - 1;
+
+	std::size_t slot = EdgeSlot(key, mask);
+	while(edges.Keys[slot] != EmptyEdge)
+	{
+		if(edges.Keys[slot] == key)
+			return edges.Midpoints[slot];
+		slot = (slot + 1) & mask;
 	}
+
+	// MidPoint is symmetric, so the vertex does not depend on which triangle comes first.
+	vertices[vertexCount] = MidPoint(vertices[a], vertices[b]);
+	edges.Keys[slot] = key;
+	edges.Midpoints[slot] = vertexCount;
+	return vertexCount++;
+}
+
+GeometryGenerator::uint32 GeometryGenerator::FindMidpoint(const EdgeTable& edges, uint32 a, uint32 b)
+{
+	const std::uint64_t key = EdgeKey(a, b);
+	const std::size_t mask = edges.Keys.size() - 1;
+
+	std::size_t slot = EdgeSlot(key, mask);
+	while(edges.Keys[slot] != key)
+	{
+		assert(edges.Keys[slot] != EmptyEdge);
+		slot = (slot + 1) & mask;
+	}
+	return edges.Midpoints[slot];
+}
+
+namespace
+{
+	struct WeldCell
+	{
+		int X, Y, Z;
+		std::uint32_t Head;
+	};
+
+	const std::uint32_t EmptyCell = ~0u;
+
+	std::size_t CellSlot(int x, int y, int z, std::size_t mask)
+	{
+		const std::uint64_t h = (std::uint64_t)(std::uint32_t)x * 0x9E3779B97F4A7C15ull ^
+			(std::uint64_t)(std::uint32_t)y * 0xC2B2AE3D27D4EB4Full ^
+			(std::uint64_t)(std::uint32_t)z * 0x165667B19E3779F9ull;
+		return (std::size_t)(h >> 32) & mask;
+	}
+}
+
+GeometryGenerator::uint32 GeometryGenerator::Weld(MeshData& meshData, float epsilon)
+{
+	// The comparison loads the eleven floats of a vertex as three overlapping vectors.
+	static_assert(sizeof(Vertex) == 11*sizeof(float), "Vertex must be eleven packed floats.");
+
+	std::vector<Vertex>& vertices = meshData.Vertices;
+	const uint32 vertexCount = (uint32)vertices.size();
+
+	// Vertices are bucketed by position in cells at least 2*epsilon wide, so a match is
+	// in the vertex's own cell or, when it lies within epsilon of a cell face, in the
+	// neighbor across that face.
+	const float cellSize = std::max(2.0f*epsilon, 1e-4f);
+	const float invCellSize = 1.0f / cellSize;
+	const XMVECTOR eps = XMVectorReplicate(epsilon);
+
+	std::size_t tableSize = 16;
+	while(tableSize < 2*(std::size_t)vertexCount)
+		tableSize *= 2;
+	const std::size_t mask = tableSize - 1;
+
+	WeldCell empty = { 0, 0, 0, EmptyCell };
+	std::vector<WeldCell> cells(tableSize, empty);
+
+	// Kept vertices of a cell are chained through next, by their new index.
+	std::vector<uint32> next(vertexCount);
+	std::vector<uint32> remap(vertexCount);
+
+	// Kept vertices are moved down to their new index as soon as they are found.  The
+	// new index is never above the old one, so nothing not yet visited is overwritten.
+	uint32 keptCount = 0;
+	for(uint32 v = 0; v < vertexCount; ++v)
+	{
+		const float* f = &vertices[v].Position.x;
+		const XMVECTOR a0 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(f + 0));
+		const XMVECTOR a1 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(f + 4));
+		const XMVECTOR a2 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(f + 7));
+
+		int cell[3];
+		int lo[3];
+		int hi[3];
+		for(int k = 0; k < 3; ++k)
+		{
+			const float p = f[k]*invCellSize;
+			cell[k] = (int)floorf(p);
+			lo[k] = (p - cell[k])*cellSize <= epsilon ? -1 : 0;
+			hi[k] = (cell[k] + 1 - p)*cellSize <= epsilon ? 1 : 0;
+		}
+
+		uint32 match = EmptyCell;
+		for(int dx = lo[0]; dx <= hi[0] && match == EmptyCell; ++dx)
+		for(int dy = lo[1]; dy <= hi[1] && match == EmptyCell; ++dy)
+		for(int dz = lo[2]; dz <= hi[2] && match == EmptyCell; ++dz)
+		{
+			const int x = cell[0] + dx, y = cell[1] + dy, z = cell[2] + dz;
+			std::size_t slot = CellSlot(x, y, z, mask);
+			while(cells[slot].Head != EmptyCell && (cells[slot].X != x || cells[slot].Y != y || cells[slot].Z != z))
+				slot = (slot + 1) & mask;
+
+			for(uint32 c = cells[slot].Head; c != EmptyCell; c = next[c])
+			{
+				const float* g = &vertices[c].Position.x;
+				if(XMVector4NearEqual(a0, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(g + 0)), eps) &&
+				   XMVector4NearEqual(a1, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(g + 4)), eps) &&
+				   XMVector4NearEqual(a2, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(g + 7)), eps))
+				{
+					match = c;
+					break;
+				}
+			}
+		}
+
+		if(match != EmptyCell)
+		{
+			remap[v] = match;
+			continue;
+		}
+
+		std::size_t slot = CellSlot(cell[0], cell[1], cell[2], mask);
+		while(cells[slot].Head != EmptyCell && (cells[slot].X != cell[0] || cells[slot].Y != cell[1] || cells[slot].Z != cell[2]))
+			slot = (slot + 1) & mask;
+
+		if(cells[slot].Head == EmptyCell)
+		{
+			cells[slot].X = cell[0];
+			cells[slot].Y = cell[1];
+			cells[slot].Z = cell[2];
+		}
+
+		vertices[keptCount] = vertices[v];
+		next[keptCount] = cells[slot].Head;
+		cells[slot].Head = keptCount;
+		remap[v] = keptCount++;
+	}
+
+	vertices.resize(keptCount);
+	for(auto& i : meshData.Indices32)
+		i = remap[i];
+
+	return keptCount;
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -835,7 +1251,18 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
 GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
     MeshData meshData;
+    CreateGeosphere(radius, numSubdivisions, Allocate(meshData, GeosphereCounts(numSubdivisions)));
+    return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::GeosphereCounts(uint32 numSubdivisions)
+{
+	// The icosahedron.
+	return SubdividedCounts(12, 30, 20, std::min<uint32>(numSubdivisions, 6u));
+}
 
+void GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, const MeshSpan& out)
+{
 	// Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
@@ -862,54 +1289,68 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
-
+	// Only the positions matter; everything else is recomputed below.
+	const XMFLOAT3 zero(0.0f, 0.0f, 0.0f);
+	Vertex v[12];
 	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+		v[i] = Vertex(pos[i], zero, zero, XMFLOAT2(0.0f, 0.0f));
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	SubdivideInto(v, 12, k, 20, numSubdivisions, out);
 
 	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+	Vertex* vertices = out.Vertices;
+	for(uint32 i = 0; i < out.VertexCount; ++i)
 	{
 		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertices[i].Position));
 
 		// Project onto sphere.
 		XMVECTOR p = radius*n;
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		XMStoreFloat3(&vertices[i].Position, p);
+		XMStoreFloat3(&vertices[i].Normal, n);
 
 		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+        float theta = atan2f(vertices[i].Position.z, vertices[i].Position.x);
 
         // Put in [0, 2pi].
         if(theta < 0.0f)
             theta += XM_2PI;
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+		float phi = acosf(vertices[i].Position.y / radius);
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+		vertices[i].TexC.x = theta/XM_2PI;
+		vertices[i].TexC.y = phi/XM_PI;
 
 		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+		vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
+		vertices[i].TangentU.y = 0.0f;
+		vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
+		XMVECTOR T = XMLoadFloat3(&vertices[i].TangentU);
+		XMStoreFloat3(&vertices[i].TangentU, XMVector3Normalize(T));
 	}
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, Allocate(meshData, CylinderCounts(sliceCount, stackCount)));
+    return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::CylinderCounts(uint32 sliceCount, uint32 stackCount)
+{
+	// stackCount + 1 rings, and a ring plus its center for each cap.
+	MeshCounts counts;
+	counts.VertexCount = (stackCount + 1)*(sliceCount + 1) + 2*(sliceCount + 2);
+	counts.IndexCount = stackCount*sliceCount*6 + 2*sliceCount*3;
+	return counts;
+}
+
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out)
+{
+    MeshWriter writer(out);
 
 	//
 	// Build Stacks.
@@ -972,7 +1413,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			writer.AddVertex(vertex);
 		}
 	}
 
@@ -985,26 +1426,26 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j+1);
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j);
+			writer.AddIndex((i+1)*ringVertexCount + j+1);
+			writer.AddIndex(i*ringVertexCount + j+1);
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, writer);
+	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, writer);
 
-    return meshData;
+    assert(writer.Complete());
 }
 
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											uint32 sliceCount, uint32 stackCount, MeshWriter& writer)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = writer.VertexCount;
 
 	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
@@ -1020,31 +1461,31 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		writer.AddVertex( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	writer.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = writer.VertexCount-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		writer.AddIndex(centerIndex);
+		writer.AddIndex(baseIndex + i+1);
+		writer.AddIndex(baseIndex + i);
 	}
 }
 
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											   uint32 sliceCount, uint32 stackCount, MeshWriter& writer)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = writer.VertexCount;
 	float y = -0.5f*height;
 
 	// vertices of ring
@@ -1059,29 +1500,41 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		writer.AddVertex( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	writer.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = writer.VertexCount-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		writer.AddIndex(centerIndex);
+		writer.AddIndex(baseIndex + i);
+		writer.AddIndex(baseIndex + i+1);
 	}
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
     MeshData meshData;
+    CreateGrid(width, depth, m, n, Allocate(meshData, GridCounts(m, n)));
+    return meshData;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::GridCounts(uint32 m, uint32 n)
+{
+	MeshCounts counts;
+	counts.VertexCount = m*n;
+	counts.IndexCount = (m-1)*(n-1)*2*3;
+	return counts;
+}
 
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, const MeshSpan& out)
+{
+	assert(out.VertexCount == m*n && out.IndexCount == (m-1)*(n-1)*6);
 
 	//
 	// Create the vertices.
@@ -1096,7 +1549,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
+	Vertex* vertices = out.Vertices;
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
@@ -1104,13 +1557,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
+			vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			vertices[i*n+j].TexC.x = j*du;
+			vertices[i*n+j].TexC.y = i*dv;
 		}
 	}
  
@@ -1118,7 +1571,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
+	uint32* indices = out.Indices;
 
 	// Iterate over each quad and compute indices.
 	uint32 k = 0;
@@ -1126,60 +1579,71 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	{
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			indices[k]   = i*n+j;
+			indices[k+1] = i*n+j+1;
+			indices[k+2] = (i+1)*n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			indices[k+3] = (i+1)*n+j;
+			indices[k+4] = i*n+j+1;
+			indices[k+5] = (i+1)*n+j+1;
 
 			k += 6; // next quad
 		}
 	}
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
 {
     MeshData meshData;
+    CreateQuad(x, y, w, h, depth, Allocate(meshData, QuadCounts()));
+    return meshData;
+}
 
-	meshData.Vertices.resize(4);
-	meshData.Indices32.resize(6);
+GeometryGenerator::MeshCounts GeometryGenerator::QuadCounts()
+{
+	MeshCounts counts;
+	counts.VertexCount = 4;
+	counts.IndexCount = 6;
+	return counts;
+}
+
+void GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, const MeshSpan& out)
+{
+	assert(out.VertexCount == 4 && out.IndexCount == 6);
+
+	Vertex* vertices = out.Vertices;
+	uint32* indices = out.Indices;
 
 	// Position coordinates specified in NDC space.
-	meshData.Vertices[0] = Vertex(
+	vertices[0] = Vertex(
         x, y - h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		0.0f, 1.0f);
 
-	meshData.Vertices[1] = Vertex(
+	vertices[1] = Vertex(
 		x, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		0.0f, 0.0f);
 
-	meshData.Vertices[2] = Vertex(
+	vertices[2] = Vertex(
 		x+w, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		1.0f, 0.0f);
 
-	meshData.Vertices[3] = Vertex(
+	vertices[3] = Vertex(
 		x+w, y-h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		1.0f, 1.0f);
 
-	meshData.Indices32[0] = 0;
-	meshData.Indices32[1] = 1;
-	meshData.Indices32[2] = 2;
-
-	meshData.Indices32[3] = 0;
-	meshData.Indices32[4] = 2;
-	meshData.Indices32[5] = 3;
+	indices[0] = 0;
+	indices[1] = 1;
+	indices[2] = 2;
 
-    return meshData;
+	indices[3] = 0;
+	indices[4] = 2;
+	indices[5] = 3;
 }
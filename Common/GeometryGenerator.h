@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
@@ -74,17 +75,86 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	// Vertex and index counts of a generated mesh.
+	struct MeshCounts
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	// Open-addressed edge -> midpoint table used while subdividing.  It belongs to the
+	// caller, not to the generator, so one generator can be shared by threads; a caller
+	// that keeps it between meshes only allocates it for the largest one.
+	struct EdgeTable
+	{
+		std::vector<std::uint64_t> Keys;
+		std::vector<uint32> Midpoints;
+	};
+
+	// Caller-owned storage for one mesh.  A generator that writes into a MeshSpan fills
+	// exactly VertexCount vertices and IndexCount indices, and the span must be sized
+	// with the matching *Counts function.  The subdivided shapes use Edges as scratch
+	// if it is set and a table of their own otherwise.
+	struct MeshSpan
+	{
+		Vertex* Vertices = nullptr;
+		uint32* Indices = nullptr;
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+		EdgeTable* Edges = nullptr;
+	};
+
+	// Bump allocator that packs many meshes into one vertex array and one index array,
+	// allocated once up front.  The offset of a span from Vertices()/Indices() is the
+	// base vertex and start index of the mesh in the combined buffers.  Its spans share
+	// the arena's edge table, so once the largest subdivided mesh has been written
+	// (after a Reset too) writing into the arena allocates nothing.
+	class MeshArena
+	{
+	public:
+		MeshArena(uint32 vertexCapacity, uint32 indexCapacity);
+
+		// Returns storage for a mesh of the given counts, or an empty span (null pointers)
+		// if the arena does not have room for it.
+		MeshSpan Allocate(const MeshCounts& counts);
+
+		// Forgets every allocation; the storage is kept.
+		void Reset();
+
+		uint32 VertexCount()const;
+		uint32 IndexCount()const;
+		const Vertex* Vertices()const;
+		const uint32* Indices()const;
+
+	private:
+		std::vector<Vertex> mVertices;
+		std::vector<uint32> mIndices;
+		EdgeTable mEdges;
+		uint32 mVertexCount = 0;
+		uint32 mIndexCount = 0;
+	};
+
+	//
+	// Every shape comes in three forms: a *Counts function that gives the exact size of
+	// the mesh, a Create* that writes into caller storage of that size, and a Create*
+	// that returns a MeshData allocated to that size.  None of them grows a buffer.
+	//
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
 	///</summary>
     MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
+	void CreateBox(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out);
+	static MeshCounts BoxCounts(uint32 numSubdivisions);
 
 	///<summary>
 	/// Creates a sphere centered at the origin with the given radius.  The
 	/// slices and stacks parameters control the degree of tessellation.
 	///</summary>
     MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount);
+	void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshSpan& out);
+	static MeshCounts SphereCounts(uint32 sliceCount, uint32 stackCount);
 	/// <summary>
 	/// //create Cone
 	/// </summary>
@@ -94,6 +164,8 @@ public:
 	/// <param name="stackCount"></param>
 	/// <returns></returns>
 	MeshData CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount);
+	void CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out);
+	static MeshCounts ConeCounts(uint32 sliceCount, uint32 stackCount);
 	/// <summary>
 	/// pyramid
 	/// </summary>
@@ -103,6 +175,8 @@ public:
 	/// <param name="numSubdivisions"></param>
 	/// <returns></returns>
 	MeshData CreatePyramid(float width, float height, float depth, uint32 numSubdivisions);
+	void CreatePyramid(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out);
+	static MeshCounts PyramidCounts(uint32 numSubdivisions);
 	/// <summary>
 	/// 
 	/// </summary>
@@ -112,14 +186,20 @@ public:
 	/// <param name="numSubdivisions"></param>
 	/// <returns></returns>
 	MeshData CreateDiamond(float width, float height, float depth, uint32 numSubdivisions);
+	void CreateDiamond(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out);
+	static MeshCounts DiamondCounts(uint32 numSubdivisions);
 	/// <summary>
 	/// 
 	/// </summary>
-	MeshData GeometryGenerator::CreateTorus(float radius, float crossRadius, uint32 sliceCount, uint32 crossCount);
+	MeshData CreateTorus(float radius, float crossRadius, uint32 sliceCount, uint32 crossCount);
+	void CreateTorus(float radius, float crossRadius, uint32 sliceCount, uint32 crossCount, const MeshSpan& out);
+	static MeshCounts TorusCounts(uint32 sliceCount, uint32 crossCount);
 	/// <summary>
 	/// 
 	/// </summary>
-	MeshData GeometryGenerator::CreateTriangularPrism(float bottomRadius, float topRadius, float height, uint32 stackCount);
+	MeshData CreateTriangularPrism(float bottomRadius, float topRadius, float height, uint32 stackCount);
+	void CreateTriangularPrism(float bottomRadius, float topRadius, float height, uint32 stackCount, const MeshSpan& out);
+	static MeshCounts TriangularPrismCounts(uint32 stackCount);
 	/// <summary>
 	/// wedge
 	/// </summary>
@@ -129,11 +209,15 @@ public:
 	/// <param name="numSubdivisions"></param>
 	/// <returns></returns>
 	MeshData CreateWedge(float width, float height, float depth, uint32 numSubdivisions);
+	void CreateWedge(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out);
+	static MeshCounts WedgeCounts(uint32 numSubdivisions);
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
 	/// depth controls the level of tessellation.
 	///</summary>
     MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
+	void CreateGeosphere(float radius, uint32 numSubdivisions, const MeshSpan& out);
+	static MeshCounts GeosphereCounts(uint32 numSubdivisions);
 
 	///<summary>
 	/// Creates a cylinder parallel to the y-axis, and centered about the origin.  
@@ -141,24 +225,68 @@ public:
 	// cylinders.  The slices and stacks parameters control the degree of tessellation.
 	///</summary>
     MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+	void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out);
+	static MeshCounts CylinderCounts(uint32 sliceCount, uint32 stackCount);
 
 	///<summary>
 	/// Creates an mxn grid in the xz-plane with m rows and n columns, centered
 	/// at the origin with the specified width and depth.
 	///</summary>
     MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
+	void CreateGrid(float width, float depth, uint32 m, uint32 n, const MeshSpan& out);
+	static MeshCounts GridCounts(uint32 m, uint32 n);
 
 	///<summary>
 	/// Creates a quad aligned with the screen.  This is useful for postprocessing and screen effects.
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
+	void CreateQuad(float x, float y, float w, float h, float depth, const MeshSpan& out);
+	static MeshCounts QuadCounts();
+
+	///<summary>
+	/// Splits every triangle into four.  Triangles that share an edge (by vertex index)
+	/// share its midpoint, so no vertex is duplicated.
+	///</summary>
 	void Subdivide(MeshData& meshData);
+
+	///<summary>
+	/// Merges vertices whose position, normal, tangent and texture coordinates all
+	/// agree to within epsilon, keeping the first of each group, and renumbers the
+	/// indices.  Returns the new vertex count.
+	///</summary>
+	uint32 Weld(MeshData& meshData, float epsilon);
 private:
-	
-    Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-	void BuildConeTopCap(float height, uint32 sliceCount, MeshData& meshData);
+	struct MeshWriter;
+
+	// Sizes meshData to counts and returns its storage.
+	static MeshSpan Allocate(MeshData& meshData, const MeshCounts& counts);
+
+	// Counts of a mesh of vertexCount vertices, edgeCount distinct edges and triCount
+	// triangles after numSubdivisions rounds of Subdivide.
+	static MeshCounts SubdividedCounts(uint32 vertexCount, uint32 edgeCount, uint32 triCount, uint32 numSubdivisions);
+
+	// Writes the base mesh subdivided numSubdivisions times into out.  Only out is used
+	// for the intermediate levels, and the edge table is sized for the last level up
+	// front so it grows at most once.
+	void SubdivideInto(const Vertex* vertices, uint32 vertexCount, const uint32* indices, uint32 triCount,
+		uint32 numSubdivisions, const MeshSpan& out);
 
+	// One round of Subdivide in place.  The midpoints go after the vertexCount vertices
+	// and the 12*triCount indices replace the 3*triCount; both arrays must have room.
+	// Returns the new vertex count.
+	uint32 SubdivideLevel(Vertex* vertices, uint32 vertexCount, uint32* indices, uint32 triCount, EdgeTable& edges);
+
+	// Slots of a table for at most edgeCount edges.
+	static std::size_t EdgeTableSize(uint32 edgeCount);
+
+	// Clears edges for at most edgeCount edges.
+	static void ResetEdgeTable(EdgeTable& edges, uint32 edgeCount);
+	uint32 FindOrAddMidpoint(EdgeTable& edges, Vertex* vertices, uint32& vertexCount, uint32 a, uint32 b);
+	static uint32 FindMidpoint(const EdgeTable& edges, uint32 a, uint32 b);
+
+    Vertex MidPoint(const Vertex& v0, const Vertex& v1);
+    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& writer);
+    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& writer);
+	void BuildConeTopCap(float height, uint32 sliceCount, MeshWriter& writer);
 };
 
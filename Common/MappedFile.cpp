@@ -0,0 +1,126 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mFile = file;
+	if(size.QuadPart == 0)
+		return true;
+
+	mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mData = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = (std::size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(mData != nullptr)
+		UnmapViewOfFile(mData);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != nullptr)
+		CloseHandle(mFile);
+
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mFile = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	if(st.st_size > 0)
+	{
+		void* data = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+
+		mData = data;
+		mSize = (std::size_t)st.st_size;
+	}
+
+	// The mapping stays valid after the descriptor is closed.
+	close(fd);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(mData != nullptr)
+		munmap(const_cast<void*>(mData), mSize);
+
+	mData = nullptr;
+	mSize = 0;
+}
+
+#endif
+
+const void* MappedFile::Data()const
+{
+	return mData;
+}
+
+std::size_t MappedFile::Size()const
+{
+	return mSize;
+}
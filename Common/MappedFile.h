@@ -0,0 +1,40 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file.  The contents are paged in by the OS as
+// they are touched instead of being read into a buffer up front.
+//***************************************************************************************
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	~MappedFile();
+
+	// Maps the file, replacing any previous mapping.  Returns false if the file cannot be
+	// opened or mapped (an empty file maps to Size() == 0 and no data).
+	bool Open(const std::string& filename);
+	void Close();
+
+	const void* Data()const;
+	std::size_t Size()const;
+
+private:
+	const void* mData = nullptr;
+	std::size_t mSize = 0;
+
+#if defined(_WIN32)
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,384 @@
+//***************************************************************************************
+// MeshClusterizer.cpp
+//***************************************************************************************
+
+#include "MeshClusterizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	typedef MeshClusterizer::uint32 uint32;
+
+	const uint32 NoTriangle = ~0u;
+
+	// Normals spread wider than about 84 degrees from the axis leave a cone that no eye
+	// position could pass, so the cluster gets none.
+	const float MinConeDot = 0.1f;
+
+	XMVECTOR TriangleNormal(const GeometryGenerator::Vertex* vertices, const uint32* tri)
+	{
+		const XMVECTOR p0 = XMLoadFloat3(&vertices[tri[0]].Position);
+		const XMVECTOR p1 = XMLoadFloat3(&vertices[tri[1]].Position);
+		const XMVECTOR p2 = XMLoadFloat3(&vertices[tri[2]].Position);
+		return XMVector3Cross(p1 - p0, p2 - p0);
+	}
+
+	void ComputeBounds(const GeometryGenerator::Vertex* vertices, const uint32* clusterVertices,
+		std::size_t vertexCount, const uint32* indices, uint32 triCount, MeshClusterizer::Cluster& cluster)
+	{
+		// Sphere around the center of the bounding box.
+		XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+		for(std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const XMVECTOR p = XMLoadFloat3(&vertices[clusterVertices[i]].Position);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		const XMVECTOR center = 0.5f*(vMin + vMax);
+		float radiusSq = 0.0f;
+		for(std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const XMVECTOR d = XMLoadFloat3(&vertices[clusterVertices[i]].Position) - center;
+			radiusSq = std::max(radiusSq, XMVectorGetX(XMVector3LengthSq(d)));
+		}
+		XMStoreFloat3(&cluster.Center, center);
+		cluster.Radius = sqrtf(radiusSq);
+
+		// The cone axis is the mean of the unit normals.  The apex goes down the axis
+		// from the center until it is behind the planes of all the triangles; from any
+		// eye within the cone's mirror image beyond the apex, every triangle is seen
+		// from behind.
+		XMVECTOR axis = XMVectorZero();
+		for(uint32 t = 0; t < triCount; ++t)
+		{
+			const XMVECTOR n = TriangleNormal(vertices, indices + t*3);
+			if(XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+				axis += XMVector3Normalize(n);
+		}
+
+		const float axisLength = XMVectorGetX(XMVector3Length(axis));
+		if(axisLength == 0.0f)
+			return;
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		float maxT = -FLT_MAX;
+		for(uint32 t = 0; t < triCount; ++t)
+		{
+			XMVECTOR n = TriangleNormal(vertices, indices + t*3);
+			if(XMVectorGetX(XMVector3LengthSq(n)) == 0.0f)
+				continue;
+			n = XMVector3Normalize(n);
+
+			const float dn = XMVectorGetX(XMVector3Dot(n, axis));
+			minDot = std::min(minDot, dn);
+			if(minDot <= MinConeDot)
+				return;
+
+			const XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t*3]].Position);
+			maxT = std::max(maxT, XMVectorGetX(XMVector3Dot(center - p0, n)) / dn);
+		}
+
+		XMStoreFloat3(&cluster.ConeAxis, axis);
+		XMStoreFloat3(&cluster.ConeApex, center - axis*maxT);
+		cluster.ConeCutoff = sqrtf(1.0f - minDot*minDot);
+	}
+
+	bool PositionLess(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		if(a.x != b.x) return a.x < b.x;
+		if(a.y != b.y) return a.y < b.y;
+		return a.z < b.z;
+	}
+
+	bool PositionEqual(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	float& Lane(XMFLOAT4& v, int lane)
+	{
+		return (&v.x)[lane];
+	}
+}
+
+MeshClusterizer::ClusterSet MeshClusterizer::Build(const uint32* indices, std::size_t indexCount,
+	const GeometryGenerator::Vertex* vertices, std::size_t vertexCount,
+	uint32 maxVertices, uint32 maxTriangles)
+{
+	// A triangle must always fit into an empty cluster.
+	maxVertices = std::max(maxVertices, 3u);
+	maxTriangles = std::max(maxTriangles, 1u);
+
+	const std::size_t triCount = indexCount / 3;
+
+	// Vertices split along seams (the faces of a box, say) still join their triangles
+	// into one surface, so neighbors are found by position.  group[v] is the first
+	// vertex at v's position.
+	std::vector<uint32> group(vertexCount);
+	{
+		std::vector<uint32> order(vertexCount);
+		for(std::size_t v = 0; v < vertexCount; ++v)
+			order[v] = (uint32)v;
+		std::sort(order.begin(), order.end(), [&](uint32 a, uint32 b)
+		{
+			return PositionLess(vertices[a].Position, vertices[b].Position);
+		});
+
+		for(std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const bool same = i > 0 && PositionEqual(vertices[order[i]].Position, vertices[order[i - 1]].Position);
+			group[order[i]] = same ? group[order[i - 1]] : order[i];
+		}
+	}
+
+	// Triangles at each position.
+	std::vector<uint32> offsets(vertexCount + 1, 0);
+	for(std::size_t i = 0; i < triCount*3; ++i)
+		++offsets[group[indices[i]] + 1];
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] += offsets[v];
+
+	std::vector<uint32> adjacency(triCount*3);
+	{
+		std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+		for(std::size_t i = 0; i < triCount*3; ++i)
+			adjacency[fill[group[indices[i]]]++] = (uint32)(i / 3);
+	}
+
+	ClusterSet set;
+	set.Indices.reserve(triCount*3);
+
+	std::vector<std::uint8_t> emitted(triCount, 0);
+
+	// Number of the last cluster each vertex went into.
+	std::vector<uint32> stamp(vertexCount, ~0u);
+	std::vector<uint32> clusterVertices;
+	clusterVertices.reserve(maxVertices);
+
+	std::size_t emittedCount = 0;
+	std::size_t cursor = 0;
+	uint32 seed = NoTriangle;
+
+	while(emittedCount < triCount)
+	{
+		const uint32 clusterIndex = (uint32)set.Clusters.size();
+
+		Cluster cluster;
+		cluster.IndexOffset = (uint32)set.Indices.size();
+		clusterVertices.clear();
+		XMVECTOR sum = XMVectorZero();
+
+		// Nothing left next to the last cluster: start from the first triangle left in
+		// input order.
+		if(seed == NoTriangle)
+		{
+			while(emitted[cursor])
+				++cursor;
+			seed = (uint32)cursor;
+		}
+
+		for(uint32 next = seed; next != NoTriangle; )
+		{
+			const uint32* tri = indices + next*3;
+			emitted[next] = 1;
+			++emittedCount;
+			for(int k = 0; k < 3; ++k)
+			{
+				set.Indices.push_back(tri[k]);
+				if(stamp[tri[k]] != clusterIndex)
+				{
+					stamp[tri[k]] = clusterIndex;
+					clusterVertices.push_back(tri[k]);
+					sum += XMLoadFloat3(&vertices[tri[k]].Position);
+				}
+			}
+
+			if(++cluster.TriangleCount == maxTriangles)
+				break;
+
+			// The next triangle touches the cluster, adds the fewest new vertices and lies
+			// nearest the cluster's centroid.
+			const XMVECTOR centroid = sum / (float)clusterVertices.size();
+			next = NoTriangle;
+			uint32 bestNew = 4;
+			float bestDistance = FLT_MAX;
+			for(uint32 v : clusterVertices)
+			{
+				const uint32 g = group[v];
+				for(uint32 i = offsets[g]; i < offsets[g + 1]; ++i)
+				{
+					const uint32 t = adjacency[i];
+					if(emitted[t])
+						continue;
+
+					const uint32* candidate = indices + t*3;
+					const uint32 added =
+						(stamp[candidate[0]] != clusterIndex) +
+						(stamp[candidate[1]] != clusterIndex) +
+						(stamp[candidate[2]] != clusterIndex);
+					if(clusterVertices.size() + added > maxVertices || added > bestNew)
+						continue;
+
+					const XMVECTOR center = (XMLoadFloat3(&vertices[candidate[0]].Position) +
+						XMLoadFloat3(&vertices[candidate[1]].Position) +
+						XMLoadFloat3(&vertices[candidate[2]].Position)) / 3.0f;
+					const float distance = XMVectorGetX(XMVector3LengthSq(center - centroid));
+					if(added < bestNew || distance < bestDistance)
+					{
+						next = t;
+						bestNew = added;
+						bestDistance = distance;
+					}
+				}
+			}
+		}
+
+		cluster.VertexCount = (uint32)clusterVertices.size();
+		ComputeBounds(vertices, clusterVertices.data(), clusterVertices.size(),
+			&set.Indices[cluster.IndexOffset], cluster.TriangleCount, cluster);
+		set.Clusters.push_back(cluster);
+
+		// The next cluster starts next to this one, so the clusters grow across the
+		// surface instead of jumping around it.
+		seed = NoTriangle;
+		for(std::size_t i = 0; i < clusterVertices.size() && seed == NoTriangle; ++i)
+		{
+			const uint32 g = group[clusterVertices[i]];
+			for(uint32 j = offsets[g]; j < offsets[g + 1]; ++j)
+			{
+				if(!emitted[adjacency[j]])
+				{
+					seed = adjacency[j];
+					break;
+				}
+			}
+		}
+	}
+
+	// Lanes past the end keep the negative radius.
+	ClusterBlock empty;
+	empty.CenterX = empty.CenterY = empty.CenterZ = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	empty.Radius = XMFLOAT4(-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+	empty.ApexX = empty.ApexY = empty.ApexZ = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	empty.AxisX = empty.AxisY = empty.AxisZ = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	empty.Cutoff = XMFLOAT4(2.0f, 2.0f, 2.0f, 2.0f);
+	set.Blocks.assign((set.Clusters.size() + 3) / 4, empty);
+
+	for(std::size_t c = 0; c < set.Clusters.size(); ++c)
+	{
+		const Cluster& cluster = set.Clusters[c];
+		ClusterBlock& block = set.Blocks[c / 4];
+		const int lane = (int)(c % 4);
+		Lane(block.CenterX, lane) = cluster.Center.x;
+		Lane(block.CenterY, lane) = cluster.Center.y;
+		Lane(block.CenterZ, lane) = cluster.Center.z;
+		Lane(block.Radius, lane) = cluster.Radius;
+		Lane(block.ApexX, lane) = cluster.ConeApex.x;
+		Lane(block.ApexY, lane) = cluster.ConeApex.y;
+		Lane(block.ApexZ, lane) = cluster.ConeApex.z;
+		Lane(block.AxisX, lane) = cluster.ConeAxis.x;
+		Lane(block.AxisY, lane) = cluster.ConeAxis.y;
+		Lane(block.AxisZ, lane) = cluster.ConeAxis.z;
+		Lane(block.Cutoff, lane) = cluster.ConeCutoff;
+	}
+
+	return set;
+}
+
+MeshClusterizer::ClusterSet MeshClusterizer::Build(const GeometryGenerator::MeshData& mesh,
+	uint32 maxVertices, uint32 maxTriangles)
+{
+	return Build(mesh.Indices32.data(), mesh.Indices32.size(),
+		mesh.Vertices.data(), mesh.Vertices.size(), maxVertices, maxTriangles);
+}
+
+void MeshClusterizer::ExtractFrustumPlanes(FXMMATRIX worldViewProj, XMFLOAT4 planes[6])
+{
+	// A point p is inside when its clip coordinates c = p*M satisfy -w <= x <= w,
+	// -w <= y <= w and 0 <= z <= w.  Each bound is a plane whose coefficients are a
+	// sum or difference of columns of M.
+	const XMMATRIX columns = XMMatrixTranspose(worldViewProj);
+	const XMVECTOR x = columns.r[0];
+	const XMVECTOR y = columns.r[1];
+	const XMVECTOR z = columns.r[2];
+	const XMVECTOR w = columns.r[3];
+
+	XMStoreFloat4(&planes[0], XMPlaneNormalize(w + x));
+	XMStoreFloat4(&planes[1], XMPlaneNormalize(w - x));
+	XMStoreFloat4(&planes[2], XMPlaneNormalize(w + y));
+	XMStoreFloat4(&planes[3], XMPlaneNormalize(w - y));
+	XMStoreFloat4(&planes[4], XMPlaneNormalize(z));
+	XMStoreFloat4(&planes[5], XMPlaneNormalize(w - z));
+}
+
+std::size_t MeshClusterizer::Cull(const ClusterSet& clusters, const XMFLOAT4 planes[6],
+	FXMVECTOR eyePos, uint32* visible)
+{
+	XMVECTOR planeX[6];
+	XMVECTOR planeY[6];
+	XMVECTOR planeZ[6];
+	XMVECTOR planeW[6];
+	for(int i = 0; i < 6; ++i)
+	{
+		const XMVECTOR p = XMLoadFloat4(&planes[i]);
+		planeX[i] = XMVectorSplatX(p);
+		planeY[i] = XMVectorSplatY(p);
+		planeZ[i] = XMVectorSplatZ(p);
+		planeW[i] = XMVectorSplatW(p);
+	}
+
+	const XMVECTOR eyeX = XMVectorSplatX(eyePos);
+	const XMVECTOR eyeY = XMVectorSplatY(eyePos);
+	const XMVECTOR eyeZ = XMVectorSplatZ(eyePos);
+	const XMVECTOR zero = XMVectorZero();
+
+	std::size_t count = 0;
+	for(std::size_t b = 0; b < clusters.Blocks.size(); ++b)
+	{
+		const ClusterBlock& block = clusters.Blocks[b];
+
+		// Inside or touching every plane: distance of the center >= -radius.
+		const XMVECTOR cx = XMLoadFloat4(&block.CenterX);
+		const XMVECTOR cy = XMLoadFloat4(&block.CenterY);
+		const XMVECTOR cz = XMLoadFloat4(&block.CenterZ);
+		const XMVECTOR radius = XMLoadFloat4(&block.Radius);
+
+		XMVECTOR inside = XMVectorTrueInt();
+		for(int i = 0; i < 6; ++i)
+		{
+			XMVECTOR d = XMVectorMultiplyAdd(cx, planeX[i], planeW[i]);
+			d = XMVectorMultiplyAdd(cy, planeY[i], d);
+			d = XMVectorMultiplyAdd(cz, planeZ[i], d);
+			inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(d + radius, zero));
+		}
+
+		// Facing away: dot(apex - eye, axis) > cutoff*|apex - eye|.
+		const XMVECTOR dx = XMLoadFloat4(&block.ApexX) - eyeX;
+		const XMVECTOR dy = XMLoadFloat4(&block.ApexY) - eyeY;
+		const XMVECTOR dz = XMLoadFloat4(&block.ApexZ) - eyeZ;
+		XMVECTOR dot = dx*XMLoadFloat4(&block.AxisX);
+		dot = XMVectorMultiplyAdd(dy, XMLoadFloat4(&block.AxisY), dot);
+		dot = XMVectorMultiplyAdd(dz, XMLoadFloat4(&block.AxisZ), dot);
+		XMVECTOR lengthSq = dx*dx;
+		lengthSq = XMVectorMultiplyAdd(dy, dy, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(dz, dz, lengthSq);
+		const XMVECTOR backFacing = XMVectorGreater(dot, XMLoadFloat4(&block.Cutoff)*XMVectorSqrt(lengthSq));
+
+		uint32 keep[4];
+		XMStoreInt4(keep, XMVectorAndCInt(inside, backFacing));
+		for(int lane = 0; lane < 4; ++lane)
+		{
+			if(keep[lane])
+				visible[count++] = (uint32)(b*4 + lane);
+		}
+	}
+
+	return count;
+}
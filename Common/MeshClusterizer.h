@@ -0,0 +1,102 @@
+//***************************************************************************************
+// MeshClusterizer.h
+//
+// Splits an indexed triangle mesh into small clusters (meshlets) that can be culled one
+// by one.  Build grows each cluster over the surface from a seed triangle, taking the
+// neighbor that adds the fewest new vertices and, among those, the one nearest the
+// cluster, so clusters come out compact.  The triangles are reordered so that every
+// cluster is one contiguous range of the index list.
+//
+// Each cluster gets a bounding sphere and a normal cone.  Cull tests four clusters at a
+// time against the six planes of a frustum and against the cones: a cluster is culled
+// when it is outside the frustum or when every one of its triangles faces away from
+// the eye.  Both tests are conservative, so a culled cluster draws no visible pixel.
+//
+// Everything here runs on the CPU and needs no device.
+//***************************************************************************************
+
+#ifndef MESHCLUSTERIZER_H
+#define MESHCLUSTERIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "GeometryGenerator.h"
+
+class MeshClusterizer
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// Limits Build uses unless told otherwise; 64 vertices and 124 triangles also fit
+	// the mesh shader limits of most GPUs.
+	static const uint32 DefaultMaxVertices = 64;
+	static const uint32 DefaultMaxTriangles = 124;
+
+	struct Cluster
+	{
+		// The cluster's triangles are the TriangleCount*3 entries of ClusterSet::Indices
+		// from IndexOffset.  VertexCount distinct vertices are used.
+		uint32 IndexOffset = 0;
+		uint32 TriangleCount = 0;
+		uint32 VertexCount = 0;
+
+		DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+
+		// Every triangle faces away from an eye at E when
+		//   dot(normalize(ConeApex - E), ConeAxis) > ConeCutoff.
+		// ConeCutoff is above one when the normals spread too far for that to happen.
+		DirectX::XMFLOAT3 ConeApex = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 0.0f };
+		float ConeCutoff = 2.0f;
+	};
+
+	// Bounds of four clusters in struct-of-arrays form, the layout Cull reads.  Lanes
+	// past the last cluster have a negative radius and never pass.
+	struct ClusterBlock
+	{
+		DirectX::XMFLOAT4 CenterX;
+		DirectX::XMFLOAT4 CenterY;
+		DirectX::XMFLOAT4 CenterZ;
+		DirectX::XMFLOAT4 Radius;
+		DirectX::XMFLOAT4 ApexX;
+		DirectX::XMFLOAT4 ApexY;
+		DirectX::XMFLOAT4 ApexZ;
+		DirectX::XMFLOAT4 AxisX;
+		DirectX::XMFLOAT4 AxisY;
+		DirectX::XMFLOAT4 AxisZ;
+		DirectX::XMFLOAT4 Cutoff;
+	};
+
+	struct ClusterSet
+	{
+		std::vector<Cluster> Clusters;
+
+		// The mesh's triangles, reordered cluster by cluster; the same vertices as before.
+		std::vector<uint32> Indices;
+
+		std::vector<ClusterBlock> Blocks;
+	};
+
+	static ClusterSet Build(const uint32* indices, std::size_t indexCount,
+		const GeometryGenerator::Vertex* vertices, std::size_t vertexCount,
+		uint32 maxVertices = DefaultMaxVertices, uint32 maxTriangles = DefaultMaxTriangles);
+
+	static ClusterSet Build(const GeometryGenerator::MeshData& mesh,
+		uint32 maxVertices = DefaultMaxVertices, uint32 maxTriangles = DefaultMaxTriangles);
+
+	// Planes of the view volume of a world-view-projection matrix, normals inward and
+	// normalized, in the space the matrix takes points from.  Pass an object's full
+	// world*view*proj to get planes Cull can use on that object's clusters directly.
+	static void ExtractFrustumPlanes(DirectX::FXMMATRIX worldViewProj, DirectX::XMFLOAT4 planes[6]);
+
+	// Writes the numbers of the clusters that may be visible to visible, in increasing
+	// order, and returns how many there are.  visible needs room for every cluster.
+	// The planes and eyePos are in the mesh's own space.
+	static std::size_t Cull(const ClusterSet& clusters, const DirectX::XMFLOAT4 planes[6],
+		DirectX::FXMVECTOR eyePos, uint32* visible);
+};
+
+#endif // MESHCLUSTERIZER_H
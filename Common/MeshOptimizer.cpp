@@ -0,0 +1,269 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	// Scoring of the cache optimizer, with the constants of Forsyth's article.  The
+	// modelled cache is an LRU of the requested size: a vertex scores higher the more
+	// recently it was used, and vertices with few triangles left get a boost so that
+	// they are finished off instead of being left behind as isolated triangles.
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// Valences below this come from a table.
+	const std::uint32_t MaxValence = 32;
+
+	struct ScoreTables
+	{
+		explicit ScoreTables(int cacheSize)
+		{
+			// The three vertices of the last triangle get a fixed score, so that the next
+			// triangle does not favor one of its edges over the others.
+			const float scale = 1.0f / (cacheSize - 3);
+			for(int i = 0; i < cacheSize; ++i)
+				Cache[i] = i < 3 ? LastTriScore : powf(1.0f - (i - 3)*scale, CacheDecayPower);
+
+			Valence[0] = 0.0f;
+			for(std::uint32_t i = 1; i < MaxValence; ++i)
+				Valence[i] = ValenceBoostScale*powf((float)i, -ValenceBoostPower);
+		}
+
+		float Cache[MeshOptimizer::MaxCacheSize];
+		float Valence[MaxValence];
+	};
+
+	float VertexScore(const ScoreTables& tables, int cachePosition, std::uint32_t remaining)
+	{
+		// No triangles left: the vertex can never be chosen again.
+		if(remaining == 0)
+			return -1.0f;
+
+		float score = cachePosition < 0 ? 0.0f : tables.Cache[cachePosition];
+		score += remaining < MaxValence ? tables.Valence[remaining] :
+			ValenceBoostScale*powf((float)remaining, -ValenceBoostPower);
+		return score;
+	}
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const uint32* indices, std::size_t indexCount,
+	std::size_t vertexCount, uint32 cacheSize)
+{
+	CacheStats stats;
+	if(indexCount < 3)
+		return stats;
+
+	// A vertex is in the FIFO while fewer than cacheSize misses have happened since it
+	// went in; a stamp of 0 means it never has.
+	std::vector<uint32> stamp(vertexCount, 0);
+	uint32 time = cacheSize + 1;
+	uint32 misses = 0;
+	uint32 used = 0;
+
+	for(std::size_t i = 0; i < indexCount; ++i)
+	{
+		const uint32 v = indices[i];
+		if(time - stamp[v] > cacheSize)
+		{
+			if(stamp[v] == 0)
+				++used;
+
+			stamp[v] = time++;
+			++misses;
+		}
+	}
+
+	stats.Acmr = (float)misses / (float)(indexCount / 3);
+	stats.Atvr = (float)misses / (float)used;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32* destination, const uint32* indices,
+	std::size_t indexCount, std::size_t vertexCount, uint32 cacheSize)
+{
+	// Anything below four leaves no room beyond the last triangle to score.
+	const int modelSize = (int)std::min(std::max(cacheSize, 4u), MaxCacheSize);
+	const ScoreTables tables(modelSize);
+
+	const std::size_t triCount = indexCount / 3;
+
+	// The output may overwrite the input.
+	std::vector<uint32> input(indices, indices + triCount*3);
+
+	// Triangles of each vertex.  The first remaining[v] entries of a vertex's list are
+	// the triangles not yet emitted.
+	std::vector<uint32> remaining(vertexCount, 0);
+	for(uint32 v : input)
+		++remaining[v];
+
+	std::vector<uint32> offsets(vertexCount + 1, 0);
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32> adjacency(input.size());
+	{
+		std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+		for(std::size_t i = 0; i < input.size(); ++i)
+			adjacency[fill[input[i]]++] = (uint32)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+
+	std::vector<std::uint8_t> emitted(triCount, 0);
+
+	// The cache briefly holds three more vertices while a triangle is added.
+	uint32 cache[MaxCacheSize + 3];
+	uint32 newCache[MaxCacheSize + 3];
+	int cacheCount = 0;
+
+	const std::size_t none = (std::size_t)-1;
+	std::size_t best = none;
+	std::size_t cursor = 0;
+
+	for(std::size_t out = 0; out < triCount; ++out)
+	{
+		// Nothing in the cache leads anywhere: start again from the first triangle left
+		// in input order.
+		if(best == none)
+		{
+			while(emitted[cursor])
+				++cursor;
+			best = cursor;
+		}
+
+		const uint32* tri = &input[best*3];
+		destination[out*3 + 0] = tri[0];
+		destination[out*3 + 1] = tri[1];
+		destination[out*3 + 2] = tri[2];
+		emitted[best] = 1;
+
+		int newCount = 0;
+		for(int k = 0; k < 3; ++k)
+		{
+			const uint32 v = tri[k];
+
+			// Swap the triangle out of the live part of the vertex's list.
+			uint32* list = &adjacency[offsets[v]];
+			const uint32 count = remaining[v];
+			for(uint32 t = 0; t < count; ++t)
+			{
+				if(list[t] == best)
+				{
+					std::swap(list[t], list[count - 1]);
+					break;
+				}
+			}
+			--remaining[v];
+
+			if(std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				newCache[newCount++] = v;
+		}
+
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			const uint32 v = cache[i];
+			if(v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Vertices pushed out of the cache lose their cache score.
+		for(int i = modelSize; i < newCount; ++i)
+		{
+			const uint32 v = newCache[i];
+			cachePosition[v] = -1;
+			vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+		}
+
+		cacheCount = std::min(newCount, modelSize);
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			const uint32 v = newCache[i];
+			cache[i] = v;
+			cachePosition[v] = i;
+			vertexScore[v] = VertexScore(tables, i, remaining[v]);
+		}
+
+		// Only triangles with a vertex in the cache changed score, and the best next
+		// triangle is almost always one of them.
+		best = none;
+		float bestScore = -1.0f;
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			const uint32 v = cache[i];
+			const uint32* list = &adjacency[offsets[v]];
+			for(uint32 t = 0; t < remaining[v]; ++t)
+			{
+				const uint32* candidate = &input[list[t]*3];
+				const float score = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+				if(score > bestScore)
+				{
+					bestScore = score;
+					best = list[t];
+				}
+			}
+		}
+	}
+}
+
+std::size_t MeshOptimizer::BuildFetchRemap(uint32* remap, const uint32* indices,
+	std::size_t indexCount, std::size_t vertexCount)
+{
+	const uint32 unused = ~0u;
+	std::fill(remap, remap + vertexCount, unused);
+
+	uint32 next = 0;
+	for(std::size_t i = 0; i < indexCount; ++i)
+	{
+		if(remap[indices[i]] == unused)
+			remap[indices[i]] = next++;
+	}
+
+	const std::size_t used = next;
+	for(std::size_t v = 0; v < vertexCount; ++v)
+	{
+		if(remap[v] == unused)
+			remap[v] = next++;
+	}
+
+	return used;
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& mesh)
+{
+	const std::size_t vertexCount = mesh.Vertices.size();
+
+	std::vector<uint32> remap(vertexCount);
+	BuildFetchRemap(remap.data(), mesh.Indices32.data(), mesh.Indices32.size(), vertexCount);
+
+	std::vector<GeometryGenerator::Vertex> vertices(vertexCount);
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		vertices[remap[v]] = mesh.Vertices[v];
+	mesh.Vertices.swap(vertices);
+
+	for(auto& i : mesh.Indices32)
+		i = remap[i];
+}
+
+MeshOptimizer::Report MeshOptimizer::Optimize(GeometryGenerator::MeshData& mesh, uint32 cacheSize)
+{
+	const std::size_t vertexCount = mesh.Vertices.size();
+
+	Report report;
+	report.Before = AnalyzeVertexCache(mesh.Indices32.data(), mesh.Indices32.size(), vertexCount, cacheSize);
+
+	OptimizeVertexCache(mesh.Indices32.data(), mesh.Indices32.data(), mesh.Indices32.size(), vertexCount, cacheSize);
+	OptimizeVertexFetch(mesh);
+
+	report.After = AnalyzeVertexCache(mesh.Indices32.data(), mesh.Indices32.size(), vertexCount, cacheSize);
+	return report;
+}
@@ -0,0 +1,420 @@
+//***************************************************************************************
+// MeshSimplifier.cpp
+//***************************************************************************************
+
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	typedef MeshSimplifier::uint32 uint32;
+
+	// Weighted sum of squared distances to a set of planes ax + by + cz + d = 0, kept
+	// as the ten distinct terms of the symmetric 4x4 matrix, and the sum of the weights.
+	struct Quadric
+	{
+		float A2 = 0.0f, B2 = 0.0f, C2 = 0.0f;
+		float AB = 0.0f, AC = 0.0f, BC = 0.0f;
+		float AD = 0.0f, BD = 0.0f, CD = 0.0f;
+		float D2 = 0.0f;
+		float W = 0.0f;
+	};
+
+	void AddPlane(Quadric& q, float a, float b, float c, float d, float w)
+	{
+		q.A2 += w*a*a; q.B2 += w*b*b; q.C2 += w*c*c;
+		q.AB += w*a*b; q.AC += w*a*c; q.BC += w*b*c;
+		q.AD += w*a*d; q.BD += w*b*d; q.CD += w*c*d;
+		q.D2 += w*d*d;
+		q.W += w;
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& r)
+	{
+		q.A2 += r.A2; q.B2 += r.B2; q.C2 += r.C2;
+		q.AB += r.AB; q.AC += r.AC; q.BC += r.BC;
+		q.AD += r.AD; q.BD += r.BD; q.CD += r.CD;
+		q.D2 += r.D2;
+		q.W += r.W;
+	}
+
+	// Distance error of moving both vertices of a collapse to p: the root mean square
+	// distance from p to the planes of the triangles merged into them, weighted by area.
+	float CollapseError(const Quadric& q, const Quadric& r, const DirectX::XMFLOAT3& p)
+	{
+		Quadric s = q;
+		AddQuadric(s, r);
+
+		const float e =
+			s.A2*p.x*p.x + s.B2*p.y*p.y + s.C2*p.z*p.z +
+			2.0f*(s.AB*p.x*p.y + s.AC*p.x*p.z + s.BC*p.y*p.z) +
+			2.0f*(s.AD*p.x + s.BD*p.y + s.CD*p.z) + s.D2;
+
+		// Rounding can take an exact fit slightly below zero.
+		return s.W > 0.0f ? sqrtf(std::max(e, 0.0f) / s.W) : 0.0f;
+	}
+
+	void TriangleNormal(const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1,
+		const DirectX::XMFLOAT3& p2, float n[3])
+	{
+		const float e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+		const float e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+		n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+		n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+		n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+	}
+
+	struct Collapse
+	{
+		uint32 From;
+		uint32 To;
+		float Error;
+	};
+
+	bool PositionLess(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		if(a.x != b.x) return a.x < b.x;
+		if(a.y != b.y) return a.y < b.y;
+		return a.z < b.z;
+	}
+
+	bool PositionEqual(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+}
+
+std::size_t MeshSimplifier::Simplify(uint32* destination, const uint32* indices, std::size_t indexCount,
+	const GeometryGenerator::Vertex* vertices, std::size_t vertexCount,
+	std::size_t targetIndexCount, float targetError, float* resultError)
+{
+	std::vector<uint32> result(indices, indices + indexCount/3*3);
+	std::size_t triCount = result.size() / 3;
+	const std::size_t targetTriCount = targetIndexCount / 3;
+	float error = 0.0f;
+
+	// Vertices at the same position, sorted next to each other; group[v] is the first
+	// of v's group in that order and stands for the position in everything below.
+	std::vector<uint32> order(vertexCount);
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		order[v] = (uint32)v;
+	std::sort(order.begin(), order.end(), [&](uint32 a, uint32 b)
+	{
+		return PositionLess(vertices[a].Position, vertices[b].Position);
+	});
+
+	std::vector<uint32> group(vertexCount);
+	std::vector<uint32> groupSize(vertexCount, 0);
+	std::vector<uint32> groupStart(vertexCount, 0);
+	for(std::size_t i = 0; i < vertexCount; ++i)
+	{
+		const uint32 v = order[i];
+		if(i > 0 && PositionEqual(vertices[v].Position, vertices[order[i - 1]].Position))
+		{
+			group[v] = group[order[i - 1]];
+		}
+		else
+		{
+			group[v] = v;
+			groupStart[v] = (uint32)i;
+		}
+		++groupSize[group[v]];
+	}
+
+	// A position split over several vertices is a seam and stays put.
+	std::vector<std::uint8_t> locked(vertexCount, 0);
+	for(std::size_t v = 0; v < vertexCount; ++v)
+		locked[v] = groupSize[group[v]] > 1;
+
+	// So does any position on an open or non-manifold edge, found as a directed edge
+	// whose reverse is missing or that is used more than once.
+	{
+		std::vector<std::uint64_t> edges;
+		edges.reserve(result.size());
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				const std::uint64_t a = group[result[t*3 + k]];
+				const std::uint64_t b = group[result[t*3 + (k + 1) % 3]];
+				edges.push_back(a << 32 | b);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for(std::size_t i = 0; i < edges.size(); ++i)
+		{
+			const uint32 a = (uint32)(edges[i] >> 32);
+			const uint32 b = (uint32)edges[i];
+			const std::uint64_t reverse = (std::uint64_t)b << 32 | a;
+			const bool repeated = (i > 0 && edges[i - 1] == edges[i]) ||
+				(i + 1 < edges.size() && edges[i + 1] == edges[i]);
+			if(repeated || !std::binary_search(edges.begin(), edges.end(), reverse))
+			{
+				locked[a] = 1;
+				locked[b] = 1;
+			}
+		}
+	}
+
+	// One quadric per position, from the planes of the triangles around it weighted by
+	// their area.
+	std::vector<Quadric> quadrics(vertexCount);
+	for(std::size_t t = 0; t < triCount; ++t)
+	{
+		const DirectX::XMFLOAT3& p0 = vertices[result[t*3 + 0]].Position;
+		float n[3];
+		TriangleNormal(p0, vertices[result[t*3 + 1]].Position, vertices[result[t*3 + 2]].Position, n);
+
+		const float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(length == 0.0f)
+			continue;
+
+		n[0] /= length; n[1] /= length; n[2] /= length;
+		const float d = -(n[0]*p0.x + n[1]*p0.y + n[2]*p0.z);
+		for(int k = 0; k < 3; ++k)
+			AddPlane(quadrics[group[result[t*3 + k]]], n[0], n[1], n[2], d, 0.5f*length);
+	}
+
+	std::vector<uint32> offsets(vertexCount + 1);
+	std::vector<uint32> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<std::uint8_t> touched(vertexCount);
+	std::vector<uint32> fromRing;
+	std::vector<uint32> toRing;
+
+	// Each pass collapses the cheapest edges first.  A collapse changes the triangles
+	// around its vertex, so every position on them sits out the rest of the pass and
+	// the later checks of that pass still see the mesh as it is.
+	bool done = false;
+	while(!done && triCount > targetTriCount)
+	{
+		// Triangles of each vertex.
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for(std::size_t i = 0; i < triCount*3; ++i)
+			++offsets[result[i] + 1];
+		for(std::size_t v = 0; v < vertexCount; ++v)
+			offsets[v + 1] += offsets[v];
+
+		adjacency.resize(triCount*3);
+		{
+			std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+			for(std::size_t i = 0; i < triCount*3; ++i)
+				adjacency[fill[result[i]]++] = (uint32)(i / 3);
+		}
+
+		// Every inner edge is seen from both of its triangles; keep it once, in its
+		// cheaper direction.
+		collapses.clear();
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				const uint32 a = result[t*3 + k];
+				const uint32 b = result[t*3 + (k + 1) % 3];
+				if(a > b || (locked[a] && locked[b]))
+					continue;
+
+				const Quadric& qa = quadrics[group[a]];
+				const Quadric& qb = quadrics[group[b]];
+				const float toB = locked[a] ? FLT_MAX : CollapseError(qa, qb, vertices[b].Position);
+				const float toA = locked[b] ? FLT_MAX : CollapseError(qa, qb, vertices[a].Position);
+
+				Collapse c;
+				c.From = toB <= toA ? a : b;
+				c.To = toB <= toA ? b : a;
+				c.Error = std::min(toA, toB);
+				collapses.push_back(c);
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+		{
+			return a.Error < b.Error;
+		});
+
+		std::fill(touched.begin(), touched.end(), 0);
+		std::size_t collapsed = 0;
+		for(const Collapse& c : collapses)
+		{
+			if(c.Error > targetError || triCount <= targetTriCount)
+			{
+				done = true;
+				break;
+			}
+
+			const uint32 from = c.From;
+			const uint32 to = c.To;
+			const uint32 toGroup = group[to];
+			if(touched[from] || touched[toGroup])
+				continue;
+
+			// The two ends may share no neighbors but the corners opposite their edge,
+			// or the collapse would fold the surface onto itself.
+			fromRing.clear();
+			for(uint32 i = offsets[from]; i < offsets[from + 1]; ++i)
+			{
+				for(int k = 0; k < 3; ++k)
+				{
+					const uint32 g = group[result[adjacency[i]*3 + k]];
+					if(g != from && g != toGroup)
+						fromRing.push_back(g);
+				}
+			}
+
+			toRing.clear();
+			for(uint32 m = 0; m < groupSize[toGroup]; ++m)
+			{
+				const uint32 member = order[groupStart[toGroup] + m];
+				for(uint32 i = offsets[member]; i < offsets[member + 1]; ++i)
+				{
+					for(int k = 0; k < 3; ++k)
+					{
+						const uint32 g = group[result[adjacency[i]*3 + k]];
+						if(g != from && g != toGroup)
+							toRing.push_back(g);
+					}
+				}
+			}
+
+			std::sort(fromRing.begin(), fromRing.end());
+			fromRing.erase(std::unique(fromRing.begin(), fromRing.end()), fromRing.end());
+			std::sort(toRing.begin(), toRing.end());
+			toRing.erase(std::unique(toRing.begin(), toRing.end()), toRing.end());
+
+			std::size_t shared = 0;
+			for(std::size_t i = 0, j = 0; i < fromRing.size() && j < toRing.size(); )
+			{
+				if(fromRing[i] < toRing[j])
+					++i;
+				else if(toRing[j] < fromRing[i])
+					++j;
+				else
+				{
+					++shared;
+					++i;
+					++j;
+				}
+			}
+			if(shared > 2)
+				continue;
+
+			// The triangles that survive may not turn over or collapse to a line.
+			bool flips = false;
+			for(uint32 i = offsets[from]; i < offsets[from + 1] && !flips; ++i)
+			{
+				const uint32* tri = &result[adjacency[i]*3];
+				if(tri[0] == to || tri[1] == to || tri[2] == to)
+					continue;
+
+				DirectX::XMFLOAT3 p[3];
+				DirectX::XMFLOAT3 q[3];
+				for(int k = 0; k < 3; ++k)
+				{
+					// Another vertex of the target's position would be left on a
+					// zero-area triangle.
+					if(tri[k] != from && group[tri[k]] == toGroup)
+						flips = true;
+
+					p[k] = vertices[tri[k]].Position;
+					q[k] = tri[k] == from ? vertices[to].Position : p[k];
+				}
+
+				float n0[3];
+				float n1[3];
+				TriangleNormal(p[0], p[1], p[2], n0);
+				TriangleNormal(q[0], q[1], q[2], n1);
+				const float dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+				const float length0 = sqrtf(n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2]);
+				const float length1 = sqrtf(n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]);
+				if(dot <= 0.25f*length0*length1)
+					flips = true;
+			}
+			if(flips)
+				continue;
+
+			// The triangles on the edge vanish; the rest take the target vertex.
+			for(uint32 i = offsets[from]; i < offsets[from + 1]; ++i)
+			{
+				uint32* tri = &result[adjacency[i]*3];
+				const bool onEdge = tri[0] == to || tri[1] == to || tri[2] == to;
+				for(int k = 0; k < 3; ++k)
+				{
+					touched[group[tri[k]]] = 1;
+					if(tri[k] == from)
+						tri[k] = to;
+				}
+				if(onEdge)
+					--triCount;
+			}
+
+			AddQuadric(quadrics[toGroup], quadrics[from]);
+			error = std::max(error, c.Error);
+			++collapsed;
+		}
+
+		// Drop the triangles that lost an edge.
+		std::size_t kept = 0;
+		for(std::size_t t = 0; t < result.size() / 3; ++t)
+		{
+			const uint32 a = result[t*3 + 0];
+			const uint32 b = result[t*3 + 1];
+			const uint32 c = result[t*3 + 2];
+			if(a == b || b == c || c == a)
+				continue;
+
+			result[kept*3 + 0] = a;
+			result[kept*3 + 1] = b;
+			result[kept*3 + 2] = c;
+			++kept;
+		}
+		result.resize(kept*3);
+		triCount = kept;
+
+		if(collapsed == 0)
+			break;
+	}
+
+	std::copy(result.begin(), result.end(), destination);
+	if(resultError != nullptr)
+		*resultError = error;
+
+	return result.size();
+}
+
+std::vector<MeshSimplifier::Lod> MeshSimplifier::BuildLods(const GeometryGenerator::MeshData& mesh,
+	uint32 levelCount, float reduction)
+{
+	std::vector<Lod> lods;
+
+	const std::size_t indexCount = mesh.Indices32.size();
+	std::vector<uint32> scratch(indexCount);
+
+	// Every level starts again from the full mesh, so its error is measured against
+	// the original surface rather than the level before.
+	std::size_t previous = indexCount;
+	float error = 0.0f;
+	for(uint32 level = 1; level <= levelCount; ++level)
+	{
+		const std::size_t target = (std::size_t)(previous/3*reduction) * 3;
+
+		float levelError = 0.0f;
+		const std::size_t count = Simplify(scratch.data(), mesh.Indices32.data(), indexCount,
+			mesh.Vertices.data(), mesh.Vertices.size(), target, FLT_MAX, &levelError);
+		if(count*5 > previous*4)
+			break;
+
+		error = std::max(error, levelError);
+
+		Lod lod;
+		lod.Indices.assign(scratch.begin(), scratch.begin() + count);
+		lod.Error = error;
+		lods.push_back(std::move(lod));
+
+		previous = count;
+	}
+
+	return lods;
+}
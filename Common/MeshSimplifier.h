@@ -0,0 +1,57 @@
+//***************************************************************************************
+// MeshSimplifier.h
+//
+// Builds coarser levels of detail of an indexed triangle mesh by quadric error metric
+// edge collapse (Garland and Heckbert, "Surface Simplification Using Quadric Error
+// Metrics").  Every collapse moves a vertex onto one of its neighbors, so a level is
+// only a new index list: it draws from the vertex buffer of the full mesh and several
+// levels can share that buffer.
+//
+// A vertex only moves if it is the one vertex at its position and lies inside the
+// surface.  Vertices on texture or normal seams (where the generator splits a position
+// into several vertices) and on open borders stay where they are, which keeps the
+// texture mapping, the hard edges and the outline of open shapes intact.
+//
+// The error of a level is in the mesh's own units: the largest root mean square
+// distance, weighted by area, from a moved vertex to the planes of the original
+// triangles it took over.  It follows the largest deviation of the surface closely
+// for the generated shapes.  Multiply it by the object's scale to get a world distance.
+//
+// Everything here runs on the CPU and needs no device.
+//***************************************************************************************
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshSimplifier
+{
+public:
+	using uint32 = std::uint32_t;
+
+	struct Lod
+	{
+		std::vector<uint32> Indices;
+		float Error = 0.0f;
+	};
+
+	// Writes a simplified copy of the triangle list to destination, which needs room
+	// for indexCount indices, and returns the number written.  Simplification stops at
+	// targetIndexCount indices, before a collapse would cost more than targetError, or
+	// when no vertex can move any more.  The error reached goes to resultError.
+	static std::size_t Simplify(uint32* destination, const uint32* indices, std::size_t indexCount,
+		const GeometryGenerator::Vertex* vertices, std::size_t vertexCount,
+		std::size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+	// Levels 1 to levelCount of mesh, each with about reduction times the triangles of
+	// the one before.  The chain ends early once a level would no longer remove at
+	// least a fifth of the triangles left.  Errors never decrease along the chain.
+	static std::vector<Lod> BuildLods(const GeometryGenerator::MeshData& mesh,
+		uint32 levelCount, float reduction = 0.5f);
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// MpscRing.h
+//
+// Bounded lock-free queue for many producers and one consumer (after Dmitry Vyukov's
+// bounded MPMC queue).  Every cell carries a sequence number telling whether it is free
+// for the producer claiming that slot or holds a value for the consumer, so neither side
+// ever takes a lock or waits: TryPush fails when the ring is full and TryPop when it is
+// empty.
+//***************************************************************************************
+
+#ifndef MPSCRING_H
+#define MPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+template<typename T>
+class MpscRing
+{
+public:
+	// The capacity is rounded up to a power of two.
+	explicit MpscRing(std::size_t capacity)
+	{
+		std::size_t size = 2;
+		while(size < capacity)
+			size <<= 1;
+
+		mMask = size - 1;
+		mCells.reset(new Cell[size]);
+		for(std::size_t i = 0; i < size; ++i)
+			mCells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpscRing(const MpscRing& rhs) = delete;
+	MpscRing& operator=(const MpscRing& rhs) = delete;
+
+	std::size_t Capacity()const
+	{
+		return mMask + 1;
+	}
+
+	// Any thread.  Returns false, without blocking, if the ring is full.
+	bool TryPush(const T& value)
+	{
+		Cell* cell;
+		std::size_t pos = mTail.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			cell = &mCells[pos & mMask];
+			const std::size_t seq = cell->Sequence.load(std::memory_order_acquire);
+			const std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+
+			if(diff == 0)
+			{
+				// The slot is free; claim it.
+				if(mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+			{
+				// The consumer has not freed this slot from the previous lap yet.
+				return false;
+			}
+			else
+			{
+				// Another producer claimed it first.
+				pos = mTail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->Value = value;
+		cell->Sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only.  Returns false if the next value has not been published yet.
+	bool TryPop(T& value)
+	{
+		Cell& cell = mCells[mHead & mMask];
+		const std::size_t seq = cell.Sequence.load(std::memory_order_acquire);
+		if((std::intptr_t)seq - (std::intptr_t)(mHead + 1) < 0)
+			return false;
+
+		value = cell.Value;
+		cell.Sequence.store(mHead + mMask + 1, std::memory_order_release);
+		++mHead;
+		return true;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<std::size_t> Sequence;
+		T Value;
+	};
+
+	std::unique_ptr<Cell[]> mCells;
+	std::size_t mMask = 0;
+
+	// Producers and the consumer work on different ends; keep them on separate cache
+	// lines.  (Padding rather than alignas, which heap allocation would not honor.)
+	char mPad0[64];
+	std::atomic<std::size_t> mTail{ 0 };
+	char mPad1[64];
+	std::size_t mHead = 0;
+};
+
+#endif // MPSCRING_H
@@ -0,0 +1,178 @@
+//***************************************************************************************
+// SharedMemory.cpp
+//***************************************************************************************
+
+#include "SharedMemory.h"
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::~SharedMemory()
+{
+	Close();
+}
+
+#if defined(_WIN32)
+
+bool SharedMemory::Create(const std::string& name, std::size_t size)
+{
+	Close();
+
+	// The mapping lives in the session namespace and disappears with its last handle,
+	// so a stale region can only be one still open elsewhere.
+	const std::string fullName = "Local\\" + name;
+	const std::uint64_t size64 = size;
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		(DWORD)(size64 >> 32), (DWORD)size64, fullName.c_str());
+	if(mapping == nullptr)
+		return false;
+
+	if(GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	mData = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if(mData == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	// Page-file backed mappings start out zeroed.
+	mMapping = mapping;
+	mSize = size;
+	mOwner = true;
+	mName = fullName;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string& name)
+{
+	Close();
+
+	const std::string fullName = "Local\\" + name;
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, fullName.c_str());
+	if(mapping == nullptr)
+		return false;
+
+	mData = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if(mData == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	// The view covers the whole mapping, rounded up to pages.
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(mData, &info, sizeof(info));
+
+	mMapping = mapping;
+	mSize = info.RegionSize;
+	mName = fullName;
+	return true;
+}
+
+void SharedMemory::Close()
+{
+	if(mData != nullptr)
+		UnmapViewOfFile(mData);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mOwner = false;
+	mName.clear();
+}
+
+#else
+
+bool SharedMemory::Create(const std::string& name, std::size_t size)
+{
+	Close();
+
+	const std::string fullName = "/" + name;
+	shm_unlink(fullName.c_str());
+
+	const int fd = shm_open(fullName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0)
+		return false;
+
+	// A new shared memory object is zero-filled as it grows.
+	void* data = MAP_FAILED;
+	if(ftruncate(fd, (off_t)size) == 0)
+		data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+	{
+		shm_unlink(fullName.c_str());
+		return false;
+	}
+
+	mData = data;
+	mSize = size;
+	mOwner = true;
+	mName = fullName;
+	return true;
+}
+
+bool SharedMemory::Open(const std::string& name)
+{
+	Close();
+
+	const std::string fullName = "/" + name;
+	const int fd = shm_open(fullName.c_str(), O_RDWR, 0);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	void* data = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size > 0)
+		data = mmap(nullptr, (std::size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	// The mapping stays valid after the descriptor is closed.
+	close(fd);
+	if(data == MAP_FAILED)
+		return false;
+
+	mData = data;
+	mSize = (std::size_t)st.st_size;
+	mName = fullName;
+	return true;
+}
+
+void SharedMemory::Close()
+{
+	if(mData != nullptr)
+		munmap(mData, mSize);
+	if(mOwner)
+		shm_unlink(mName.c_str());
+
+	mData = nullptr;
+	mSize = 0;
+	mOwner = false;
+	mName.clear();
+}
+
+#endif
+
+void* SharedMemory::Data()const
+{
+	return mData;
+}
+
+std::size_t SharedMemory::Size()const
+{
+	return mSize;
+}
@@ -0,0 +1,50 @@
+//***************************************************************************************
+// SharedMemory.h
+//
+// Named shared memory region that several processes can map at once.  One process
+// creates the region; others open it by name.  On POSIX systems this is a shm_open
+// object, on Windows a page-file backed file mapping.
+//***************************************************************************************
+
+#ifndef SHAREDMEMORY_H
+#define SHAREDMEMORY_H
+
+#include <cstddef>
+#include <string>
+
+class SharedMemory
+{
+public:
+	SharedMemory() = default;
+	SharedMemory(const SharedMemory& rhs) = delete;
+	SharedMemory& operator=(const SharedMemory& rhs) = delete;
+	~SharedMemory();
+
+	// name is a plain identifier (no slashes); the platform prefix is added here.
+	// Create makes a zero-filled region of size bytes.  On POSIX systems an object left
+	// over under the same name (say by a crashed run) is removed first; on Windows the
+	// name is freed with its last handle, and Create fails while it is still in use.
+	// Open maps a region another process created, at its full size (on Windows rounded
+	// up to whole pages).  Both replace any previous mapping and return false on failure.
+	bool Create(const std::string& name, std::size_t size);
+	bool Open(const std::string& name);
+
+	// Unmaps the region.  The creator also removes the name; processes that still have
+	// the region mapped keep it until they close it too.
+	void Close();
+
+	void* Data()const;
+	std::size_t Size()const;
+
+private:
+	void* mData = nullptr;
+	std::size_t mSize = 0;
+	bool mOwner = false;
+	std::string mName;
+
+#if defined(_WIN32)
+	void* mMapping = nullptr;
+#endif
+};
+
+#endif // SHAREDMEMORY_H
@@ -0,0 +1,261 @@
+//***************************************************************************************
+// ThreadPool.cpp 
+//***************************************************************************************
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Identifies the pool (if any) that owns the current thread and the deque it works from.
+	thread_local const ThreadPool* tPool = nullptr;
+	thread_local unsigned tQueue = 0;
+}
+
+ThreadPool::ThreadPool(unsigned workerCount, bool pinThreads)
+	: mQueuedTasks(0)
+{
+	if(workerCount == NoWorkers)
+	{
+		workerCount = 0;
+	}
+	else if(workerCount == 0)
+	{
+		unsigned hw = std::thread::hardware_concurrency();
+		workerCount = hw > 1 ? hw - 1 : 0;
+	}
+
+	// The extra deque at index workerCount is shared by threads outside the pool.
+	for(unsigned i = 0; i < workerCount + 1; ++i)
+		mQueues.push_back(std::make_unique<WorkQueue>());
+
+	for(unsigned i = 0; i < workerCount; ++i)
+	{
+		mWorkers.emplace_back([this, i, pinThreads]
+		{
+			if(pinThreads)
+				PinCurrentThread(i + 1);
+
+			WorkerMain(i);
+		});
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStopping = true;
+	}
+	mWakeCondition.notify_all();
+
+	for(auto& t : mWorkers)
+		t.join();
+}
+
+unsigned ThreadPool::WorkerCount()const
+{
+	return (unsigned)mWorkers.size();
+}
+
+unsigned ThreadPool::Concurrency()const
+{
+	return (unsigned)mWorkers.size() + 1;
+}
+
+ThreadPool& ThreadPool::Default()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::ParallelFor(int first, int last, int grainSize, const std::function<void(int, int)>& body)
+{
+	if(last <= first)
+		return;
+
+	grainSize = std::max(grainSize, 1);
+	const int chunkCount = (last - first - 1) / grainSize + 1;
+
+	// Nothing to share; don't pay for the queues.
+	if(chunkCount == 1 || mWorkers.empty())
+	{
+		for(int b = first; b < last; b += grainSize)
+			body(b, std::min(b + grainSize, last));
+		return;
+	}
+
+	Job job;
+	job.Body = &body;
+	job.Pending.store(chunkCount);
+	job.Failed.store(false);
+
+	// Deal the chunks round-robin over all deques, starting with our own, so every
+	// worker starts on local work and only steals once it runs dry.
+	const unsigned queueCount = (unsigned)mQueues.size();
+	const unsigned home = CallerQueue();
+
+	unsigned q = home;
+	for(int c = 0; c < chunkCount; ++c)
+	{
+		int b = first + c*grainSize;
+		Push(q, Task{ &job, b, std::min(b + grainSize, last) });
+		q = (q + 1) % queueCount;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWakeCondition.notify_all();
+
+	// Help out until all of our chunks have finished.  Pool threads take any task; a
+	// thread from outside only takes its own, or it could end up running (and waiting
+	// on) the chunks of another outside thread that shares the pool.
+	const bool inPool = tPool == this;
+	while(job.Pending.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		if(inPool ? PopOrSteal(home, task) : TakeOwn(job, task))
+			Run(task);
+		else
+			std::this_thread::yield();
+	}
+
+	if(job.Error)
+		std::rethrow_exception(job.Error);
+}
+
+void ThreadPool::WorkerMain(unsigned index)
+{
+	tPool = this;
+	tQueue = index;
+
+	for(;;)
+	{
+		Task task;
+		if(PopOrSteal(index, task))
+		{
+			Run(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mWakeCondition.wait(lock, [this] { return mStopping || mQueuedTasks.load() > 0; });
+
+		if(mStopping && mQueuedTasks.load() == 0)
+			return;
+	}
+}
+
+void ThreadPool::Push(unsigned queue, const Task& task)
+{
+	mQueuedTasks.fetch_add(1);
+
+	WorkQueue& q = *mQueues[queue];
+	std::lock_guard<std::mutex> lock(q.Mutex);
+	q.Tasks.push_back(task);
+}
+
+bool ThreadPool::PopOrSteal(unsigned queue, Task& task)
+{
+	// Newest task from our own deque first (its data is most likely still in cache)...
+	{
+		WorkQueue& q = *mQueues[queue];
+		std::lock_guard<std::mutex> lock(q.Mutex);
+		if(!q.Tasks.empty())
+		{
+			task = q.Tasks.back();
+			q.Tasks.pop_back();
+			mQueuedTasks.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// ...otherwise the oldest task of somebody else's.
+	const unsigned queueCount = (unsigned)mQueues.size();
+	for(unsigned k = 1; k < queueCount; ++k)
+	{
+		WorkQueue& q = *mQueues[(queue + k) % queueCount];
+		std::lock_guard<std::mutex> lock(q.Mutex);
+		if(!q.Tasks.empty())
+		{
+			task = q.Tasks.front();
+			q.Tasks.pop_front();
+			mQueuedTasks.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ThreadPool::TakeOwn(const Job& job, Task& task)
+{
+	for(auto& queue : mQueues)
+	{
+		WorkQueue& q = *queue;
+		std::lock_guard<std::mutex> lock(q.Mutex);
+		auto it = std::find_if(q.Tasks.begin(), q.Tasks.end(), [&job](const Task& t) { return t.Owner == &job; });
+		if(it != q.Tasks.end())
+		{
+			task = *it;
+			q.Tasks.erase(it);
+			mQueuedTasks.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::Run(const Task& task)
+{
+	Job& job = *task.Owner;
+
+	// Once a chunk has failed the rest of the job is skipped, but every chunk must
+	// still count down so that the owner wakes up.
+	if(!job.Failed.load(std::memory_order_relaxed))
+	{
+		try
+		{
+			(*job.Body)(task.Begin, task.End);
+		}
+		catch(...)
+		{
+			if(!job.Failed.exchange(true))
+				job.Error = std::current_exception();
+		}
+	}
+
+	// The owner may return as soon as this reaches zero, so don't touch the job after it.
+	job.Pending.fetch_sub(1, std::memory_order_release);
+}
+
+unsigned ThreadPool::CallerQueue()const
+{
+	return tPool == this ? tQueue : (unsigned)mWorkers.size();
+}
+
+void ThreadPool::PinCurrentThread(unsigned processor)
+{
+	unsigned hw = std::max(std::thread::hardware_concurrency(), 1u);
+	processor %= hw;
+
+#if defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (processor % (8*sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)processor;
+#endif
+}
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// ThreadPool.h 
+//
+// Portable work-stealing task scheduler.  Each worker owns a deque of tasks; it pops
+// its own work from the back and, when empty, steals from the front of the other
+// workers' deques.  ParallelFor splits an index range into chunks of a tunable grain
+// size and spreads them over the deques.  The calling thread takes part in the work
+// and may itself be a pool task, so ParallelFor can be nested.  A thread outside the
+// pool only helps with its own chunks, so two outside threads sharing a pool never run
+// each other's work while they wait.
+//***************************************************************************************
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// workerCount == 0 creates one worker per hardware thread minus one (the thread
+	// calling ParallelFor also runs tasks), and NoWorkers creates none, so every chunk
+	// runs on the caller.  When pinThreads is set, worker k is bound to logical
+	// processor k+1, leaving processor 0 to the calling thread.
+	static const unsigned NoWorkers = ~0u;
+	explicit ThreadPool(unsigned workerCount = 0, bool pinThreads = false);
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(const ThreadPool& rhs) = delete;
+	~ThreadPool();
+
+	unsigned WorkerCount()const;
+
+	// Number of threads that execute a ParallelFor: the workers plus the caller.
+	unsigned Concurrency()const;
+
+	// Calls body(begin, end) for consecutive chunks covering [first, last), each at
+	// most grainSize long, and returns once every chunk has run.  If a chunk throws, the
+	// chunks that have not started yet are skipped and the first exception is rethrown
+	// here once the others have finished.
+	void ParallelFor(int first, int last, int grainSize, const std::function<void(int, int)>& body);
+
+	// Process-wide pool sized to the machine, created on first use.
+	static ThreadPool& Default();
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int)>* Body = nullptr;
+		std::atomic<int> Pending;
+
+		// First exception thrown by a chunk; set once, guarded by Failed.
+		std::atomic<bool> Failed;
+		std::exception_ptr Error;
+	};
+
+	struct Task
+	{
+		Job* Owner;
+		int Begin;
+		int End;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	void WorkerMain(unsigned index);
+	void Push(unsigned queue, const Task& task);
+	bool PopOrSteal(unsigned queue, Task& task);
+	bool TakeOwn(const Job& job, Task& task);
+	void Run(const Task& task);
+	unsigned CallerQueue()const;
+
+	static void PinCurrentThread(unsigned processor);
+
+private:
+	std::vector<std::thread> mWorkers;
+
+	// One deque per worker plus a shared one for threads outside the pool.
+	std::vector<std::unique_ptr<WorkQueue>> mQueues;
+
+	std::atomic<int> mQueuedTasks;
+	std::mutex mSleepMutex;
+	std::condition_variable mWakeCondition;
+	bool mStopping = false;
+};
+
+#endif // THREADPOOL_H
@@ -55,6 +55,13 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Start of the persistently mapped memory, for writing many elements in place.
+    // The memory is write-combined: write it sequentially and never read it back.
+    BYTE* MappedData()const
+    {
+        return mMappedData;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -151,6 +151,10 @@ struct SubmeshGeometry
 	// Bounding box of the geometry defined by this submesh. 
 	// This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// For a simplified level of detail, how far its surface strays from the full
+	// mesh, in the mesh's own units.  Zero for the full mesh.
+	float LodError = 0.0f;
 };
 
 struct MeshGeometry
@@ -0,0 +1,380 @@
+//***************************************************************************************
+// BuoyancySystem.cpp
+//***************************************************************************************
+
+#include "BuoyancySystem.h"
+#include "Waves.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Rotation matrix of the unit quaternion (x, y, z, w), m[r][c] acting on column
+	// vectors, so column c is where body axis c points in the world.
+	void QuaternionToMatrix(float x, float y, float z, float w, float m[3][3])
+	{
+		const float xx = x*x, yy = y*y, zz = z*z;
+		const float xy = x*y, xz = x*z, yz = y*z;
+		const float wx = w*x, wy = w*y, wz = w*z;
+
+		m[0][0] = 1.0f - 2.0f*(yy + zz);
+		m[0][1] = 2.0f*(xy - wz);
+		m[0][2] = 2.0f*(xz + wy);
+
+		m[1][0] = 2.0f*(xy + wz);
+		m[1][1] = 1.0f - 2.0f*(xx + zz);
+		m[1][2] = 2.0f*(yz - wx);
+
+		m[2][0] = 2.0f*(xz - wy);
+		m[2][1] = 2.0f*(yz + wx);
+		m[2][2] = 1.0f - 2.0f*(xx + yy);
+	}
+}
+
+BuoyancySystem::BuoyancySystem(const Waves* water, const XMFLOAT3& waterOrigin, int dirtyFrameCount,
+	ThreadPool* pool)
+	: mWater(water),
+	mWaterOrigin(waterOrigin),
+	mDirtyFrameCount(dirtyFrameCount),
+	mPool(pool != nullptr ? pool : &ThreadPool::Default())
+{
+}
+
+BuoyancySystem::~BuoyancySystem()
+{
+}
+
+int BuoyancySystem::AddBody(const BodyDesc& desc, XMFLOAT4X4* world, int* numFramesDirty)
+{
+	assert(desc.HullPointCount > 0 && desc.HullPointCount <= MaxHullPoints);
+	assert(desc.Mass > 0.0f);
+
+	const int index = BodyCount();
+
+	// Keep the orientation a unit quaternion; the integrator only renormalizes it.
+	const XMFLOAT4& q = desc.Orientation;
+	float len = std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+	if(len == 0.0f)
+		len = 1.0f;
+
+	mPosX.push_back(desc.Position.x);
+	mPosY.push_back(desc.Position.y);
+	mPosZ.push_back(desc.Position.z);
+	mVelX.push_back(0.0f);
+	mVelY.push_back(0.0f);
+	mVelZ.push_back(0.0f);
+	mRotX.push_back(q.x / len);
+	mRotY.push_back(q.y / len);
+	mRotZ.push_back(q.z / len);
+	mRotW.push_back(q.w / len);
+	mAngX.push_back(0.0f);
+	mAngY.push_back(0.0f);
+	mAngZ.push_back(0.0f);
+
+	mMass.push_back(desc.Mass);
+	mInvInertiaX.push_back(1.0f / desc.Inertia.x);
+	mInvInertiaY.push_back(1.0f / desc.Inertia.y);
+	mInvInertiaZ.push_back(1.0f / desc.Inertia.z);
+	mPointVolume.push_back(desc.Volume / desc.HullPointCount);
+	mPointRadius.push_back(desc.HullPointRadius);
+	mLinearDrag.push_back(desc.LinearDrag / desc.HullPointCount);
+	mAngularDrag.push_back(desc.AngularDrag);
+	mScaleX.push_back(desc.RenderScale.x);
+	mScaleY.push_back(desc.RenderScale.y);
+	mScaleZ.push_back(desc.RenderScale.z);
+
+	mHullStart.push_back((int)mHullX.size());
+	mHullCount.push_back(desc.HullPointCount);
+	for(int i = 0; i < desc.HullPointCount; ++i)
+	{
+		mHullX.push_back(desc.HullPoints[i].x);
+		mHullY.push_back(desc.HullPoints[i].y);
+		mHullZ.push_back(desc.HullPoints[i].z);
+	}
+
+	mWorld.push_back(world);
+	mNumFramesDirty.push_back(numFramesDirty);
+
+	WriteWorld(index, index + 1);
+	return index;
+}
+
+int BuoyancySystem::BodyCount()const
+{
+	return (int)mPosX.size();
+}
+
+XMFLOAT3 BuoyancySystem::GetPosition(int body)const
+{
+	return XMFLOAT3(mPosX[body], mPosY[body], mPosZ[body]);
+}
+
+XMFLOAT4 BuoyancySystem::GetOrientation(int body)const
+{
+	return XMFLOAT4(mRotX[body], mRotY[body], mRotZ[body], mRotW[body]);
+}
+
+XMFLOAT3 BuoyancySystem::GetVelocity(int body)const
+{
+	return XMFLOAT3(mVelX[body], mVelY[body], mVelZ[body]);
+}
+
+void BuoyancySystem::SetFluidDensity(float density)
+{
+	mFluidDensity = density;
+}
+
+void BuoyancySystem::SetGravity(float gravity)
+{
+	mGravity = gravity;
+}
+
+void BuoyancySystem::SetTimeStep(float dt)
+{
+	assert(dt > 0.0f);
+	mTimeStep = dt;
+}
+
+void BuoyancySystem::SetMaxSubsteps(int count)
+{
+	mMaxSubsteps = std::max(count, 1);
+}
+
+void BuoyancySystem::Update(float dt)
+{
+	// Fixed steps, capped the same way as Waves::Simulate.
+	mAccumulator += dt;
+
+	int steps = 0;
+	while(mAccumulator >= mTimeStep && steps < mMaxSubsteps)
+	{
+		mAccumulator -= mTimeStep;
+		++steps;
+	}
+
+	if(mAccumulator >= mTimeStep)
+		mAccumulator -= std::floor(mAccumulator / mTimeStep) * mTimeStep;
+
+	const int count = BodyCount();
+	if(steps == 0 || count == 0)
+		return;
+
+	// The water does not move during this call, so each chunk of bodies runs all of its
+	// substeps and writes its matrices in one go: one pass over the pool per frame.  A
+	// body costs about a microsecond per step, so chunks are kept to a few dozen bodies
+	// at least to pay for the task.
+	const float stepDt = mTimeStep;
+	const int grain = std::max(32, count / (4 * (int)mPool->Concurrency()));
+	mPool->ParallelFor(0, count, grain, [this, stepDt, steps](int b0, int b1)
+	{
+		StepBodies(b0, b1, stepDt, steps);
+		WriteWorld(b0, b1);
+	});
+}
+
+void BuoyancySystem::StepBodies(int b0, int b1, float dt, int steps)
+{
+	XMFLOAT2 xz[MaxHullPoints];
+	float height[MaxHullPoints];
+	float rx[MaxHullPoints];
+	float ry[MaxHullPoints];
+	float rz[MaxHullPoints];
+
+	const float ox = mWaterOrigin.x;
+	const float oy = mWaterOrigin.y;
+	const float oz = mWaterOrigin.z;
+
+	for(int b = b0; b < b1; ++b)
+	{
+		const int start = mHullStart[b];
+		const int n = mHullCount[b];
+
+		float px = mPosX[b], py = mPosY[b], pz = mPosZ[b];
+		float vx = mVelX[b], vy = mVelY[b], vz = mVelZ[b];
+		float qx = mRotX[b], qy = mRotY[b], qz = mRotZ[b], qw = mRotW[b];
+		float wx = mAngX[b], wy = mAngY[b], wz = mAngZ[b];
+
+		const float invMass = 1.0f / mMass[b];
+		const float ix = mInvInertiaX[b], iy = mInvInertiaY[b], iz = mInvInertiaZ[b];
+		const float lift = mFluidDensity * mGravity * mPointVolume[b];
+		const float drag = mLinearDrag[b];
+		const float angularDrag = mAngularDrag[b];
+		const float invDepthRange = 0.5f / mPointRadius[b];
+
+		for(int s = 0; s < steps; ++s)
+		{
+			float R[3][3];
+			QuaternionToMatrix(qx, qy, qz, qw, R);
+
+			// Hull points relative to the center of mass, in world orientation, and where
+			// they fall on the water grid.
+			for(int i = 0; i < n; ++i)
+			{
+				const float hx = mHullX[start + i];
+				const float hy = mHullY[start + i];
+				const float hz = mHullZ[start + i];
+
+				rx[i] = R[0][0]*hx + R[0][1]*hy + R[0][2]*hz;
+				ry[i] = R[1][0]*hx + R[1][1]*hy + R[1][2]*hz;
+				rz[i] = R[2][0]*hx + R[2][1]*hy + R[2][2]*hz;
+
+				xz[i].x = px + rx[i] - ox;
+				xz[i].y = pz + rz[i] - oz;
+			}
+
+			mWater->SampleHeights(xz, n, height);
+
+			float fx = 0.0f, fy = -mGravity * mMass[b], fz = 0.0f;
+			float tx = 0.0f, ty = 0.0f, tz = 0.0f;
+			float submerged = 0.0f;
+
+			for(int i = 0; i < n; ++i)
+			{
+				// Share of the point's slab below the surface: 0 once the water is a radius
+				// below the point, 1 once it is a radius above.
+				const float depth = height[i] + oy - (py + ry[i]);
+				const float f = std::min(std::max(depth*invDepthRange + 0.5f, 0.0f), 1.0f);
+				if(f <= 0.0f)
+					continue;
+
+				submerged += f;
+
+				// Velocity of the point: v + w x r.
+				const float ux = vx + (wy*rz[i] - wz*ry[i]);
+				const float uy = vy + (wz*rx[i] - wx*rz[i]);
+				const float uz = vz + (wx*ry[i] - wy*rx[i]);
+
+				const float k = drag * f;
+				const float gx = -k*ux;
+				const float gy = lift*f - k*uy;
+				const float gz = -k*uz;
+
+				fx += gx;
+				fy += gy;
+				fz += gz;
+
+				// Torque about the center of mass: r x F.
+				tx += ry[i]*gz - rz[i]*gy;
+				ty += rz[i]*gx - rx[i]*gz;
+				tz += rx[i]*gy - ry[i]*gx;
+			}
+
+			// Semi-implicit Euler: velocities first, then positions from the new velocities.
+			vx += dt * fx * invMass;
+			vy += dt * fy * invMass;
+			vz += dt * fz * invMass;
+
+			// World inverse inertia R * diag(1/I) * R^T applied to the torque.
+			const float bx = R[0][0]*tx + R[1][0]*ty + R[2][0]*tz;
+			const float by = R[0][1]*tx + R[1][1]*ty + R[2][1]*tz;
+			const float bz = R[0][2]*tx + R[1][2]*ty + R[2][2]*tz;
+			const float cx = ix*bx, cy = iy*by, cz = iz*bz;
+			wx += dt * (R[0][0]*cx + R[0][1]*cy + R[0][2]*cz);
+			wy += dt * (R[1][0]*cx + R[1][1]*cy + R[1][2]*cz);
+			wz += dt * (R[2][0]*cx + R[2][1]*cy + R[2][2]*cz);
+
+			// Implicit so that a large drag rate still only slows the spin down.
+			const float spinDecay = 1.0f / (1.0f + dt * angularDrag * submerged / n);
+			wx *= spinDecay;
+			wy *= spinDecay;
+			wz *= spinDecay;
+
+			px += dt * vx;
+			py += dt * vy;
+			pz += dt * vz;
+
+			// dq/dt = 0.5 * (w, 0) * q.
+			const float h = 0.5f * dt;
+			const float dqx = h * ( wx*qw + wy*qz - wz*qy);
+			const float dqy = h * ( wy*qw + wz*qx - wx*qz);
+			const float dqz = h * ( wz*qw + wx*qy - wy*qx);
+			const float dqw = h * (-wx*qx - wy*qy - wz*qz);
+			qx += dqx;
+			qy += dqy;
+			qz += dqz;
+			qw += dqw;
+
+			const float invLen = 1.0f / std::sqrt(qx*qx + qy*qy + qz*qz + qw*qw);
+			qx *= invLen;
+			qy *= invLen;
+			qz *= invLen;
+			qw *= invLen;
+		}
+
+		mPosX[b] = px; mPosY[b] = py; mPosZ[b] = pz;
+		mVelX[b] = vx; mVelY[b] = vy; mVelZ[b] = vz;
+		mRotX[b] = qx; mRotY[b] = qy; mRotZ[b] = qz; mRotW[b] = qw;
+		mAngX[b] = wx; mAngY[b] = wy; mAngZ[b] = wz;
+	}
+}
+
+void BuoyancySystem::WriteWorld(int b0, int b1)
+{
+	for(int b = b0; b < b1; ++b)
+	{
+		if(mWorld[b] != nullptr)
+		{
+			float R[3][3];
+			QuaternionToMatrix(mRotX[b], mRotY[b], mRotZ[b], mRotW[b], R);
+
+			// Scale * Rotation * Translation for row vectors: row i is body axis i scaled.
+			const float s[3] = { mScaleX[b], mScaleY[b], mScaleZ[b] };
+			XMFLOAT4X4& W = *mWorld[b];
+			for(int i = 0; i < 3; ++i)
+			{
+				W.m[i][0] = s[i] * R[0][i];
+				W.m[i][1] = s[i] * R[1][i];
+				W.m[i][2] = s[i] * R[2][i];
+				W.m[i][3] = 0.0f;
+			}
+			W.m[3][0] = mPosX[b];
+			W.m[3][1] = mPosY[b];
+			W.m[3][2] = mPosZ[b];
+			W.m[3][3] = 1.0f;
+		}
+
+		if(mNumFramesDirty[b] != nullptr)
+			*mNumFramesDirty[b] = mDirtyFrameCount;
+	}
+}
+
+float BuoyancySystem::BoxHull(const XMFLOAT3& halfExtents, int n, std::vector<XMFLOAT3>& points)
+{
+	assert(n > 0 && n*n*n <= MaxHullPoints);
+
+	points.clear();
+	for(int k = 0; k < n; ++k)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			for(int i = 0; i < n; ++i)
+			{
+				points.push_back(XMFLOAT3(
+					halfExtents.x * ((2*i + 1) / (float)n - 1.0f),
+					halfExtents.y * ((2*j + 1) / (float)n - 1.0f),
+					halfExtents.z * ((2*k + 1) / (float)n - 1.0f)));
+			}
+		}
+	}
+
+	return halfExtents.y / n;
+}
+
+float BuoyancySystem::SphereHull(float radius, int n, std::vector<XMFLOAT3>& points)
+{
+	std::vector<XMFLOAT3> cells;
+	BoxHull(XMFLOAT3(radius, radius, radius), n, cells);
+
+	points.clear();
+	for(const XMFLOAT3& p : cells)
+	{
+		if(p.x*p.x + p.y*p.y + p.z*p.z <= radius*radius)
+			points.push_back(p);
+	}
+
+	return radius / n;
+}
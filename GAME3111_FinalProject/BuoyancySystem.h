@@ -0,0 +1,150 @@
+//***************************************************************************************
+// BuoyancySystem.h
+//
+// Floats rigid bodies on a Waves height field.  Each body carries a hull of sample
+// points in body space, each standing for an equal share of the body's volume.  Every
+// step the hull points are moved into the world, the water height under each is
+// sampled (Waves::SampleHeights), and the submerged share of each point pushes up with
+// its displaced weight and drags against the point's velocity.  Forces and torques are
+// integrated with semi-implicit Euler at a fixed step.
+//
+// Body state is stored structure-of-arrays.  Bodies are independent, so Update splits
+// them across the thread pool; each body's world matrix is written to the location
+// registered with AddBody (a RenderItem's World) along with its dirty frame count.
+//***************************************************************************************
+
+#ifndef BUOYANCYSYSTEM_H
+#define BUOYANCYSYSTEM_H
+
+#include <vector>
+#include <DirectXMath.h>
+
+class ThreadPool;
+class Waves;
+
+class BuoyancySystem
+{
+public:
+	struct BodyDesc
+	{
+		DirectX::XMFLOAT3 Position = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+		DirectX::XMFLOAT4 Orientation = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		float Mass = 1.0f;
+
+		// Principal moments of inertia about the body axes.
+		DirectX::XMFLOAT3 Inertia = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+		// Volume displaced when fully under water, shared evenly by the hull points.
+		float Volume = 1.0f;
+
+		// Body-space hull points (at most MaxHullPoints), and the vertical half extent of
+		// the slab of volume each stands for: a point is fully submerged once the water is
+		// HullPointRadius above it.
+		const DirectX::XMFLOAT3* HullPoints = nullptr;
+		int HullPointCount = 0;
+		float HullPointRadius = 0.5f;
+
+		// Drag of a fully submerged body, scaled down with the submerged share.  The linear
+		// drag is force per unit of velocity (kg/s), spread over the hull points so that
+		// it also resists spinning and rocking; the angular drag is the rate (1/s) at which
+		// the remaining spin decays.
+		float LinearDrag = 1.0f;
+		float AngularDrag = 1.0f;
+
+		// Scale applied before the body's rotation in the written world matrix (the
+		// render mesh may be sized by its world matrix).
+		DirectX::XMFLOAT3 RenderScale = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+	};
+
+	static const int MaxHullPoints = 64;
+
+	// water's local space is placed at waterOrigin in the world.  World matrices written
+	// back are marked dirty for dirtyFrameCount frames.  Bodies are updated on pool
+	// (ThreadPool::Default() if null).
+	BuoyancySystem(const Waves* water, const DirectX::XMFLOAT3& waterOrigin, int dirtyFrameCount,
+		ThreadPool* pool = nullptr);
+	BuoyancySystem(const BuoyancySystem& rhs) = delete;
+	BuoyancySystem& operator=(const BuoyancySystem& rhs) = delete;
+	~BuoyancySystem();
+
+	// Adds a body and returns its index.  world and numFramesDirty (both optional) must
+	// stay valid for the life of the system.
+	int AddBody(const BodyDesc& desc, DirectX::XMFLOAT4X4* world, int* numFramesDirty);
+	int BodyCount()const;
+
+	DirectX::XMFLOAT3 GetPosition(int body)const;
+	DirectX::XMFLOAT4 GetOrientation(int body)const;
+	DirectX::XMFLOAT3 GetVelocity(int body)const;
+
+	// Advances the bodies by dt seconds in fixed steps, like Waves::Update, then writes the
+	// world matrices.  Reads the water's current solution, so call it after the water's
+	// Update for the frame.
+	void Update(float dt);
+
+	void SetFluidDensity(float density);
+	void SetGravity(float gravity);
+	void SetTimeStep(float dt);
+	void SetMaxSubsteps(int count);
+
+	// Hull points on an n x n x n grid of cell centers filling a box (half extents h) or
+	// the part of that grid inside a sphere.  Return the matching HullPointRadius.
+	static float BoxHull(const DirectX::XMFLOAT3& halfExtents, int n, std::vector<DirectX::XMFLOAT3>& points);
+	static float SphereHull(float radius, int n, std::vector<DirectX::XMFLOAT3>& points);
+
+private:
+	void StepBodies(int b0, int b1, float dt, int steps);
+	void WriteWorld(int b0, int b1);
+
+private:
+	const Waves* mWater = nullptr;
+	DirectX::XMFLOAT3 mWaterOrigin;
+	int mDirtyFrameCount = 0;
+	ThreadPool* mPool = nullptr;
+
+	float mFluidDensity = 1000.0f;
+	float mGravity = 9.81f;
+	float mTimeStep = 1.0f / 60.0f;
+	int mMaxSubsteps = 4;
+	float mAccumulator = 0.0f;
+
+	// Body state.
+	std::vector<float> mPosX;
+	std::vector<float> mPosY;
+	std::vector<float> mPosZ;
+	std::vector<float> mVelX;
+	std::vector<float> mVelY;
+	std::vector<float> mVelZ;
+	std::vector<float> mRotX;
+	std::vector<float> mRotY;
+	std::vector<float> mRotZ;
+	std::vector<float> mRotW;
+	std::vector<float> mAngX;
+	std::vector<float> mAngY;
+	std::vector<float> mAngZ;
+
+	// Body constants.
+	std::vector<float> mMass;
+	std::vector<float> mInvInertiaX;
+	std::vector<float> mInvInertiaY;
+	std::vector<float> mInvInertiaZ;
+	std::vector<float> mPointVolume;
+	std::vector<float> mPointRadius;
+	std::vector<float> mLinearDrag;
+	std::vector<float> mAngularDrag;
+	std::vector<float> mScaleX;
+	std::vector<float> mScaleY;
+	std::vector<float> mScaleZ;
+	std::vector<int> mHullStart;
+	std::vector<int> mHullCount;
+
+	// Hull points of all bodies, body space.
+	std::vector<float> mHullX;
+	std::vector<float> mHullY;
+	std::vector<float> mHullZ;
+
+	std::vector<DirectX::XMFLOAT4X4*> mWorld;
+	std::vector<int*> mNumFramesDirty;
+};
+
+#endif // BUOYANCYSYSTEM_H
@@ -11,7 +11,7 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
     MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
 
-    WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+    WavesVB = std::make_unique<UploadBuffer<WaterDynamicVertex>>(device, waveVertCount, false);
 }
 
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
@@ -49,6 +49,20 @@ struct Vertex
     //DirectX::XMFLOAT4 Color;
 };
 
+// The water is drawn from two vertex streams.  The static stream is built once; only the
+// dynamic one is rewritten as the waves move.
+struct WaterStaticVertex
+{
+	DirectX::XMFLOAT2 PosXZ;
+	DirectX::XMFLOAT2 TexC;
+};
+
+struct WaterDynamicVertex
+{
+	float Height;
+	std::uint32_t Normal; // Octahedral, R16G16_SNORM
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
@@ -74,7 +88,13 @@ public:
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // Every water body has its slice of WavesVB (WaterSystem::BaseVertex).
+    std::unique_ptr<UploadBuffer<WaterDynamicVertex>> WavesVB = nullptr;
+
+    // Water patch versions last copied into WavesVB (empty until the first full copy),
+    // indexed by WaterSystem patch.  Only patches whose version has moved on since need
+    // to be rewritten.
+    std::vector<std::uint32_t> WavesPatchVersions;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
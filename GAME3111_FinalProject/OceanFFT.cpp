@@ -0,0 +1,377 @@
+//***************************************************************************************
+// OceanFFT.cpp
+//***************************************************************************************
+
+#include "OceanFFT.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OCEAN_FFT_SSE2 1
+#include <emmintrin.h>
+#else
+#define OCEAN_FFT_SSE2 0
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	const float Gravity = 9.81f;
+	const double TwoPi = 6.283185307179586;
+
+	// Columns per task in the column pass: 16 columns of a 256-row tile are 32 KB.
+	const int ColumnBand = 16;
+
+	// Standard normal deviates from the engine's raw output (Box-Muller), so the same
+	// seed gives the same ocean whatever the standard library.
+	void GaussianPair(std::mt19937& rng, float& a, float& b)
+	{
+		const double u1 = (rng() + 1.0) / 4294967297.0;
+		const double u2 = rng() / 4294967296.0;
+		const double r = std::sqrt(-2.0*std::log(u1));
+		a = (float)(r*std::cos(TwoPi*u2));
+		b = (float)(r*std::sin(TwoPi*u2));
+	}
+
+	// One radix-2 butterfly applied to count neighboring columns:
+	//   (a, b) <- (a + w*b, a - w*b)
+	void ButterflyColumns(float* ar, float* ai, float* br, float* bi, int count, float wr, float wi)
+	{
+		int c = 0;
+#if OCEAN_FFT_SSE2
+		const __m128 vwr = _mm_set1_ps(wr);
+		const __m128 vwi = _mm_set1_ps(wi);
+		for(; c + 4 <= count; c += 4)
+		{
+			__m128 xr = _mm_loadu_ps(br + c);
+			__m128 xi = _mm_loadu_ps(bi + c);
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr));
+
+			__m128 yr = _mm_loadu_ps(ar + c);
+			__m128 yi = _mm_loadu_ps(ai + c);
+			_mm_storeu_ps(br + c, _mm_sub_ps(yr, tr));
+			_mm_storeu_ps(bi + c, _mm_sub_ps(yi, ti));
+			_mm_storeu_ps(ar + c, _mm_add_ps(yr, tr));
+			_mm_storeu_ps(ai + c, _mm_add_ps(yi, ti));
+		}
+#endif
+		for(; c < count; ++c)
+		{
+			float tr = br[c]*wr - bi[c]*wi;
+			float ti = br[c]*wi + bi[c]*wr;
+			br[c] = ar[c] - tr;
+			bi[c] = ai[c] - ti;
+			ar[c] += tr;
+			ai[c] += ti;
+		}
+	}
+}
+
+OceanFFT::OceanFFT(int n, float tileSize, float windSpeed, float windX, float windZ,
+	float amplitude, std::uint32_t seed)
+{
+	assert(n >= 2 && (n & (n - 1)) == 0);
+
+	mN = n;
+	mTileSize = tileSize;
+	while((1 << mLog2N) < n)
+		++mLog2N;
+
+	mPool = &ThreadPool::Default();
+
+	const float dx = tileSize / n;
+	mGridX.resize(n);
+	mGridZ.resize(n);
+	for(int i = 0; i < n; ++i)
+	{
+		mGridX[i] = -0.5f*tileSize + i*dx;
+		mGridZ[i] = 0.5f*tileSize - i*dx;
+	}
+
+	mCos.resize(n / 2);
+	mSin.resize(n / 2);
+	for(int k = 0; k < n / 2; ++k)
+	{
+		mCos[k] = (float)std::cos(TwoPi*k / n);
+		mSin[k] = (float)std::sin(TwoPi*k / n);
+	}
+
+	mBitReverse.resize(n);
+	for(int i = 0; i < n; ++i)
+	{
+		int r = 0;
+		for(int b = 0; b < mLog2N; ++b)
+			r |= ((i >> b) & 1) << (mLog2N - 1 - b);
+		mBitReverse[i] = r;
+	}
+
+	const int count = n*n;
+	mHeightRe.resize(count);
+	mHeightIm.resize(count);
+	mSlopeRe.resize(count);
+	mSlopeIm.resize(count);
+	mHeights.assign(count, 0.0f);
+	mNormalX.assign(count, 0.0f);
+	mNormalY.assign(count, 1.0f);
+	mNormalZ.assign(count, 0.0f);
+	mTangentX.assign(count, 1.0f);
+	mTangentY.assign(count, 0.0f);
+
+	BuildSpectrum(windSpeed, windX, windZ, amplitude, seed);
+	Evaluate();
+}
+
+OceanFFT::~OceanFFT()
+{
+}
+
+int OceanFFT::RowCount()const
+{
+	return mN;
+}
+
+int OceanFFT::ColumnCount()const
+{
+	return mN;
+}
+
+int OceanFFT::VertexCount()const
+{
+	return mN*mN;
+}
+
+int OceanFFT::TriangleCount()const
+{
+	return 2*(mN - 1)*(mN - 1);
+}
+
+float OceanFFT::Width()const
+{
+	return mTileSize;
+}
+
+float OceanFFT::Depth()const
+{
+	return mTileSize;
+}
+
+float OceanFFT::Time()const
+{
+	return (float)mTime;
+}
+
+void OceanFFT::SetThreadPool(ThreadPool* pool)
+{
+	mPool = pool != nullptr ? pool : &ThreadPool::Default();
+}
+
+void OceanFFT::Update(float dt)
+{
+	mTime += dt;
+	Evaluate();
+}
+
+void OceanFFT::BuildSpectrum(float windSpeed, float windX, float windZ, float amplitude, std::uint32_t seed)
+{
+	const int n = mN;
+	const int count = n*n;
+
+	mH0Re.resize(count);
+	mH0Im.resize(count);
+	mH0MinusRe.resize(count);
+	mH0MinusIm.resize(count);
+	mOmega.resize(count);
+	mKx.resize(count);
+	mKz.resize(count);
+
+	const float windLen = std::sqrt(windX*windX + windZ*windZ);
+	const float wx = windLen > 0.0f ? windX / windLen : 1.0f;
+	const float wz = windLen > 0.0f ? windZ / windLen : 0.0f;
+
+	// Largest wave from the wind speed; waves far shorter than it are damped out.
+	const float largest = windSpeed*windSpeed / Gravity;
+	const float smallest = largest / 1000.0f;
+
+	std::mt19937 rng(seed);
+	for(int r = 0; r < n; ++r)
+	{
+		// FFT order: index m stands for frequency m for m < n/2 and m - n above.  Rows go
+		// toward -z (see mGridZ), hence the sign of kz.
+		const int mz = r < n / 2 ? r : r - n;
+		const float kz = -(float)(TwoPi*mz / mTileSize);
+
+		for(int c = 0; c < n; ++c)
+		{
+			const int mx = c < n / 2 ? c : c - n;
+			const float kx = (float)(TwoPi*mx / mTileSize);
+			const int k = r*n + c;
+
+			float xr, xi;
+			GaussianPair(rng, xr, xi);
+
+			// Phillips spectrum.  The Nyquist frequencies are left empty: -k folds back onto
+			// k there, so their slopes would not come out real.
+			const float kSq = kx*kx + kz*kz;
+			float phillips = 0.0f;
+			if(kSq > 0.0f && mx != -n / 2 && mz != -n / 2)
+			{
+				const float kDotW = (kx*wx + kz*wz) / std::sqrt(kSq);
+				phillips = amplitude*std::exp(-1.0f / (kSq*largest*largest)) / (kSq*kSq)*
+					kDotW*kDotW*std::exp(-kSq*smallest*smallest);
+			}
+
+			const float scale = std::sqrt(0.5f*phillips);
+			mH0Re[k] = xr*scale;
+			mH0Im[k] = xi*scale;
+			mOmega[k] = std::sqrt(Gravity*std::sqrt(kSq));
+			mKx[k] = kx;
+			mKz[k] = kz;
+		}
+	}
+
+	for(int r = 0; r < n; ++r)
+	{
+		for(int c = 0; c < n; ++c)
+		{
+			const int minusK = ((n - r) % n)*n + (n - c) % n;
+			mH0MinusRe[r*n + c] = mH0Re[minusK];
+			mH0MinusIm[r*n + c] = -mH0Im[minusK];
+		}
+	}
+}
+
+void OceanFFT::Evaluate()
+{
+	const int n = mN;
+	const int rowGrain = std::max(1, n / (4 * (int)mPool->Concurrency()));
+
+	// h(k, t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt), which keeps h(x, t) real, and the
+	// slope spectrum i k h(k, t) with the x and z slopes packed as sx + i sz.
+	mPool->ParallelFor(0, n, rowGrain, [this, n](int r0, int r1)
+	{
+		for(int k = r0*n; k < r1*n; ++k)
+		{
+			const double phase = std::fmod((double)mOmega[k]*mTime, TwoPi);
+			const float cs = (float)std::cos(phase);
+			const float sn = (float)std::sin(phase);
+
+			const float hr = mH0Re[k]*cs - mH0Im[k]*sn + mH0MinusRe[k]*cs + mH0MinusIm[k]*sn;
+			const float hi = mH0Re[k]*sn + mH0Im[k]*cs + mH0MinusIm[k]*cs - mH0MinusRe[k]*sn;
+			mHeightRe[k] = hr;
+			mHeightIm[k] = hi;
+
+			// (i kx - kz) h
+			mSlopeRe[k] = -mKx[k]*hi - mKz[k]*hr;
+			mSlopeIm[k] = mKx[k]*hr - mKz[k]*hi;
+		}
+	});
+
+	Inverse2D(mHeightRe.data(), mHeightIm.data());
+	Inverse2D(mSlopeRe.data(), mSlopeIm.data());
+
+	mPool->ParallelFor(0, n, rowGrain, [this, n](int r0, int r1)
+	{
+		for(int k = r0*n; k < r1*n; ++k)
+		{
+			const float sx = mSlopeRe[k];
+			const float sz = mSlopeIm[k];
+			mHeights[k] = mHeightRe[k];
+
+			float invLen = 1.0f / std::sqrt(sx*sx + 1.0f + sz*sz);
+			mNormalX[k] = -sx*invLen;
+			mNormalY[k] = invLen;
+			mNormalZ[k] = -sz*invLen;
+
+			invLen = 1.0f / std::sqrt(1.0f + sx*sx);
+			mTangentX[k] = invLen;
+			mTangentY[k] = sx*invLen;
+		}
+	});
+}
+
+void OceanFFT::InverseRow(float* re, float* im)const
+{
+	const int n = mN;
+	for(int i = 0; i < n; ++i)
+	{
+		const int j = mBitReverse[i];
+		if(i < j)
+		{
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+
+	for(int half = 1, step = n / 2; half < n; half <<= 1, step >>= 1)
+	{
+		for(int i = 0; i < n; i += 2*half)
+		{
+			for(int k = 0; k < half; ++k)
+			{
+				const float wr = mCos[k*step];
+				const float wi = mSin[k*step];
+				const int a = i + k;
+				const int b = a + half;
+
+				float tr = re[b]*wr - im[b]*wi;
+				float ti = re[b]*wi + im[b]*wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+void OceanFFT::InverseColumns(float* re, float* im, int c0, int c1)const
+{
+	const int n = mN;
+	const int width = c1 - c0;
+
+	for(int i = 0; i < n; ++i)
+	{
+		const int j = mBitReverse[i];
+		if(i < j)
+		{
+			std::swap_ranges(re + i*n + c0, re + i*n + c1, re + j*n + c0);
+			std::swap_ranges(im + i*n + c0, im + i*n + c1, im + j*n + c0);
+		}
+	}
+
+	for(int half = 1, step = n / 2; half < n; half <<= 1, step >>= 1)
+	{
+		for(int i = 0; i < n; i += 2*half)
+		{
+			for(int k = 0; k < half; ++k)
+			{
+				const int a = (i + k)*n + c0;
+				const int b = a + half*n;
+				ButterflyColumns(re + a, im + a, re + b, im + b, width, mCos[k*step], mSin[k*step]);
+			}
+		}
+	}
+}
+
+void OceanFFT::Inverse2D(float* re, float* im)
+{
+	const int n = mN;
+
+	mPool->ParallelFor(0, n, std::max(1, n / (4 * (int)mPool->Concurrency())), [this, re, im, n](int r0, int r1)
+	{
+		for(int r = r0; r < r1; ++r)
+			InverseRow(re + r*n, im + r*n);
+	});
+
+	const int band = std::min(ColumnBand, n);
+	mPool->ParallelFor(0, n / band, 1, [this, re, im, band](int b0, int b1)
+	{
+		for(int b = b0; b < b1; ++b)
+			InverseColumns(re, im, b*band, (b + 1)*band);
+	});
+}
@@ -0,0 +1,127 @@
+//***************************************************************************************
+// OceanFFT.h
+//
+// Spectral ocean (Tessendorf, "Simulating Ocean Water").  A Phillips spectrum of random
+// wave amplitudes is evolved analytically in time and brought back to the spatial domain
+// with inverse FFTs each Update.  The result is periodic: the n x n points cover one
+// tile of Width() x Depth() metres, and point (i, n) would equal point (i, 0), so one
+// small tile can be repeated across a large water surface.
+//
+// The query surface matches Waves (Position, Normal, TangentX, RowCount, ...), so the
+// client copies the solution into vertex buffers the same way.  Storage is
+// structure-of-arrays like Waves.
+//***************************************************************************************
+
+#ifndef OCEANFFT_H
+#define OCEANFFT_H
+
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+
+class ThreadPool;
+
+class OceanFFT
+{
+public:
+	// n is the resolution per side and must be a power of two; tileSize is the side of
+	// the tile in metres.  Waves travel mostly along the wind direction (windX, windZ) and
+	// the wind speed sets the size of the largest waves.  amplitude scales the spectrum.
+	// The same seed always produces the same ocean.
+	OceanFFT(int n, float tileSize, float windSpeed, float windX, float windZ,
+		float amplitude, std::uint32_t seed = 1);
+	OceanFFT(const OceanFFT& rhs) = delete;
+	OceanFFT& operator=(const OceanFFT& rhs) = delete;
+	~OceanFFT();
+
+	int RowCount()const;
+	int ColumnCount()const;
+	int VertexCount()const;
+	int TriangleCount()const;
+
+	// Size of one tile (the period of the surface), not of the n - 1 quads between points.
+	float Width()const;
+	float Depth()const;
+
+	// Returns the solution at the ith grid point.
+	DirectX::XMFLOAT3 Position(int i)const
+	{
+		return DirectX::XMFLOAT3(mGridX[i % mN], mHeights[i], mGridZ[i / mN]);
+	}
+
+	// Returns the solution normal at the ith grid point.
+	DirectX::XMFLOAT3 Normal(int i)const
+	{
+		return DirectX::XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]);
+	}
+
+	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
+	DirectX::XMFLOAT3 TangentX(int i)const
+	{
+		return DirectX::XMFLOAT3(mTangentX[i], mTangentY[i], 0.0f);
+	}
+
+	float Height(int i)const { return mHeights[i]; }
+	const float* Heights()const { return mHeights.data(); }
+
+	// Advances the ocean by dt seconds and evaluates the surface at the new time.
+	void Update(float dt);
+	float Time()const;
+
+	// Pool that runs the FFTs (ThreadPool::Default() unless set).
+	void SetThreadPool(ThreadPool* pool);
+
+private:
+	void BuildSpectrum(float windSpeed, float windX, float windZ, float amplitude, std::uint32_t seed);
+	void Evaluate();
+
+	// In-place inverse FFT of one contiguous row.
+	void InverseRow(float* re, float* im)const;
+
+	// In-place inverse FFT down columns [c0, c1) of an n x n row-major array.  The
+	// butterflies run across neighboring columns, which are contiguous, so they vectorize.
+	void InverseColumns(float* re, float* im, int c0, int c1)const;
+
+	void Inverse2D(float* re, float* im);
+
+private:
+	int mN = 0;
+	int mLog2N = 0;
+	float mTileSize = 0.0f;
+	double mTime = 0.0;
+
+	ThreadPool* mPool = nullptr;
+
+	std::vector<float> mGridX;
+	std::vector<float> mGridZ;
+
+	// Initial amplitudes h0(k), h0(-k) conjugated, and the dispersion w(k), in FFT order.
+	std::vector<float> mH0Re;
+	std::vector<float> mH0Im;
+	std::vector<float> mH0MinusRe;
+	std::vector<float> mH0MinusIm;
+	std::vector<float> mOmega;
+	std::vector<float> mKx;
+	std::vector<float> mKz;
+
+	// FFT twiddles e^(2 pi i k / n) for k < n/2 and the bit-reversal permutation.
+	std::vector<float> mCos;
+	std::vector<float> mSin;
+	std::vector<int> mBitReverse;
+
+	// Spectra being transformed: heights, and the x/z slopes packed as sx + i sz (both
+	// are real, so one complex transform yields the two of them).
+	std::vector<float> mHeightRe;
+	std::vector<float> mHeightIm;
+	std::vector<float> mSlopeRe;
+	std::vector<float> mSlopeIm;
+
+	std::vector<float> mHeights;
+	std::vector<float> mNormalX;
+	std::vector<float> mNormalY;
+	std::vector<float> mNormalZ;
+	std::vector<float> mTangentX;
+	std::vector<float> mTangentY;
+};
+
+#endif // OCEANFFT_H
@@ -112,6 +112,36 @@ VertexOut VS(VertexIn vin)
     return vout;
 }
 
+// The water comes in two streams: x/z and texture coordinates in slot 0, which never
+// change, and the height and packed normal in slot 1, which are rewritten every frame.
+struct WaterVertexIn
+{
+	float2 PosXZ   : POSITION;
+	float2 TexC    : TEXCOORD;
+	float  Height  : HEIGHT;
+	float2 NormalL : NORMAL;
+};
+
+// Inverse of Waves::EncodeOctahedral: x/z on the octahedron around +y.
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+	if(n.y < 0.0f)
+		n.xz = (1.0f - abs(n.zx)) * (n.xz >= 0.0f ? 1.0f : -1.0f);
+
+	return normalize(n);
+}
+
+VertexOut WaterVS(WaterVertexIn win)
+{
+	VertexIn vin;
+	vin.PosL = float3(win.PosXZ.x, win.Height, win.PosXZ.y);
+	vin.NormalL = DecodeOctahedral(win.NormalL);
+	vin.TexC = win.TexC;
+
+	return VS(vin);
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
     float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
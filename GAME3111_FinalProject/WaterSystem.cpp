@@ -0,0 +1,131 @@
+//***************************************************************************************
+// WaterSystem.cpp
+//***************************************************************************************
+
+#include "WaterSystem.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+WaterSystem::WaterSystem(ThreadPool* pool)
+	: mPool(pool != nullptr ? pool : &ThreadPool::Default())
+{
+}
+
+WaterSystem::~WaterSystem()
+{
+}
+
+int WaterSystem::AddBody(std::unique_ptr<Waves> body)
+{
+	assert(!body->IsAsync());
+	body->SetThreadPool(mPool);
+
+	// All bodies share one vertex layout, whose normal is the octahedral R16G16_SNORM
+	// word; a Float3 body would write R8G8B8A8 normals into it.
+	body->SetNormalFormat(Waves::NormalFormat::Octahedral);
+
+	const int index = (int)mBodies.size();
+	mBaseVertex.push_back(mTotalVertexCount);
+	mBasePatch.push_back((int)mPatchBody.size());
+	mPatchBody.insert(mPatchBody.end(), body->PatchCount(), index);
+	mTotalVertexCount += body->PatchVertexCount();
+	mBodies.push_back(std::move(body));
+
+	// Largest first; equal sizes keep the order they were added in.
+	mOrder.push_back(index);
+	std::stable_sort(mOrder.begin(), mOrder.end(), [this](int a, int b)
+	{
+		return mBodies[a]->VertexCount() > mBodies[b]->VertexCount();
+	});
+
+	return index;
+}
+
+int WaterSystem::BodyCount()const
+{
+	return (int)mBodies.size();
+}
+
+Waves& WaterSystem::GetBody(int body)
+{
+	return *mBodies[body];
+}
+
+const Waves& WaterSystem::GetBody(int body)const
+{
+	return *mBodies[body];
+}
+
+int WaterSystem::BaseVertex(int body)const
+{
+	return mBaseVertex[body];
+}
+
+int WaterSystem::BasePatch(int body)const
+{
+	return mBasePatch[body];
+}
+
+int WaterSystem::PatchBody(int patch)const
+{
+	return mPatchBody[patch];
+}
+
+int WaterSystem::TotalVertexCount()const
+{
+	return mTotalVertexCount;
+}
+
+int WaterSystem::TotalPatchCount()const
+{
+	return (int)mPatchBody.size();
+}
+
+void WaterSystem::Update(float dt)
+{
+	const int count = (int)mBodies.size();
+	if(count == 1)
+	{
+		mBodies[0]->Update(dt);
+		return;
+	}
+
+	// One task per thread, each pulling the next largest body until none are left, so
+	// the big bodies start right away and the small ones fill in around them.  A body's
+	// own row sweeps are nested pool work and get stolen by threads that run dry.
+	std::atomic<int> next(0);
+	const int tasks = std::min((int)mPool->Concurrency(), count);
+	mPool->ParallelFor(0, tasks, 1, [this, count, dt, &next](int, int)
+	{
+		for(int k = next.fetch_add(1); k < count; k = next.fetch_add(1))
+			mBodies[mOrder[k]]->Update(dt);
+	});
+}
+
+void WaterSystem::WriteStaticVertices(void* dst)const
+{
+	std::uint8_t* base = static_cast<std::uint8_t*>(dst);
+	for(int b = 0; b < BodyCount(); ++b)
+		mBodies[b]->WriteStaticVertices(base + (size_t)mBaseVertex[b]*Waves::StaticVertexStride);
+}
+
+void WaterSystem::WriteDynamicVertices(void* dst, const int* patches, int patchCount)const
+{
+	std::uint8_t* base = static_cast<std::uint8_t*>(dst);
+
+	// Patches are a few thousand vertices each; spread them like Waves does.  Writing a
+	// single patch does not go back to the pool.
+	const int grain = std::max(1, patchCount / (4 * (int)mPool->Concurrency()));
+	mPool->ParallelFor(0, patchCount, grain, [this, base, patches](int a0, int a1)
+	{
+		for(int a = a0; a < a1; ++a)
+		{
+			const int b = mPatchBody[patches[a]];
+			const int local = patches[a] - mBasePatch[b];
+			mBodies[b]->WriteDynamicVertices(base + (size_t)mBaseVertex[b]*Waves::DynamicVertexStride, &local, 1);
+		}
+	});
+}
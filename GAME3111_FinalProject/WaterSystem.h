@@ -0,0 +1,75 @@
+//***************************************************************************************
+// WaterSystem.h
+//
+// Owns every independent body of water in a level (lake, ponds, rivers, pools), each a
+// Waves instance with its own size and constants, and steps them together.  One Update
+// runs all bodies as a single batch of pool tasks, handing out the largest bodies
+// first so that a big lake does not end up starting last.
+//
+// The bodies' vertices share one patch-major vertex buffer: body b owns the block
+// starting at BaseVertex(b), and its patches are numbered from BasePatch(b) on in the
+// system-wide patch order.
+//***************************************************************************************
+
+#ifndef WATERSYSTEM_H
+#define WATERSYSTEM_H
+
+#include <memory>
+#include <vector>
+#include "Waves.h"
+
+class ThreadPool;
+
+class WaterSystem
+{
+public:
+	// Bodies are simulated on pool (ThreadPool::Default() if null).
+	explicit WaterSystem(ThreadPool* pool = nullptr);
+	WaterSystem(const WaterSystem& rhs) = delete;
+	WaterSystem& operator=(const WaterSystem& rhs) = delete;
+	~WaterSystem();
+
+	// Takes over a body and returns its index.  The body is switched to the system's
+	// pool and to octahedral normals (the format of the shared vertex layout), so it
+	// must not be running asynchronously yet.
+	int AddBody(std::unique_ptr<Waves> body);
+
+	int BodyCount()const;
+	Waves& GetBody(int body);
+	const Waves& GetBody(int body)const;
+
+	// The body's slice of the shared vertex buffer and of the system-wide patch order.
+	int BaseVertex(int body)const;
+	int BasePatch(int body)const;
+
+	// Body owning a system-wide patch index.
+	int PatchBody(int patch)const;
+
+	int TotalVertexCount()const;
+	int TotalPatchCount()const;
+
+	// Advances every body by dt seconds.  Bodies running asynchronously only take the
+	// hand-off here.
+	void Update(float dt);
+
+	// Like the Waves functions of the same name, over the shared buffer.  patches are
+	// system-wide patch indices; they are written in parallel whichever body they
+	// belong to.
+	void WriteStaticVertices(void* dst)const;
+	void WriteDynamicVertices(void* dst, const int* patches, int patchCount)const;
+
+private:
+	ThreadPool* mPool = nullptr;
+
+	std::vector<std::unique_ptr<Waves>> mBodies;
+	std::vector<int> mBaseVertex;
+	std::vector<int> mBasePatch;
+	std::vector<int> mPatchBody;
+
+	// Body indices by decreasing cell count.
+	std::vector<int> mOrder;
+
+	int mTotalVertexCount = 0;
+};
+
+#endif // WATERSYSTEM_H
@@ -3,14 +3,74 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "../Common/ThreadPool.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
 
 using namespace DirectX;
 
+namespace
+{
+	// Results of the per-tile energy check.
+	const std::uint8_t TileQuiet     = 0x01;
+	const std::uint8_t TileEdgeUp    = 0x02;
+	const std::uint8_t TileEdgeDown  = 0x04;
+	const std::uint8_t TileEdgeLeft  = 0x08;
+	const std::uint8_t TileEdgeRight = 0x10;
+
+	// Consecutive quiet steps before a tile is put to sleep.
+	const std::uint8_t QuietStepsToSleep = 8;
+
+	// Same rounding as the octahedral normal kernels.
+	std::uint32_t PackSnorm16(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f)*32767.0f + 32768.5f;
+		return ((std::uint32_t)(std::int32_t)v - 32768) & 0xffff;
+	}
+
+	float UnpackSnorm16(std::uint32_t bits)
+	{
+		return std::max((float)(std::int16_t)(bits & 0xffff) / 32767.0f, -1.0f);
+	}
+
+	// Set in mMiddleSnapshot when the worker has published a snapshot Update has not
+	// picked up yet.
+	const int NewSnapshot = 0x4;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Copies rows [i0, i1) x columns [j0, j1) of a row-major plane.
+	template<typename T>
+	void CopyRect(std::vector<T>& dst, const std::vector<T>& src, int rowPitch, int i0, int i1, int j0, int j1)
+	{
+		for(int i = i0; i < i1; ++i)
+			std::memcpy(&dst[i*rowPitch + j0], &src[i*rowPitch + j0], (j1 - j0)*sizeof(T));
+	}
+}
+
 Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
+    : mImpulses(ImpulseQueueCapacity),
+      mImpulseEdgePolicy(ImpulseEdgePolicy::Clamp),
+      mDroppedImpulses(0),
+      mMiddleSnapshot(1),
+      mUpdateMs(0.0f),
+      mSimulationMs(0.0f),
+      mAverageSimulationMs(0.0f),
+      mPublishMs(0.0f),
+      mStepCount(0),
+      mPublishCount(0),
+      mSimulationSeconds(0.0)
 {
     mNumRows = m;
     mNumCols = n;
@@ -18,41 +78,47 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mVertexCount = m*n;
     mTriangleCount = (m - 1)*(n - 1) * 2;
 
-    mTimeStep = dt;
     mSpatialStep = dx;
+    mSpeed = speed;
+    mDamping = damping;
+    mRequestedTimeStep = dt;
+    BuildConstants();
+
+    mKernels = &WavesKernels::Best();
+    mPool = &ThreadPool::Default();
+    SetRowGrain(0);
+
+    mPrevHeights.assign(m*n, 0.0f);
+    mCurrHeights.assign(m*n, 0.0f);
 
-    float d = damping*dt + 2.0f;
-    float e = (speed*speed)*(dt*dt) / (dx*dx);
-    mK1 = (damping*dt - 2.0f) / d;
-    mK2 = (4.0f - 8.0f*e) / d;
-    mK3 = (2.0f*e) / d;
+    mNormals.X.assign(m*n, 0.0f);
+    mNormals.Y.assign(m*n, 1.0f);
+    mNormals.Z.assign(m*n, 0.0f);
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mTangentX.X.assign(m*n, 1.0f);
+    mTangentX.Y.assign(m*n, 0.0f);
 
-    // Generate grid vertices in system memory.
+    // Generate the grid coordinates in system memory.
 
     float halfWidth = (n - 1)*dx*0.5f;
     float halfDepth = (m - 1)*dx*0.5f;
+
+    mGridX.resize(n);
+    for(int j = 0; j < n; ++j)
+        mGridX[j] = -halfWidth + j*dx;
+
+    mGridZ.resize(m);
     for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
+        mGridZ[i] = halfDepth - i*dx;
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    BuildTiles(mTileSize);
+    SetPatchSize(mPatchSize);
+    ViewSimulation();
 }
 
 Waves::~Waves()
 {
+	StopAsync();
 }
 
 int Waves::RowCount()const
@@ -85,88 +151,1299 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
+void Waves::SetSimdLevel(SimdLevel level)
+{
+	assert(!mAsync);
+	mKernels = &WavesKernels::Get(level);
+}
+
+SimdLevel Waves::GetSimdLevel()const
+{
+	return mKernels->Level;
+}
+
+void Waves::SetThreadPool(ThreadPool* pool)
+{
+	assert(!mAsync);
+	mPool = pool != nullptr ? pool : &ThreadPool::Default();
+}
+
+void Waves::SetRowGrain(int rows)
+{
+	assert(!mAsync);
+	// Aim for roughly 16K cells per task so the scheduling cost stays in the noise.
+	mRowGrain = rows > 0 ? rows : std::max(1, 16384 / mNumCols);
+}
+
+void Waves::SetUpdateMode(UpdateMode mode)
+{
+	assert(!mAsync);
+	mUpdateMode = mode;
+}
+
+Waves::UpdateMode Waves::GetUpdateMode()const
+{
+	return mUpdateMode;
+}
+
+void Waves::SetIntegrator(Integrator integrator)
+{
+	assert(!mAsync);
+	mIntegrator = integrator;
+	BuildConstants();
+
+	// The implicit steps move every point, so no tile may stay asleep.
+	if(integrator == Integrator::Implicit)
+	{
+		for(int t = 0; t < TileCount(); ++t)
+			WakeTile(t);
+	}
+}
+
+Waves::Integrator Waves::GetIntegrator()const
+{
+	return mIntegrator;
+}
+
+void Waves::SetNormalFormat(NormalFormat format)
+{
+	assert(!mAsync);
+	if(format == mNormalFormat)
+		return;
+
+	mNormalFormat = format;
+
+	// Only the storage of the current format is kept.  The grid boundary is never
+	// recomputed and stays pointing straight up.
+	const int count = mNumRows*mNumCols;
+	if(format == NormalFormat::Octahedral)
+	{
+		mPackedNormals.assign(count, EncodeOctahedral(0.0f, 1.0f, 0.0f));
+		std::vector<float>().swap(mNormals.X);
+		std::vector<float>().swap(mNormals.Y);
+		std::vector<float>().swap(mNormals.Z);
+	}
+	else
+	{
+		mNormals.X.assign(count, 0.0f);
+		mNormals.Y.assign(count, 1.0f);
+		mNormals.Z.assign(count, 0.0f);
+		std::vector<std::uint32_t>().swap(mPackedNormals);
+	}
+
+	ComputeNormals();
+
+	for(std::uint32_t& version : mTileVersion)
+		++version;
+
+	ViewSimulation();
+}
+
+Waves::NormalFormat Waves::GetNormalFormat()const
+{
+	return mNormalFormat;
+}
+
+std::uint32_t Waves::EncodeOctahedral(float x, float y, float z)
+{
+	const float invL1 = 1.0f / (std::fabs(x) + std::fabs(y) + std::fabs(z));
+	float u = x*invL1;
+	float v = z*invL1;
+
+	// Fold the lower hemisphere over the diagonals.
+	if(y < 0.0f)
+	{
+		const float foldedU = (1.0f - std::fabs(v))*(u >= 0.0f ? 1.0f : -1.0f);
+		const float foldedV = (1.0f - std::fabs(u))*(v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	return PackSnorm16(u) | PackSnorm16(v) << 16;
+}
+
+XMFLOAT3 Waves::DecodeOctahedral(std::uint32_t packed)
+{
+	float u = UnpackSnorm16(packed);
+	float v = UnpackSnorm16(packed >> 16);
+	const float y = 1.0f - std::fabs(u) - std::fabs(v);
+
+	if(y < 0.0f)
+	{
+		const float unfoldedU = (1.0f - std::fabs(v))*(u >= 0.0f ? 1.0f : -1.0f);
+		const float unfoldedV = (1.0f - std::fabs(u))*(v >= 0.0f ? 1.0f : -1.0f);
+		u = unfoldedU;
+		v = unfoldedV;
+	}
+
+	const float invLen = 1.0f / std::sqrt(u*u + y*y + v*v);
+	return XMFLOAT3(u*invLen, y*invLen, v*invLen);
+}
+
+float Waves::StableTimeStep(float dx, float speed)
+{
+	// The worst mode is the checkerboard (Laplacian eigenvalue -8/dx^2): its two
+	// amplification roots stay on or inside the unit circle while c^2 dt^2/dx^2 <= 1/2.
+	if(speed == 0.0f)
+		return std::numeric_limits<float>::infinity();
+
+	return (float)((double)dx / (std::sqrt(2.0)*std::fabs((double)speed)));
+}
+
+void Waves::BuildConstants()
+{
+	mStabilityLimit = StableTimeStep(mSpatialStep, mSpeed);
+
+	// The implicit integrator is stable at any step, so only the explicit one is capped.
+	const float stable = mStabilitySafety*mStabilityLimit;
+	float dt = stable;
+	if(mRequestedTimeStep > 0.0f)
+		dt = mIntegrator == Integrator::Implicit ? mRequestedTimeStep : std::min(mRequestedTimeStep, stable);
+
+	// Nothing moves with no wave speed; keep the step finite anyway.
+	if(!(dt < std::numeric_limits<float>::infinity()))
+		dt = mRequestedTimeStep > 0.0f ? mRequestedTimeStep : 1.0f / 60.0f;
+
+	mTimeStep = dt;
+
+	const float dx = mSpatialStep;
+	float d = mDamping*dt + 2.0f;
+	float e = (mSpeed*mSpeed)*(dt*dt) / (dx*dx);
+	mK1 = (mDamping*dt - 2.0f) / d;
+	mK2 = (4.0f - 8.0f*e) / d;
+	mK3 = (2.0f*e) / d;
+
+	BuildImplicitConstants(dt, e);
+}
+
+void Waves::SetSpeed(float speed)
+{
+	assert(!mAsync);
+	mSpeed = speed;
+	BuildConstants();
+}
+
+void Waves::SetDamping(float damping)
+{
+	assert(!mAsync);
+	mDamping = damping;
+	BuildConstants();
+}
+
+void Waves::SetTimeStep(float dt)
+{
+	assert(!mAsync);
+	mRequestedTimeStep = dt;
+	BuildConstants();
+}
+
+void Waves::SetStabilitySafety(float factor)
+{
+	assert(!mAsync);
+	mStabilitySafety = std::min(std::max(factor, 0.01f), 1.0f);
+	BuildConstants();
+}
+
+float Waves::GetSpeed()const
+{
+	return mSpeed;
+}
+
+float Waves::GetDamping()const
+{
+	return mDamping;
+}
+
+float Waves::GetStabilitySafety()const
+{
+	return mStabilitySafety;
+}
+
+float Waves::GetTimeStep()const
+{
+	return mTimeStep;
+}
+
+float Waves::StabilityLimit()const
+{
+	return mStabilityLimit;
+}
+
+void Waves::GetStepConstants(float& k1, float& k2, float& k3)const
+{
+	k1 = mK1;
+	k2 = mK2;
+	k3 = mK3;
+}
+
+void Waves::SetMaxSubsteps(int count)
+{
+	assert(!mAsync);
+	mMaxSubsteps = std::max(count, 1);
+}
+
+int Waves::GetMaxSubsteps()const
+{
+	return mMaxSubsteps;
+}
+
 void Waves::Update(float dt)
 {
-	static float t = 0;
+	const Clock::time_point start = Clock::now();
+
+	if(mAsync)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mAsyncMutex);
+			mAsyncPendingTime += dt;
+		}
+		mAsyncWake.notify_one();
+
+		AcquireLatest();
+	}
+	else
+	{
+		if(Simulate(dt) > 0)
+			RecordSimulation(MillisecondsSince(start));
+		ViewSimulation();
+	}
+
+	mUpdateMs.store((float)MillisecondsSince(start), std::memory_order_relaxed);
+}
 
+int Waves::Simulate(float dt)
+{
 	// Accumulate time.
-	t += dt;
+	mAccumulator += dt;
+
+	// Run one simulation step per elapsed time step, up to the substep cap.
+	int steps = 0;
+	while(mAccumulator >= mTimeStep && steps < mMaxSubsteps)
+	{
+		mAccumulator -= mTimeStep;
+		++steps;
+	}
+
+	// If we hit the cap, drop the whole steps we could not afford (keeping the fraction
+	// of a step) rather than letting the backlog snowball over the next frames.
+	if(mAccumulator >= mTimeStep)
+		mAccumulator -= std::floor(mAccumulator / mTimeStep) * mTimeStep;
+
+	if(steps == 0)
+		return 0;
+
+	RunSteps(steps);
+	return steps;
+}
+
+void Waves::RunSteps(std::uint64_t steps)
+{
+	mStepCount.fetch_add(steps, std::memory_order_relaxed);
+
+	if(mIntegrator == Integrator::Implicit)
+	{
+		for(std::uint64_t s = 0; s < steps; ++s, ++mStep)
+		{
+			ApplyImpulses();
+			StepImplicit();
+		}
+
+		ComputeNormals();
+		for(auto& v : mTileVersion)
+			++v;
+		return;
+	}
+
+	if(mSparse)
+	{
+		for(std::uint64_t s = 0; s < steps; ++s, ++mStep)
+		{
+			ApplyImpulses();
+			StepSparse(s == steps - 1);
+		}
+		return;
+	}
+
+	// Only the final solution is ever looked at, so the intermediate substeps just
+	// advance the heights and the normals are computed once, after the last one.
+	for(std::uint64_t s = 0; s < steps - 1; ++s, ++mStep)
+	{
+		ApplyImpulses();
+		StepHeights();
+	}
+
+	ApplyImpulses();
+	if(mUpdateMode == UpdateMode::Fused)
+	{
+		StepFused();
+	}
+	else
+	{
+		StepHeights();
+		ComputeNormals();
+	}
+	++mStep;
+
+	// Every tile changed.
+	for(auto& v : mTileVersion)
+		++v;
+}
+
+std::uint64_t Waves::StepIndex()const
+{
+	return mStep;
+}
+
+void Waves::LoadHeights(const float* heights)
+{
+	assert(!mAsync && !mSparse);
+
+	const std::size_t count = (std::size_t)mNumRows*mNumCols;
+	std::memcpy(mCurrHeights.data(), heights, count*sizeof(float));
+	std::memcpy(mPrevHeights.data(), heights, count*sizeof(float));
+
+	ComputeNormals();
+
+	for(std::uint32_t& version : mTileVersion)
+		++version;
+
+	ViewSimulation();
+}
+
+void Waves::StartAsync()
+{
+	if(mAsync)
+		return;
+
+	// Every snapshot starts out as a full copy; from then on only changed tiles move.
+	for(Snapshot& snap : mSnapshots)
+	{
+		snap.Heights = mCurrHeights;
+		snap.Normals.X = mNormals.X;
+		snap.Normals.Y = mNormals.Y;
+		snap.Normals.Z = mNormals.Z;
+		snap.PackedNormals = mPackedNormals;
+		snap.TangentX.X = mTangentX.X;
+		snap.TangentX.Y = mTangentX.Y;
+		snap.TileAwake = mTileAwake;
+		snap.TileVersion = mTileVersion;
+	}
+
+	mBackSnapshot = 0;
+	mMiddleSnapshot.store(1, std::memory_order_relaxed);
+	mFrontSnapshot = 2;
+	AcquireLatest();
+
+	mAsyncPendingTime = 0.0f;
+	mAsyncStop = false;
+	mAsync = true;
+	mAsyncThread = std::thread(&Waves::AsyncMain, this);
+}
+
+void Waves::StopAsync()
+{
+	if(!mAsync)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mAsyncMutex);
+		mAsyncStop = true;
+	}
+	mAsyncWake.notify_one();
+	mAsyncThread.join();
+
+	// Time the worker never got to is simulated by the next Update.
+	mAccumulator += mAsyncPendingTime;
+	mAsyncPendingTime = 0.0f;
+	mAsync = false;
+
+	for(Snapshot& snap : mSnapshots)
+		snap = Snapshot();
+	ViewSimulation();
+}
+
+bool Waves::IsAsync()const
+{
+	return mAsync;
+}
+
+Waves::Timings Waves::GetTimings()const
+{
+	Timings t;
+	t.UpdateMs = mUpdateMs.load(std::memory_order_relaxed);
+	t.SimulationMs = mSimulationMs.load(std::memory_order_relaxed);
+	t.AverageSimulationMs = mAverageSimulationMs.load(std::memory_order_relaxed);
+	t.PublishMs = mPublishMs.load(std::memory_order_relaxed);
+	t.Steps = mStepCount.load(std::memory_order_relaxed);
+	t.Published = mPublishCount.load(std::memory_order_relaxed);
+
+	const double seconds = mSimulationSeconds.load(std::memory_order_relaxed);
+	t.StepsPerSecond = seconds > 0.0 ? (float)(t.Steps / seconds) : 0.0f;
+	t.RequiredStepsPerSecond = 1.0f / mTimeStep;
+	return t;
+}
+
+void Waves::AsyncMain()
+{
+	for(;;)
+	{
+		float dt;
+		{
+			std::unique_lock<std::mutex> lock(mAsyncMutex);
+			mAsyncWake.wait(lock, [this]() { return mAsyncStop || mAsyncPendingTime > 0.0f; });
+			if(mAsyncStop)
+				return;
+
+			dt = mAsyncPendingTime;
+			mAsyncPendingTime = 0.0f;
+		}
+
+		const Clock::time_point start = Clock::now();
+		if(Simulate(dt) == 0)
+			continue;
+
+		const Clock::time_point publishStart = Clock::now();
+		Publish();
+		mPublishMs.store((float)MillisecondsSince(publishStart), std::memory_order_relaxed);
+
+		RecordSimulation(MillisecondsSince(start));
+	}
+}
+
+void Waves::Publish()
+{
+	Snapshot& snap = mSnapshots[mBackSnapshot];
+
+	for(int t = 0; t < TileCount(); ++t)
+	{
+		if(snap.TileVersion[t] == mTileVersion[t])
+			continue;
+
+		const TileRect r = GetTileRect(t);
+		CopyRect(snap.Heights, mCurrHeights, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+		if(mNormalFormat == NormalFormat::Octahedral)
+		{
+			CopyRect(snap.PackedNormals, mPackedNormals, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+		}
+		else
+		{
+			CopyRect(snap.Normals.X, mNormals.X, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+			CopyRect(snap.Normals.Y, mNormals.Y, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+			CopyRect(snap.Normals.Z, mNormals.Z, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+		}
+		CopyRect(snap.TangentX.X, mTangentX.X, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+		CopyRect(snap.TangentX.Y, mTangentX.Y, mNumCols, r.Row0, r.Row1, r.Col0, r.Col1);
+
+		snap.TileVersion[t] = mTileVersion[t];
+	}
+	std::copy(mTileAwake.begin(), mTileAwake.end(), snap.TileAwake.begin());
+
+	// Hand the snapshot over and take back whichever one Update is not holding.
+	const int previous = mMiddleSnapshot.exchange(mBackSnapshot | NewSnapshot, std::memory_order_acq_rel);
+	mBackSnapshot = previous & ~NewSnapshot;
+
+	mPublishCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Waves::AcquireLatest()
+{
+	if(mMiddleSnapshot.load(std::memory_order_relaxed) & NewSnapshot)
+	{
+		const int latest = mMiddleSnapshot.exchange(mFrontSnapshot, std::memory_order_acq_rel);
+		mFrontSnapshot = latest & ~NewSnapshot;
+	}
+
+	const Snapshot& snap = mSnapshots[mFrontSnapshot];
+	mView.Heights = snap.Heights.data();
+	mView.NormalX = snap.Normals.X.data();
+	mView.NormalY = snap.Normals.Y.data();
+	mView.NormalZ = snap.Normals.Z.data();
+	mView.PackedNormals = snap.PackedNormals.data();
+	mView.TangentX = snap.TangentX.X.data();
+	mView.TangentY = snap.TangentX.Y.data();
+	mView.TileAwake = snap.TileAwake.data();
+	mView.TileVersion = snap.TileVersion.data();
+}
+
+void Waves::ViewSimulation()
+{
+	mView.Heights = mCurrHeights.data();
+	mView.NormalX = mNormals.X.data();
+	mView.NormalY = mNormals.Y.data();
+	mView.NormalZ = mNormals.Z.data();
+	mView.PackedNormals = mPackedNormals.data();
+	mView.TangentX = mTangentX.X.data();
+	mView.TangentY = mTangentX.Y.data();
+	mView.TileAwake = mTileAwake.data();
+	mView.TileVersion = mTileVersion.data();
+}
+
+void Waves::RecordSimulation(double ms)
+{
+	// Exponential moving average; only the simulating thread writes it.
+	const float average = mAverageSimulationMs.load(std::memory_order_relaxed);
+	mSimulationSeconds.store(mSimulationSeconds.load(std::memory_order_relaxed) + ms*0.001,
+		std::memory_order_relaxed);
+	mSimulationMs.store((float)ms, std::memory_order_relaxed);
+	mAverageSimulationMs.store(average == 0.0f ? (float)ms : average + ((float)ms - average)/32.0f,
+		std::memory_order_relaxed);
+}
+
+void Waves::UpdateRow(int i)
+{
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// Note how we can do this inplace (read/write to same element) 
+	// because we won't need prev_ij again and the assignment happens last.
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to 
+	// keep consistent with our row indices going down.
+	const float* curr = &mCurrHeights[i*mNumCols];
+	mKernels->UpdateRow(&mPrevHeights[i*mNumCols], curr, curr - mNumCols, curr + mNumCols,
+		1, mNumCols - 1, mK1, mK2, mK3);
+}
+
+void Waves::NormalRow(const float* heights, int i)
+{
+	NormalRow(heights, i, 1, mNumCols - 1);
+}
+
+void Waves::NormalRow(const float* heights, int i, int j0, int j1)
+{
+	const int row = i*mNumCols;
+	const float* h = heights + row;
+
+	if(mNormalFormat == NormalFormat::Octahedral)
+	{
+		mKernels->NormalRowOct(h, h - mNumCols, h + mNumCols, j0, j1, 2.0f*mSpatialStep,
+			&mPackedNormals[row], &mTangentX.X[row], &mTangentX.Y[row]);
+	}
+	else
+	{
+		mKernels->NormalRow(h, h - mNumCols, h + mNumCols, j0, j1, 2.0f*mSpatialStep,
+			&mNormals.X[row], &mNormals.Y[row], &mNormals.Z[row],
+			&mTangentX.X[row], &mTangentX.Y[row]);
+	}
+}
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+void Waves::StepHeights()
+{
+	// Only update interior points; we use zero boundary conditions.
+	mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this](int i0, int i1)
+	{
+		for(int i = i0; i < i1; ++i)
+			UpdateRow(i);
+	});
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::ComputeNormals()
+{
+	//
+	// Compute normals using finite difference scheme.
+	//
+	mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this](int i0, int i1)
+	{
+		for(int i = i0; i < i1; ++i)
+			NormalRow(mCurrHeights.data(), i);
+	});
+}
+
+void Waves::StepFused()
+{
+	// The grid is cut into row bands, one task per band.  Within a band the normals
+	// trail the height update by one row, so row i-1 is differentiated right after
+	// row i got its new heights, while all three rows it reads are still in cache.
+	// The first and last row of a band need new heights from the neighboring bands;
+	// those two rows are done in a short second pass once every band has finished.
+	const int interiorRows = mNumRows - 2;
+	const int tasksWanted = 4 * (int)mPool->Concurrency();
+	const int bandRows = std::max(mRowGrain, (interiorRows + tasksWanted - 1) / tasksWanted);
+	const int bandCount = (interiorRows + bandRows - 1) / bandRows;
+
+	// The new solution is written over the previous one.
+	const float* next = mPrevHeights.data();
+
+	mPool->ParallelFor(0, bandCount, 1, [this, next, bandRows](int b0, int b1)
+	{
+		for(int band = b0; band < b1; ++band)
+		{
+			const int first = 1 + band*bandRows;
+			const int last = std::min(first + bandRows, mNumRows - 1);
+
+			for(int i = first; i < last; ++i)
+			{
+				UpdateRow(i);
+
+				if(i - 1 > first)
+					NormalRow(next, i - 1);
+			}
+		}
+	});
+
+	mPool->ParallelFor(0, bandCount, std::max(1, bandCount / (int)mPool->Concurrency()),
+		[this, next, bandRows](int b0, int b1)
+	{
+		for(int band = b0; band < b1; ++band)
+		{
+			const int first = 1 + band*bandRows;
+			const int last = std::min(first + bandRows, mNumRows - 1);
+
+			NormalRow(next, first);
+			if(last - 1 > first)
+				NormalRow(next, last - 1);
+		}
+	});
+
+	std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::SetSparseTiles(bool enable, int tileSize, float sleepThreshold)
+{
+	assert(!mAsync);
+	mSparse = enable;
+	mSleepThreshold = sleepThreshold;
+
+	if(tileSize != mTileSize)
+		BuildTiles(tileSize);
+
+	// Start with everything awake; quiet tiles fall asleep on their own.
+	std::fill(mTileAwake.begin(), mTileAwake.end(), (std::uint8_t)1);
+	std::fill(mTileQuietSteps.begin(), mTileQuietSteps.end(), (std::uint8_t)0);
+	ViewSimulation();
+}
+
+bool Waves::SparseTilesEnabled()const
+{
+	return mSparse;
+}
+
+int Waves::TileCount()const
+{
+	return mTileRows*mTileCols;
+}
+
+int Waves::AwakeTileCount()const
+{
+	return (int)std::count(mView.TileAwake, mView.TileAwake + TileCount(), (std::uint8_t)1);
+}
+
+Waves::TileRect Waves::GetTileRect(int tile)const
+{
+	const int tr = tile / mTileCols;
+	const int tc = tile % mTileCols;
+
+	TileRect r;
+	r.Row0 = 1 + tr*mTileSize;
+	r.Row1 = std::min(r.Row0 + mTileSize, mNumRows - 1);
+	r.Col0 = 1 + tc*mTileSize;
+	r.Col1 = std::min(r.Col0 + mTileSize, mNumCols - 1);
+	return r;
+}
+
+bool Waves::IsTileAwake(int tile)const
+{
+	return mView.TileAwake[tile] != 0;
+}
+
+std::uint32_t Waves::TileVersion(int tile)const
+{
+	return mView.TileVersion[tile];
+}
+
+void Waves::SetPatchSize(int quads)
+{
+	assert(!mAsync);
+	mPatchSize = std::max(quads, 1);
+	mPatches.clear();
+	mPatchVertexCount = 0;
+
+	for(int r0 = 0; r0 < mNumRows - 1; r0 += mPatchSize)
+	{
+		for(int c0 = 0; c0 < mNumCols - 1; c0 += mPatchSize)
+		{
+			Patch p;
+			p.Row0 = r0;
+			p.Row1 = std::min(r0 + mPatchSize, mNumRows - 1) + 1;
+			p.Col0 = c0;
+			p.Col1 = std::min(c0 + mPatchSize, mNumCols - 1) + 1;
+			p.VertexStart = mPatchVertexCount;
+			p.VertexCount = (p.Row1 - p.Row0)*(p.Col1 - p.Col0);
+
+			mPatchVertexCount += p.VertexCount;
+			mPatches.push_back(p);
+		}
+	}
+}
+
+int Waves::PatchSize()const
+{
+	return mPatchSize;
+}
+
+int Waves::PatchCount()const
+{
+	return (int)mPatches.size();
+}
+
+const Waves::Patch& Waves::GetPatch(int patch)const
+{
+	return mPatches[patch];
+}
+
+int Waves::PatchVertexCount()const
+{
+	return mPatchVertexCount;
+}
+
+std::uint32_t Waves::PatchVersion(int patch)const
+{
+	const Patch& p = mPatches[patch];
+
+	// Interior points of the patch; the boundary of the grid never changes.
+	const int i0 = std::max(p.Row0, 1);
+	const int i1 = std::min(p.Row1, mNumRows - 1);
+	const int j0 = std::max(p.Col0, 1);
+	const int j1 = std::min(p.Col1, mNumCols - 1);
+	if(i0 >= i1 || j0 >= j1)
+		return 0;
+
+	// Tile versions only ever go up, so their sum moves whenever one of them does.
+	std::uint32_t version = 0;
+	for(int tr = (i0 - 1) / mTileSize; tr <= (i1 - 2) / mTileSize; ++tr)
+	{
+		for(int tc = (j0 - 1) / mTileSize; tc <= (j1 - 2) / mTileSize; ++tc)
+			version += mView.TileVersion[tr*mTileCols + tc];
+	}
+
+	return version;
+}
+
+void Waves::SampleHeights(const XMFLOAT2* xz, int count, float* heights)const
+{
+	static_assert(sizeof(XMFLOAT2) == 2*sizeof(float), "samples are read as interleaved x, z pairs");
+	mKernels->Sample(mView.Heights, mNumRows, mNumCols, mGridX[0], mGridZ[0], 1.0f / mSpatialStep,
+		&xz[0].x, count, heights, nullptr, nullptr, nullptr);
+}
+
+void Waves::SampleNormals(const XMFLOAT2* xz, int count, XMFLOAT3* normals)const
+{
+	// The kernels write component planes; go through a small batch on the stack.
+	const int BatchSize = 256;
+	float nx[BatchSize];
+	float ny[BatchSize];
+	float nz[BatchSize];
+
+	for(int k0 = 0; k0 < count; k0 += BatchSize)
+	{
+		const int n = std::min(BatchSize, count - k0);
+		mKernels->Sample(mView.Heights, mNumRows, mNumCols, mGridX[0], mGridZ[0], 1.0f / mSpatialStep,
+			&xz[k0].x, n, nullptr, nx, ny, nz);
+
+		for(int k = 0; k < n; ++k)
+			normals[k0 + k] = XMFLOAT3(nx[k], ny[k], nz[k]);
+	}
+}
+
+void Waves::WriteVertices(void* dst, const int* patches, int patchCount)const
+{
+	const float invWidth = 1.0f / Width();
+	const float invDepth = 1.0f / Depth();
+	float* base = static_cast<float*>(dst);
+
+	auto writePatch = [this, base, invWidth, invDepth](const Patch& p)
+	{
+		float* out = base + (size_t)p.VertexStart*8;
+		for(int i = p.Row0; i < p.Row1; ++i)
+		{
+			const int row = i*mNumCols;
+			const float* h = &mView.Heights[row];
+			const float z = mGridZ[i];
+			const float v = 0.5f - z*invDepth;
+
+			for(int j = p.Col0; j < p.Col1; ++j)
+			{
+				const float x = mGridX[j];
+				const XMFLOAT3 n = Normal(row + j);
+				out[0] = x;
+				out[1] = h[j];
+				out[2] = z;
+				out[3] = n.x;
+				out[4] = n.y;
+				out[5] = n.z;
+				out[6] = 0.5f + x*invWidth;
+				out[7] = v;
+				out += 8;
+			}
+		}
+	};
+
+	ForEachPatch(patches, patchCount, writePatch);
+}
+
+void Waves::WriteStaticVertices(void* dst)const
+{
+	const float invWidth = 1.0f / Width();
+	const float invDepth = 1.0f / Depth();
+	float* base = static_cast<float*>(dst);
+
+	ForEachPatch(nullptr, PatchCount(), [this, base, invWidth, invDepth](const Patch& p)
+	{
+		float* out = base + (size_t)p.VertexStart*4;
+		for(int i = p.Row0; i < p.Row1; ++i)
+		{
+			const float z = mGridZ[i];
+			const float v = 0.5f - z*invDepth;
+
+			for(int j = p.Col0; j < p.Col1; ++j)
+			{
+				const float x = mGridX[j];
+				out[0] = x;
+				out[1] = z;
+				out[2] = 0.5f + x*invWidth;
+				out[3] = v;
+				out += 4;
+			}
+		}
+	});
+}
+
+void Waves::WriteDynamicVertices(void* dst, const int* patches, int patchCount)const
+{
+	std::uint32_t* base = static_cast<std::uint32_t*>(dst);
+
+	ForEachPatch(patches, patchCount, [this, base](const Patch& p)
+	{
+		std::uint32_t* out = base + (size_t)p.VertexStart*2;
+		for(int i = p.Row0; i < p.Row1; ++i)
+		{
+			const int row = i*mNumCols;
+			if(mNormalFormat == NormalFormat::Octahedral)
+			{
+				// Already packed; interleave with the heights.
+				const float* h = &mView.Heights[row];
+				const std::uint32_t* n = &mView.PackedNormals[row];
+				for(int j = p.Col0; j < p.Col1; ++j)
+				{
+					std::memcpy(out, &h[j], sizeof(float));
+					out[1] = n[j];
+					out += 2;
+				}
+			}
+			else
+			{
+				mKernels->PackRow(&mView.Heights[row], &mView.NormalX[row], &mView.NormalY[row], &mView.NormalZ[row],
+					p.Col0, p.Col1, out);
+				out += 2*(p.Col1 - p.Col0);
+			}
+		}
+	});
+}
+
+void Waves::ForEachPatch(const int* patches, int patchCount, const std::function<void(const Patch&)>& writePatch)const
+{
+	// A patch is a few thousand vertices, so hand them out a few at a time.
+	const int grain = std::max(1, patchCount / (4 * (int)mPool->Concurrency()));
+	mPool->ParallelFor(0, patchCount, grain, [this, patches, &writePatch](int a0, int a1)
+	{
+		for(int a = a0; a < a1; ++a)
+			writePatch(mPatches[patches != nullptr ? patches[a] : a]);
+	});
+}
+
+void Waves::BuildTiles(int tileSize)
+{
+	mTileSize = std::max(tileSize, 1);
+	mTileRows = std::max(mNumRows - 2, 0) / mTileSize + (std::max(mNumRows - 2, 0) % mTileSize != 0);
+	mTileCols = std::max(mNumCols - 2, 0) / mTileSize + (std::max(mNumCols - 2, 0) % mTileSize != 0);
+
+	const int tileCount = mTileRows*mTileCols;
+	mTileAwake.assign(tileCount, 1);
+	mTileQuietSteps.assign(tileCount, 0);
+	mTileReport.assign(tileCount, 0);
+	mTileVersion.assign(tileCount, 0);
+	mActiveTiles.reserve(tileCount);
+}
+
+int Waves::TileAt(int i, int j)const
+{
+	return ((i - 1) / mTileSize)*mTileCols + (j - 1) / mTileSize;
+}
+
+void Waves::WakeTile(int tile)
+{
+	mTileAwake[tile] = 1;
+	mTileQuietSteps[tile] = 0;
+}
+
+void Waves::StepSparse(bool computeNormals)
+{
+	mActiveTiles.clear();
+	for(int t = 0; t < TileCount(); ++t)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		if(mTileAwake[t])
+			mActiveTiles.push_back(t);
+	}
+
+	// Sleeping tiles hold zero in both solutions, so swapping the buffers below
+	// leaves them untouched.
+	if(mActiveTiles.empty())
+		return;
+
+	const int tileGrain = std::max(1, (int)mActiveTiles.size() / (4 * (int)mPool->Concurrency()));
+
+	mPool->ParallelFor(0, (int)mActiveTiles.size(), tileGrain, [this](int a0, int a1)
+	{
+		for(int a = a0; a < a1; ++a)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			TileRect r = GetTileRect(mActiveTiles[a]);
+			for(int i = r.Row0; i < r.Row1; ++i)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				const float* curr = &mCurrHeights[i*mNumCols];
+				mKernels->UpdateRow(&mPrevHeights[i*mNumCols], curr, curr - mNumCols, curr + mNumCols,
+					r.Col0, r.Col1, mK1, mK2, mK3);
 			}
-		});
+		}
+	});
+
+	std::swap(mPrevHeights, mCurrHeights);
+
+	mPool->ParallelFor(0, (int)mActiveTiles.size(), tileGrain, [this](int a0, int a1)
+	{
+		for(int a = a0; a < a1; ++a)
+			mTileReport[mActiveTiles[a]] = CheckTile(mActiveTiles[a]);
+	});
+
+	// Apply the reports serially: wake the neighbors the waves are crossing into and
+	// put tiles that have been quiet long enough to sleep.
+	for(int t : mActiveTiles)
+	{
+		const std::uint8_t report = mTileReport[t];
+		const int tr = t / mTileCols;
+		const int tc = t % mTileCols;
+
+		++mTileVersion[t];
+
+		if((report & TileEdgeUp) && tr > 0)
+			WakeTile(t - mTileCols);
+		if((report & TileEdgeDown) && tr + 1 < mTileRows)
+			WakeTile(t + mTileCols);
+		if((report & TileEdgeLeft) && tc > 0)
+			WakeTile(t - 1);
+		if((report & TileEdgeRight) && tc + 1 < mTileCols)
+			WakeTile(t + 1);
+
+		if(report & TileQuiet)
+		{
+			if(++mTileQuietSteps[t] >= QuietStepsToSleep)
+				SleepTile(t);
+		}
+		else
+		{
+			mTileQuietSteps[t] = 0;
+		}
+	}
+
+	if(!computeNormals)
+		return;
+
+	mActiveTiles.clear();
+	for(int t = 0; t < TileCount(); ++t)
+	{
+		if(mTileAwake[t])
+			mActiveTiles.push_back(t);
+	}
+
+	mPool->ParallelFor(0, (int)mActiveTiles.size(), tileGrain, [this](int a0, int a1)
+	{
+		for(int a = a0; a < a1; ++a)
+		{
+			TileRect r = GetTileRect(mActiveTiles[a]);
+			for(int i = r.Row0; i < r.Row1; ++i)
+				NormalRow(mCurrHeights.data(), i, r.Col0, r.Col1);
+		}
+	});
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+	for(int t : mActiveTiles)
+		++mTileVersion[t];
+}
+
+std::uint8_t Waves::CheckTile(int tile)const
+{
+	TileRect r = GetTileRect(tile);
+
+	float maxHeight = 0.0f;
+	float maxChange = 0.0f;
+	for(int i = r.Row0; i < r.Row1; ++i)
+	{
+		const float* h = &mCurrHeights[i*mNumCols];
+		const float* prev = &mPrevHeights[i*mNumCols];
+		for(int j = r.Col0; j < r.Col1; ++j)
+		{
+			maxHeight = std::max(maxHeight, std::fabs(h[j]));
+			maxChange = std::max(maxChange, std::fabs(h[j] - prev[j]));
+		}
+	}
+
+	std::uint8_t report = 0;
+	if(maxHeight < mSleepThreshold && maxChange < mSleepThreshold)
+		report |= TileQuiet;
 
-		t = 0.0f; // reset time
+	auto rowActive = [this, &r](int i)
+	{
+		for(int j = r.Col0; j < r.Col1; ++j)
+		{
+			if(std::fabs(mCurrHeights[i*mNumCols + j]) >= mSleepThreshold)
+				return true;
+		}
+		return false;
+	};
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+	auto colActive = [this, &r](int j)
+	{
+		for(int i = r.Row0; i < r.Row1; ++i)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			if(std::fabs(mCurrHeights[i*mNumCols + j]) >= mSleepThreshold)
+				return true;
+		}
+		return false;
+	};
+
+	if(rowActive(r.Row0))     report |= TileEdgeUp;
+	if(rowActive(r.Row1 - 1)) report |= TileEdgeDown;
+	if(colActive(r.Col0))     report |= TileEdgeLeft;
+	if(colActive(r.Col1 - 1)) report |= TileEdgeRight;
+
+	return report;
+}
+
+void Waves::SleepTile(int tile)
+{
+	// Flatten the tile so it contributes nothing while asleep and both solutions agree.
+	TileRect r = GetTileRect(tile);
+	for(int i = r.Row0; i < r.Row1; ++i)
+	{
+		for(int j = r.Col0; j < r.Col1; ++j)
+		{
+			const int k = i*mNumCols + j;
+			mPrevHeights[k] = 0.0f;
+			mCurrHeights[k] = 0.0f;
+		}
+	}
+	FlattenTileNormals(tile);
+
+	mTileAwake[tile] = 0;
+	mTileQuietSteps[tile] = 0;
+	++mTileVersion[tile];
+}
+
+void Waves::FlattenTileNormals(int tile)
+{
+	TileRect r = GetTileRect(tile);
+	const std::uint32_t flatNormal = EncodeOctahedral(0.0f, 1.0f, 0.0f);
+	for(int i = r.Row0; i < r.Row1; ++i)
+	{
+		for(int j = r.Col0; j < r.Col1; ++j)
+		{
+			const int k = i*mNumCols + j;
+			if(mNormalFormat == NormalFormat::Octahedral)
+			{
+				mPackedNormals[k] = flatNormal;
+			}
+			else
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				mNormals.X[k] = 0.0f;
+				mNormals.Y[k] = 1.0f;
+				mNormals.Z[k] = 0.0f;
 			}
-		});
+			mTangentX.X[k] = 1.0f;
+			mTangentX.Y[k] = 0.0f;
+		}
 	}
 }
 
-void Waves::Disturb(int i, int j, float magnitude)
+bool Waves::Disturb(int i, int j, float magnitude)
 {
-	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows-2);
-	assert(j > 1 && j < mNumCols-2);
+	Impulse impulse;
+	impulse.Row = (float)i;
+	impulse.Col = (float)j;
+	impulse.Magnitude = magnitude;
 
-	float halfMag = 0.5f*magnitude;
+	return Disturb(impulse);
+}
 
-	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+bool Waves::Disturb(const Impulse& impulse)
+{
+	Impulse queued = impulse;
+	if(!PlaceImpulse(queued, mNumRows, mNumCols, mImpulseEdgePolicy.load(std::memory_order_relaxed)))
+	{
+		mDroppedImpulses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if(!mImpulses.TryPush(queued))
+	{
+		mDroppedImpulses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+int Waves::DisturbBatch(const Impulse* impulses, int count)
+{
+	int queued = 0;
+	for(int k = 0; k < count; ++k)
+		queued += Disturb(impulses[k]) ? 1 : 0;
+
+	return queued;
+}
+
+void Waves::SetImpulseEdgePolicy(ImpulseEdgePolicy policy)
+{
+	mImpulseEdgePolicy.store(policy, std::memory_order_relaxed);
+}
+
+Waves::ImpulseEdgePolicy Waves::GetImpulseEdgePolicy()const
+{
+	return mImpulseEdgePolicy.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Waves::DroppedImpulseCount()const
+{
+	return mDroppedImpulses.load(std::memory_order_relaxed);
+}
+
+bool Waves::PlaceImpulse(Impulse& impulse, int rowCount, int colCount, ImpulseEdgePolicy policy)
+{
+	// Keep the center inside the interior, or refuse it.
+	const float maxRow = (float)(rowCount - 2);
+	const float maxCol = (float)(colCount - 2);
+	const bool inside = impulse.Row >= 1.0f && impulse.Row <= maxRow &&
+		impulse.Col >= 1.0f && impulse.Col <= maxCol;
+	if(inside)
+		return true;
+
+	// A NaN center fails every comparison and can be neither kept nor clamped.
+	const bool nan = impulse.Row != impulse.Row || impulse.Col != impulse.Col;
+	if(nan || policy == ImpulseEdgePolicy::Reject)
+		return false;
+
+	impulse.Row = std::min(std::max(impulse.Row, 1.0f), maxRow);
+	impulse.Col = std::min(std::max(impulse.Col, 1.0f), maxCol);
+	return true;
+}
+
+void Waves::ApplyImpulses()
+{
+	if(mReplayEnd != nullptr)
+	{
+		for(; mReplayNext != mReplayEnd && mReplayNext->Step <= mStep; ++mReplayNext)
+		{
+			if(mReplayNext->Step < mStep)
+				continue;
+
+			ApplyImpulse(mReplayNext->Value);
+			if(mLogImpulses)
+				mImpulseLog.push_back(*mReplayNext);
+		}
+		return;
+	}
+
+	Impulse impulse;
+	while(mImpulses.TryPop(impulse))
+	{
+		ApplyImpulse(impulse);
+		if(mLogImpulses)
+			mImpulseLog.push_back(LoggedImpulse{ mStep, impulse });
+	}
+}
+
+Waves::TileRect Waves::AddImpulse(const Impulse& impulse, int rowCount, int colCount, int row0, int row1, float* heights)
+{
+	// Footprint rectangle, cut down to the interior (the boundary stays at zero) and to
+	// the rows stored in heights.
+	const int ci = (int)std::floor(impulse.Row + 0.5f);
+	const int cj = (int)std::floor(impulse.Col + 0.5f);
+	const float radius = std::max(impulse.Radius, 0.0f);
+
+	const float reach = impulse.Shape == ImpulseShape::Gaussian ? 3.0f*radius : radius;
+
+	int i0 = ci - 1, i1 = ci + 1, j0 = cj - 1, j1 = cj + 1;
+	if(impulse.Shape != ImpulseShape::Cross)
+	{
+		i0 = (int)std::ceil(impulse.Row - reach);
+		i1 = (int)std::floor(impulse.Row + reach);
+		j0 = (int)std::ceil(impulse.Col - reach);
+		j1 = (int)std::floor(impulse.Col + reach);
+	}
+
+	i0 = std::max(i0, std::max(row0, 1));
+	i1 = std::min(i1, std::min(row1 - 1, rowCount - 2));
+	j0 = std::max(j0, 1);
+	j1 = std::min(j1, colCount - 2);
+
+	if(impulse.Shape == ImpulseShape::Cross)
+	{
+		// Disturb the ijth vertex height and its neighbors.
+		const float halfMag = 0.5f*impulse.Magnitude;
+		const int points[5][2] = { { ci, cj }, { ci, cj+1 }, { ci, cj-1 }, { ci+1, cj }, { ci-1, cj } };
+		for(const auto& p : points)
+		{
+			if(p[0] < i0 || p[0] > i1 || p[1] < j0 || p[1] > j1)
+				continue;
+
+			heights[(p[0] - row0)*colCount + p[1]] += (p[0] == ci && p[1] == cj) ? impulse.Magnitude : halfMag;
+		}
+	}
+	else
+	{
+		const float invTwoSigmaSq = radius > 0.0f ? 0.5f / (radius*radius) : 0.0f;
+		const float radiusSq = radius*radius;
+
+		for(int i = i0; i <= i1; ++i)
+		{
+			const float di = i - impulse.Row;
+			for(int j = j0; j <= j1; ++j)
+			{
+				const float dj = j - impulse.Col;
+				const float dSq = di*di + dj*dj;
+
+				if(impulse.Shape == ImpulseShape::Gaussian)
+					heights[(i - row0)*colCount + j] += impulse.Magnitude*std::exp(-dSq*invTwoSigmaSq);
+				else if(dSq <= radiusSq)
+					heights[(i - row0)*colCount + j] += impulse.Magnitude;
+			}
+		}
+	}
+
+	TileRect touched = { i0, i1 + 1, j0, j1 + 1 };
+	if(i0 > i1 || j0 > j1)
+		touched.Row1 = touched.Row0;
+	return touched;
+}
+
+void Waves::ApplyImpulse(const Impulse& impulse)
+{
+	const TileRect r = AddImpulse(impulse, mNumRows, mNumCols, 0, mNumRows, mCurrHeights.data());
+
+	// Wake every tile the disturbance touched.
+	if(r.Row0 >= r.Row1)
+		return;
+
+	for(int tr = (r.Row0 - 1) / mTileSize; tr <= (r.Row1 - 2) / mTileSize; ++tr)
+	{
+		for(int tc = (r.Col0 - 1) / mTileSize; tc <= (r.Col1 - 2) / mTileSize; ++tc)
+		{
+			const int tile = tr*mTileCols + tc;
+			WakeTile(tile);
+			++mTileVersion[tile];
+		}
+	}
 }
 	
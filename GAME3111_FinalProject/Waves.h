@@ -4,17 +4,131 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// The solution is stored structure-of-arrays: the simulation only ever touches the
+// heights, so the previous/current solutions are plain float planes and the x/z grid
+// coordinates are kept separately (they never change after construction).  Normals
+// and tangents are likewise stored one component plane per array.
+//
+// The simulation can also run on a worker thread of its own (StartAsync).  The worker
+// publishes each finished solution into one of three snapshots, and Update only hands
+// over the elapsed time and picks up the most recent snapshot, so a frame never waits
+// on a simulation step.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
 #include <vector>
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <DirectXMath.h>
+#include "WavesKernels.h"
+#include "../Common/MpscRing.h"
+
+class ThreadPool;
 
 class Waves
 {
 public:
+	// How a step walks the grid.  TwoPass updates every height and then sweeps the grid
+	// again for the normals.  Fused computes the normals of each row band while its new
+	// heights are still in cache, so the heights only travel from memory once per step.
+	// Both modes give identical results.
+	enum class UpdateMode
+	{
+		TwoPass,
+		Fused
+	};
+
+	// How a step advances the heights.  Explicit is the classic leapfrog update: cheap,
+	// but only stable up to StableTimeStep.  Implicit treats the spatial term with the
+	// average of the new, current and previous solutions (weights 1/4, 1/2, 1/4), which
+	// is stable for any time step, and solves the resulting system by alternating
+	// directions (ADI): a tridiagonal solve along every row, then along every column.
+	// A step costs several explicit steps, so it pays off once the time step is a few
+	// times the explicit limit, as for coarse far-away water.  Large steps damp and
+	// slow down the short waves.  Implicit steps are always dense.
+	enum class Integrator
+	{
+		Explicit,
+		Implicit
+	};
+
+	// How the normal pass stores normals.  Float3 keeps three float planes.  Octahedral
+	// keeps one 32-bit word per point: the normal projected onto the octahedron around
+	// +y, with x in the low and z in the high 16 bits as snorm (R16G16_SNORM).  That is a
+	// third of the normal pass's stores, and the word can be uploaded as is.
+	enum class NormalFormat
+	{
+		Float3,
+		Octahedral
+	};
+
+	// Footprint of an impulse.  Cross is the classic stencil: the full magnitude at the
+	// center and half of it on the four neighbors.  Gaussian falls off with a standard
+	// deviation of Radius grid cells and is cut off at 3*Radius.  Disk adds the full
+	// magnitude to every point within Radius.
+	enum class ImpulseShape
+	{
+		Cross,
+		Gaussian,
+		Disk
+	};
+
+	// What happens to an impulse centered outside the interior of the grid.  Clamp moves
+	// the center to the nearest interior point; Reject drops the impulse.  Either way the
+	// part of a footprint that falls on the boundary or beyond is cut off.
+	enum class ImpulseEdgePolicy
+	{
+		Clamp,
+		Reject
+	};
+
+	struct Impulse
+	{
+		// Center in grid coordinates (row i, column j); may be fractional.
+		float Row;
+		float Col;
+		float Magnitude;
+		float Radius = 1.0f;
+		ImpulseShape Shape = ImpulseShape::Cross;
+	};
+
+	// Rectangle [Row0, Row1) x [Col0, Col1) of interior grid points covered by a tile.
+	struct TileRect
+	{
+		int Row0;
+		int Row1;
+		int Col0;
+		int Col1;
+	};
+
+	// Rendering patch.  The grid is cut into patches of at most PatchSize x PatchSize
+	// quads.  Neighboring patches share their border row/column of points, and those
+	// points are duplicated so that every patch owns one contiguous block of vertices
+	// (patch-major order) and can be drawn with patch-local indices.
+	struct Patch
+	{
+		// Grid points [Row0, Row1) x [Col0, Col1), borders included.
+		int Row0;
+		int Row1;
+		int Col0;
+		int Col1;
+
+		// Location of the patch's block in the patch-major vertex order.
+		int VertexStart;
+		int VertexCount;
+	};
+
+    // dt is the simulation time step.  It is capped at the stability limit (times the
+    // safety factor), and dt <= 0 asks for the largest stable step.
     Waves(int m, int n, float dx, float dt, float speed, float damping);
     Waves(const Waves& rhs) = delete;
     Waves& operator=(const Waves& rhs) = delete;
@@ -28,18 +142,379 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+    DirectX::XMFLOAT3 Position(int i)const
+    {
+        return DirectX::XMFLOAT3(mGridX[i % mNumCols], mView.Heights[i], mGridZ[i / mNumCols]);
+    }
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    DirectX::XMFLOAT3 Normal(int i)const
+    {
+        if(mNormalFormat == NormalFormat::Octahedral)
+            return DecodeOctahedral(mView.PackedNormals[i]);
+
+        return DirectX::XMFLOAT3(mView.NormalX[i], mView.NormalY[i], mView.NormalZ[i]);
+    }
+
+	// Octahedrally encoded normals of NormalFormat::Octahedral, one per grid point.
+	const std::uint32_t* PackedNormals()const { return mView.PackedNormals; }
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    DirectX::XMFLOAT3 TangentX(int i)const
+    {
+        return DirectX::XMFLOAT3(mView.TangentX[i], mView.TangentY[i], 0.0f);
+    }
+
+	// Returns the height of the current solution at the ith grid point.
+	float Height(int i)const { return mView.Heights[i]; }
 
+	// Direct access to the height planes, row-major with RowCount()*ColumnCount() entries.
+	const float* Heights()const { return mView.Heights; }
+
+	// Bilinear samples of the surface at count points (x, z) in the grid's local space,
+	// the space of Position.  Points off the grid get the value at the nearest edge.  The
+	// normals are those of the interpolated surface.  Samples read the same solution as
+	// the functions above (the last published one in asynchronous mode), so any number
+	// of threads may sample at once, just not while Update runs.
+	void SampleHeights(const DirectX::XMFLOAT2* xz, int count, float* heights)const;
+	void SampleNormals(const DirectX::XMFLOAT2* xz, int count, DirectX::XMFLOAT3* normals)const;
+
+	// Advances the simulation by dt seconds of real time.  Time is accumulated per
+	// instance and consumed in fixed steps of the construction time step, running as
+	// many steps as have elapsed (at most the substep cap; time beyond that is dropped).
+	// In asynchronous mode the time is passed to the worker instead and the solution
+	// seen through the query functions becomes the latest one the worker has finished;
+	// this never blocks on the worker.
 	void Update(float dt);
-	void Disturb(int i, int j, float magnitude);
+
+	// Moves the simulation onto a dedicated worker thread, or back onto the thread
+	// calling Update.  Between StartAsync and StopAsync only Update, the query and
+	// vertex writing functions and the Disturb family may be called; the setters
+	// below must wait for StopAsync.  The worker still runs its row sweeps on the
+	// thread pool, so give it a pool of its own if the frame thread should not help.
+	void StartAsync();
+	void StopAsync();
+	bool IsAsync()const;
+
+	// Simulation timing counters, updated by whichever thread runs the simulation.
+	struct Timings
+	{
+		// Time the last Update call took on the calling thread.  In asynchronous mode this
+		// is only the hand-off to the worker.
+		float UpdateMs;
+
+		// Time the last batch of simulation steps took (including the publish in
+		// asynchronous mode), and a running average over roughly the last 32 batches.
+		float SimulationMs;
+		float AverageSimulationMs;
+
+		// Time the worker spent copying the last solution into its snapshot.
+		float PublishMs;
+
+		std::uint64_t Steps;
+		std::uint64_t Published;
+
+		// Steps completed per second of time spent simulating (solver throughput), and
+		// steps needed per second of simulated time (1 / time step).
+		float StepsPerSecond;
+		float RequiredStepsPerSecond;
+	};
+	Timings GetTimings()const;
+
+	// Queue impulses for the start of the next simulation step.  These may be called
+	// from any number of threads, also while Update runs, and never wait on the
+	// simulation.  They return whether the impulse was queued: it is dropped if the
+	// queue is full or the edge policy rejects it.  DisturbBatch returns the number queued.
+	bool Disturb(int i, int j, float magnitude);
+	bool Disturb(const Impulse& impulse);
+	int DisturbBatch(const Impulse* impulses, int count);
+
+	void SetImpulseEdgePolicy(ImpulseEdgePolicy policy);
+	ImpulseEdgePolicy GetImpulseEdgePolicy()const;
+
+	// The placement and footprint rules of Disturb for a grid of rowCount x colCount
+	// points, for code that steps part of a grid elsewhere (WavesDomain).  PlaceImpulse
+	// applies the edge policy to the center and returns false if the impulse is dropped.
+	// AddImpulse adds the footprint, cut to the interior and to rows [row0, row1), to
+	// heights, which holds those rows starting with row0; it returns the rectangle of
+	// points it touched (empty if none).
+	static bool PlaceImpulse(Impulse& impulse, int rowCount, int colCount, ImpulseEdgePolicy policy);
+	static TileRect AddImpulse(const Impulse& impulse, int rowCount, int colCount, int row0, int row1, float* heights);
+
+	// Impulses dropped so far because the queue was full or they were rejected.
+	std::uint64_t DroppedImpulseCount()const;
+
+	// Selects the row kernels used by Update.  Defaults to the best level the CPU
+	// supports; SimdLevel::Scalar forces the reference implementation.  All levels
+	// produce bit-identical results.
+	void SetSimdLevel(SimdLevel level);
+	SimdLevel GetSimdLevel()const;
+
+	// Pool that runs the row sweeps (ThreadPool::Default() unless set) and the number of
+	// rows handed to each task.  A grain of 0 picks one from the grid width.
+	void SetThreadPool(ThreadPool* pool);
+	void SetRowGrain(int rows);
+
+	void SetUpdateMode(UpdateMode mode);
+	UpdateMode GetUpdateMode()const;
+
+	// Switching integrators rebuilds the constants (see SetTimeStep).  Switching to
+	// Implicit wakes every sparse tile.
+	void SetIntegrator(Integrator integrator);
+	Integrator GetIntegrator()const;
+
+	// Switching formats recomputes the normals of the current solution.
+	void SetNormalFormat(NormalFormat format);
+	NormalFormat GetNormalFormat()const;
+
+	// Octahedral normal encoding (see NormalFormat).  Decoding returns a unit vector;
+	// the round trip is within 0.004 degrees.
+	static std::uint32_t EncodeOctahedral(float x, float y, float z);
+	static DirectX::XMFLOAT3 DecodeOctahedral(std::uint32_t packed);
+
+	// Largest time step for which the scheme stays stable with spatial step dx and wave
+	// speed c.  Beyond it the solution grows without bound.  For the update in UpdateRow
+	// the von Neumann condition works out to
+	//   dt < dx / (sqrt(2)*c)
+	// whatever the damping: the damping is centered in time, so it scales both the
+	// oscillating and the decaying part of the amplification equally.  (The bound often
+	// quoted for this solver, (mu*dx^2 + sqrt(mu^2*dx^4 + 32*c^2*dx^2)) / (8*c^2),
+	// agrees at mu = 0 but is too large for mu > 0.)  Infinite for c == 0.
+	static float StableTimeStep(float dx, float speed);
+
+	// Changing the wave speed, damping or time step rebuilds the simulation constants
+	// and re-derives the time step: the requested one, capped at the stability limit
+	// times the safety factor (0.9 unless changed), or that product if the requested
+	// one is <= 0.  The Implicit integrator takes the requested step uncapped.  The
+	// current solution carries on with the new constants.
+	void SetSpeed(float speed);
+	void SetDamping(float damping);
+	void SetTimeStep(float dt);
+	void SetStabilitySafety(float factor);
+	float GetSpeed()const;
+	float GetDamping()const;
+	float GetStabilitySafety()const;
+
+	// Time step actually simulated with, and the stability limit it was derived from.
+	float GetTimeStep()const;
+	float StabilityLimit()const;
+
+	// Coefficients of the update in UpdateRow for the current configuration.
+	void GetStepConstants(float& k1, float& k2, float& k3)const;
+
+	// Most simulation steps a single Update may run to catch up after a slow frame.
+	void SetMaxSubsteps(int count);
+	int GetMaxSubsteps()const;
+
+	// The interior of the grid is split into square tiles of tileSize points.  With
+	// sparse updates enabled only awake tiles are simulated.  Disturb wakes the tiles it
+	// touches; an awake tile wakes its neighbor when the wave on their shared edge rises
+	// above sleepThreshold.  A tile whose heights and height changes have all stayed
+	// below sleepThreshold for a few steps is flattened and put to sleep.  With sparse
+	// updates disabled every tile is always awake.  Sparse stepping is done tile by
+	// tile, so the UpdateMode only applies to dense stepping.  The Implicit integrator
+	// couples whole rows and columns and ignores the tiles.
+	void SetSparseTiles(bool enable, int tileSize = 16, float sleepThreshold = 1.0e-3f);
+	bool SparseTilesEnabled()const;
+
+	int TileCount()const;
+	int AwakeTileCount()const;
+	TileRect GetTileRect(int tile)const;
+	bool IsTileAwake(int tile)const;
+
+	// Bumped whenever the solution inside the tile changes.  Clients keep the last
+	// version they copied to find the tiles whose vertices need to be rewritten.
+	std::uint32_t TileVersion(int tile)const;
+
+	// Rendering patches (64x64 quads unless changed).  Point (r, c) of patch p is vertex
+	// VertexStart + (r - Row0)*(Col1 - Col0) + (c - Col0) of the patch-major order.
+	void SetPatchSize(int quads);
+	int PatchSize()const;
+	int PatchCount()const;
+	const Patch& GetPatch(int patch)const;
+
+	// Number of vertices in patch-major order, shared borders counted once per patch.
+	int PatchVertexCount()const;
+
+	// Changes whenever a point of the patch changes, like TileVersion.
+	std::uint32_t PatchVersion(int patch)const;
+
+	// Interleaved vertex written by WriteVertices: position, normal and texture
+	// coordinates (mapping [-w/2,w/2] --> [0,1]) as 8 floats.
+	static const int VertexStride = 8 * sizeof(float);
+
+	// Writes the listed patches into dst, the start of a patch-major vertex buffer of
+	// PatchVertexCount() vertices.  Vertices are written front to back and never read,
+	// so dst may be write-combined upload memory.  Patches are split across the pool.
+	void WriteVertices(void* dst, const int* patches, int patchCount)const;
+
+	// Split water streams.  The static stream (x, z, u, v as 4 floats) never changes
+	// and is written once for the whole patch-major buffer.  Per frame only the dynamic
+	// stream needs uploading: the height as a float followed by the normal, a quarter of
+	// VertexStride.  The normal is packed as R8G8B8A8_SNORM for NormalFormat::Float3 and
+	// is the octahedral R16G16_SNORM word for NormalFormat::Octahedral.
+	static const int StaticVertexStride = 4 * sizeof(float);
+	static const int DynamicVertexStride = sizeof(float) + sizeof(std::uint32_t);
+	void WriteStaticVertices(void* dst)const;
+	void WriteDynamicVertices(void* dst, const int* patches, int patchCount)const;
+
+	// Number of simulation steps run so far (or restored from a snapshot).  Impulses are
+	// applied at the start of a step and logged against its index.
+	std::uint64_t StepIndex()const;
+
+	// Recording and replay, implemented in WavesRecorder.cpp.
+	//
+	// Snapshot file: the SnapshotHeader fields in order, little-endian and unpadded,
+	// followed by the previous and the current height planes (RowCount()*ColumnCount()
+	// floats each) and, per tile, its awake flag and quiet step count (one byte each).
+	// Normals are recomputed on load.  Restoring a snapshot into a grid with the same
+	// size, constants and integrator continues the simulation bit-exactly.  None of
+	// these may be called in asynchronous mode.
+	struct SnapshotHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::int32_t Rows;
+		std::int32_t Cols;
+		float SpatialStep;
+		float TimeStep;
+		float K1;
+		float K2;
+		float K3;
+		float Accumulator;
+		std::int32_t Integrator;
+		std::int32_t Reserved; // Zero.  Puts Step on an 8-byte boundary with no padding.
+		std::uint64_t Step;
+		std::int32_t Sparse;
+		std::int32_t TileSize;
+		float SleepThreshold;
+		std::int32_t TileCount;
+	};
+	static const std::uint32_t SnapshotMagic = 0x53564157; // "WAVS"
+	static const std::uint32_t SnapshotVersion = 4;
+
+	std::vector<std::uint8_t> SaveSnapshot()const;
+
+	// Captures the state right away and writes the file on another thread; the future
+	// reports whether the write succeeded.
+	std::future<bool> SaveSnapshotAsync(const std::string& filename)const;
+
+	// Return false (leaving the state untouched) if the data is not a snapshot of a grid
+	// with this size, these constants and this integrator.  The file is memory mapped, not read.
+	bool LoadSnapshot(const void* data, std::size_t size);
+	bool LoadSnapshot(const std::string& filename);
+
+	// Impulse log.  While logging, every impulse is recorded as it is applied, with the
+	// index of the step it went into.  Together with a snapshot taken when logging
+	// started, the log reproduces the run.  Read the log only in synchronous mode.
+	struct LoggedImpulse
+	{
+		std::uint64_t Step;
+		Impulse Value;
+	};
+	static const std::uint32_t ImpulseLogMagic = 0x4c504d49; // "IMPL"
+	static const std::uint32_t ImpulseLogVersion = 2;
+
+	// Enabling (re)starts an empty log.
+	void SetImpulseLogging(bool enable);
+	bool ImpulseLoggingEnabled()const;
+	const std::vector<LoggedImpulse>& ImpulseLog()const;
+
+	// Log file, little-endian whatever the platform: magic, version and entry count
+	// (32-bit each), then per entry the step (64-bit), row, column, magnitude and radius
+	// (32-bit floats) and the shape (32-bit), with no padding.
+	bool SaveImpulseLog(const std::string& filename)const;
+	static bool LoadImpulseLog(const std::string& filename, std::vector<LoggedImpulse>& log);
+
+	// Runs stepCount steps back to back with no time accumulation, applying the logged
+	// impulses of each step instead of the queued ones; entries for steps before
+	// StepIndex() are skipped.  The log must be sorted by step, as recorded.
+	void Replay(const LoggedImpulse* log, int count, std::uint64_t stepCount);
+
+	// Replaces the solution with RowCount()*ColumnCount() heights at rest (the previous
+	// solution is set equal to them) and recomputes the normals.  This is how a solution
+	// computed elsewhere, such as by a WavesDomain, is shown.  Dense grids only, and not
+	// in asynchronous mode.
+	void LoadHeights(const float* heights);
 
 private:
+	void UpdateRow(int i);
+	void NormalRow(const float* heights, int i);
+	void NormalRow(const float* heights, int i, int j0, int j1);
+	// Calls writePatch for the listed patches (all of them if patches is null) across the pool.
+	void ForEachPatch(const int* patches, int patchCount, const std::function<void(const Patch&)>& writePatch)const;
+
+	// Applies the queued impulses; called at the start of every step.
+	void ApplyImpulses();
+	void ApplyImpulse(const Impulse& impulse);
+
+	// Runs the steps due for dt seconds; returns how many ran.
+	int Simulate(float dt);
+	void RunSteps(std::uint64_t steps);
+	void StepHeights();
+	void ComputeNormals();
+	void StepFused();
+	void StepImplicit();
+
+	// Coefficients and sweep factors of StepImplicit for time step dt, where
+	// e = c^2*dt^2/dx^2.  Part of BuildConstants.
+	void BuildImplicitConstants(float dt, float e);
+
+	// Derives the time step and K1..K3 from the current configuration.
+	void BuildConstants();
+
+	// Points the query functions at the simulation buffers (synchronous mode).
+	void ViewSimulation();
+
+	void AsyncMain();
+	void Publish();
+	void AcquireLatest();
+	void RecordSimulation(double ms);
+
+	void BuildTiles(int tileSize);
+	int TileAt(int i, int j)const;
+	void WakeTile(int tile);
+	void StepSparse(bool computeNormals);
+	std::uint8_t CheckTile(int tile)const;
+	void SleepTile(int tile);
+	void FlattenTileNormals(int tile);
+
+private:
+	// Component planes of a field of 3D vectors.
+	struct VectorPlanes
+	{
+		std::vector<float> X;
+		std::vector<float> Y;
+		std::vector<float> Z;
+	};
+
+	// What the query functions read: the simulation buffers in synchronous mode, the
+	// front snapshot in asynchronous mode.
+	struct SolutionView
+	{
+		const float* Heights = nullptr;
+		const float* NormalX = nullptr;
+		const float* NormalY = nullptr;
+		const float* NormalZ = nullptr;
+		const std::uint32_t* PackedNormals = nullptr;
+		const float* TangentX = nullptr;
+		const float* TangentY = nullptr;
+		const std::uint8_t* TileAwake = nullptr;
+		const std::uint32_t* TileVersion = nullptr;
+	};
+
+	// One published solution.  TileVersion records the state of each tile it holds, so
+	// publishing into it only copies the tiles that changed since it was last filled.
+	struct Snapshot
+	{
+		std::vector<float> Heights;
+		VectorPlanes Normals;
+		std::vector<std::uint32_t> PackedNormals;
+		VectorPlanes TangentX;
+		std::vector<std::uint8_t> TileAwake;
+		std::vector<std::uint32_t> TileVersion;
+	};
+
     int mNumRows = 0;
     int mNumCols = 0;
 
@@ -54,10 +529,116 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Configuration the constants are built from.
+    float mSpeed = 0.0f;
+    float mDamping = 0.0f;
+    float mRequestedTimeStep = 0.0f;
+    float mStabilitySafety = 0.9f;
+    float mStabilityLimit = 0.0f;
+
+    const WavesKernels* mKernels = nullptr;
+
+    ThreadPool* mPool = nullptr;
+    int mRowGrain = 0;
+
+    UpdateMode mUpdateMode = UpdateMode::Fused;
+    Integrator mIntegrator = Integrator::Explicit;
+
+    // Implicit integrator: right-hand side coefficients, the sweep weight beta, and the
+    // Thomas factors along a row (x) and a column (z), indexed by grid column/row.
+    float mImplicitB = 0.0f;
+    float mImplicitQ = 0.0f;
+    float mImplicitInvA = 0.0f;
+    float mImplicitBeta = 0.0f;
+    std::vector<float> mSweepInvX;
+    std::vector<float> mSweepGainX;
+    std::vector<float> mSweepInvZ;
+    std::vector<float> mSweepGainZ;
+
+    // Rows solved together along x, one vector across the rows.
+    static const int ImplicitBand = 16;
+
+    // Implicit scratch: the right-hand side (then the correction), and each row band
+    // transposed to column-major.
+    std::vector<float> mImplicitRhs;
+    std::vector<float> mImplicitBands;
+
+    // Elapsed time not yet consumed by a simulation step.
+    float mAccumulator = 0.0f;
+    int mMaxSubsteps = 4;
+
+    // Impulses waiting for the next step, fed by any thread and drained by the simulation.
+    static const int ImpulseQueueCapacity = 4096;
+    MpscRing<Impulse> mImpulses;
+    std::atomic<ImpulseEdgePolicy> mImpulseEdgePolicy;
+    std::atomic<std::uint64_t> mDroppedImpulses;
+
+    std::uint64_t mStep = 0;
+
+    bool mLogImpulses = false;
+    std::vector<LoggedImpulse> mImpulseLog;
+
+    // Log being replayed by ApplyImpulses (null when taking impulses from the queue).
+    const LoggedImpulse* mReplayNext = nullptr;
+    const LoggedImpulse* mReplayEnd = nullptr;
+
+    SolutionView mView;
+
+    // Asynchronous mode.  Time handed over by Update waits in mAsyncPendingTime.  The
+    // snapshots form a triple buffer: the worker fills mBackSnapshot and swaps it with
+    // mMiddleSnapshot, flagged as new; Update swaps mFrontSnapshot with the middle one
+    // when the flag is set.
+    bool mAsync = false;
+    std::thread mAsyncThread;
+    std::mutex mAsyncMutex;
+    std::condition_variable mAsyncWake;
+    float mAsyncPendingTime = 0.0f;
+    bool mAsyncStop = false;
+    Snapshot mSnapshots[3];
+    int mBackSnapshot = 0;
+    std::atomic<int> mMiddleSnapshot;
+    int mFrontSnapshot = 2;
+
+    // Timing counters, written by the thread running the simulation.
+    std::atomic<float> mUpdateMs;
+    std::atomic<float> mSimulationMs;
+    std::atomic<float> mAverageSimulationMs;
+    std::atomic<float> mPublishMs;
+    std::atomic<std::uint64_t> mStepCount;
+    std::atomic<std::uint64_t> mPublishCount;
+    std::atomic<double> mSimulationSeconds;
+
+    // Activity tiles.
+    bool mSparse = false;
+    float mSleepThreshold = 1.0e-3f;
+    int mTileSize = 16;
+    int mTileRows = 0;
+    int mTileCols = 0;
+    std::vector<std::uint8_t> mTileAwake;
+    std::vector<std::uint8_t> mTileQuietSteps;
+    std::vector<std::uint8_t> mTileReport;
+    std::vector<std::uint32_t> mTileVersion;
+    std::vector<int> mActiveTiles;
+
+    // Rendering patches.
+    int mPatchSize = 64;
+    int mPatchVertexCount = 0;
+    std::vector<Patch> mPatches;
+
+    // Grid coordinates: x per column, z per row.
+    std::vector<float> mGridX;
+    std::vector<float> mGridZ;
+
+    std::vector<float> mPrevHeights;
+    std::vector<float> mCurrHeights;
+
+    VectorPlanes mNormals;
+
+    // The x-axis tangent always has a zero z component, so only x and y are stored.
+    VectorPlanes mTangentX;
+
+    NormalFormat mNormalFormat = NormalFormat::Float3;
+    std::vector<std::uint32_t> mPackedNormals;
 };
 
-#endif // WAVES_H
\ No newline at end of file
+#endif // WAVES_H
@@ -0,0 +1,411 @@
+//***************************************************************************************
+// WavesDomain.cpp
+//***************************************************************************************
+
+#include "WavesDomain.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Shared block layout, each part starting on its own cache line:
+//   Header
+//   SlabControl per slab
+//   edge rows: per slab, per step parity, the slab's first and last row
+//   impulses for the next batch of steps
+//   gather plane: the whole grid, row-major
+struct WavesDomain::Header
+{
+	std::atomic<std::uint32_t> Magic;
+	std::uint32_t Version;
+	std::int32_t Rows;
+	std::int32_t Cols;
+	std::int32_t SlabCount;
+	std::int32_t ImpulseCapacity;
+	float K1;
+	float K2;
+	float K3;
+
+	// Impulses in the impulse buffer, applied at the start of step ImpulseStep.
+	std::int32_t ImpulseCount;
+	std::uint64_t ImpulseStep;
+
+	// Number of steps the slabs are to have run.  Written by the coordinator, after
+	// the impulses for the batch.
+	std::atomic<std::uint64_t> Target;
+	std::atomic<std::uint32_t> Stop;
+};
+
+struct WavesDomain::SlabControl
+{
+	std::int32_t Row0;
+	std::int32_t Row1;
+
+	// Steps whose edge rows the slab has posted, and the last target it reached and
+	// gathered.
+	std::atomic<std::uint64_t> Posted;
+	std::atomic<std::uint64_t> Done;
+};
+
+namespace
+{
+	const std::uint32_t DomainMagic = 0x4e4d4f44; // "DOMN"
+	const std::uint32_t DomainVersion = 1;
+	const std::size_t CacheLine = 64;
+
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+		"the domain's atomics must be lock-free to work across processes");
+
+	std::size_t AlignUp(std::size_t bytes)
+	{
+		return (bytes + CacheLine - 1) & ~(CacheLine - 1);
+	}
+
+	struct Layout
+	{
+		std::size_t Slabs;
+		std::size_t Edges;
+		std::size_t Impulses;
+		std::size_t Gather;
+		std::size_t Size;
+	};
+
+	Layout GetLayout(std::size_t headerSize, std::size_t slabSize, std::size_t impulseSize,
+		int rows, int cols, int slabCount, int impulseCapacity)
+	{
+		Layout l;
+		l.Slabs = AlignUp(headerSize);
+		l.Edges = l.Slabs + (std::size_t)slabCount*AlignUp(slabSize);
+		l.Impulses = l.Edges + AlignUp((std::size_t)slabCount*4*cols*sizeof(float));
+		l.Gather = l.Impulses + AlignUp((std::size_t)impulseCapacity*impulseSize);
+		l.Size = l.Gather + (std::size_t)rows*cols*sizeof(float);
+		return l;
+	}
+
+	// Edge row side of a slab posted for a step of the given parity: side 0 is the
+	// slab's first row, side 1 its last.
+	float* EdgeRow(std::uint8_t* region, const Layout& l, int cols, int slab, std::uint64_t step, int side)
+	{
+		const std::size_t index = ((std::size_t)slab*2 + (step & 1))*2 + side;
+		return reinterpret_cast<float*>(region + l.Edges) + index*cols;
+	}
+
+	// Spins briefly, then yields, then naps until ready() holds.  Returns false if the
+	// domain is stopped first.
+	template<typename Ready>
+	bool WaitUntil(const std::atomic<std::uint32_t>& stop, Ready ready)
+	{
+		for(int spin = 0; !ready(); ++spin)
+		{
+			if(stop.load(std::memory_order_acquire) != 0)
+				return false;
+
+			if(spin < 64)
+				continue;
+			if(spin < 1024)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+		return true;
+	}
+}
+
+std::size_t WavesDomain::RegionSize(int rows, int cols, int slabCount)
+{
+	return GetLayout(sizeof(Header), sizeof(SlabControl), sizeof(Waves::Impulse),
+		rows, cols, slabCount, ImpulseCapacity).Size;
+}
+
+WavesDomain::WavesDomain(Waves* view, int slabCount, void* region, std::size_t regionSize)
+	: mView(view),
+	mRegion(static_cast<std::uint8_t*>(region)),
+	mImpulses(ImpulseCapacity)
+{
+	assert(!view->IsAsync() && !view->SparseTilesEnabled());
+	assert(view->GetIntegrator() == Waves::Integrator::Explicit);
+
+	const int rows = view->RowCount();
+	const int cols = view->ColumnCount();
+	const int interiorRows = rows - 2;
+	slabCount = std::min(std::max(slabCount, 1), std::max(interiorRows, 1));
+
+	const Layout l = GetLayout(sizeof(Header), sizeof(SlabControl), sizeof(Waves::Impulse),
+		rows, cols, slabCount, ImpulseCapacity);
+	assert(regionSize >= l.Size);
+	(void)regionSize;
+
+	mHeader = new(mRegion) Header();
+	mHeader->Version = DomainVersion;
+	mHeader->Rows = rows;
+	mHeader->Cols = cols;
+	mHeader->SlabCount = slabCount;
+	mHeader->ImpulseCapacity = ImpulseCapacity;
+	view->GetStepConstants(mHeader->K1, mHeader->K2, mHeader->K3);
+	mHeader->ImpulseCount = 0;
+	mHeader->ImpulseStep = 0;
+	mHeader->Target.store(0, std::memory_order_relaxed);
+	mHeader->Stop.store(0, std::memory_order_relaxed);
+
+	mSlabs = mRegion + l.Slabs;
+	for(int s = 0; s < slabCount; ++s)
+	{
+		SlabControl* slab = new(mSlabs + s*AlignUp(sizeof(SlabControl))) SlabControl();
+		slab->Row0 = 1 + (int)((std::int64_t)s*interiorRows / slabCount);
+		slab->Row1 = 1 + (int)((std::int64_t)(s + 1)*interiorRows / slabCount);
+		slab->Posted.store(0, std::memory_order_relaxed);
+		slab->Done.store(0, std::memory_order_relaxed);
+	}
+
+	mImpulseBuffer = reinterpret_cast<Waves::Impulse*>(mRegion + l.Impulses);
+
+	// The slabs pick up their starting rows (and the boundary) from the gather plane.
+	float* gather = reinterpret_cast<float*>(mRegion + l.Gather);
+	std::memcpy(gather, view->Heights(), (std::size_t)rows*cols*sizeof(float));
+	mGather = gather;
+
+	mView->LoadHeights(mGather);
+
+	// Slabs that attach early wait for the magic.
+	mHeader->Magic.store(DomainMagic, std::memory_order_release);
+}
+
+WavesDomain::~WavesDomain()
+{
+	Stop();
+}
+
+int WavesDomain::SlabCount()const
+{
+	return mHeader->SlabCount;
+}
+
+void WavesDomain::GetSlabRows(int slab, int& row0, int& row1)const
+{
+	row0 = GetSlab(slab)->Row0;
+	row1 = GetSlab(slab)->Row1;
+}
+
+WavesDomain::SlabControl* WavesDomain::GetSlab(int slab)const
+{
+	return reinterpret_cast<SlabControl*>(mSlabs + slab*AlignUp(sizeof(SlabControl)));
+}
+
+bool WavesDomain::Disturb(int i, int j, float magnitude)
+{
+	Waves::Impulse impulse;
+	impulse.Row = (float)i;
+	impulse.Col = (float)j;
+	impulse.Magnitude = magnitude;
+
+	return Disturb(impulse);
+}
+
+bool WavesDomain::Disturb(const Waves::Impulse& impulse)
+{
+	Waves::Impulse queued = impulse;
+	if(!Waves::PlaceImpulse(queued, mHeader->Rows, mHeader->Cols, mView->GetImpulseEdgePolicy()))
+		return false;
+
+	return mImpulses.TryPush(queued);
+}
+
+void WavesDomain::Update(float dt)
+{
+	// Same fixed-step accounting as Waves::Simulate.
+	const float timeStep = mView->GetTimeStep();
+	const int maxSubsteps = mView->GetMaxSubsteps();
+	mAccumulator += dt;
+
+	int steps = 0;
+	while(mAccumulator >= timeStep && steps < maxSubsteps)
+	{
+		mAccumulator -= timeStep;
+		++steps;
+	}
+
+	if(mAccumulator >= timeStep)
+		mAccumulator -= std::floor(mAccumulator / timeStep) * timeStep;
+
+	if(steps > 0)
+		Step(steps);
+}
+
+void WavesDomain::Step(std::uint64_t steps)
+{
+	if(steps == 0 || mHeader->Stop.load(std::memory_order_relaxed) != 0)
+		return;
+
+	// Hand the queued impulses to the first step of the batch.  The slabs are idle, so
+	// the buffer is free.
+	int count = 0;
+	Waves::Impulse impulse;
+	while(count < ImpulseCapacity && mImpulses.TryPop(impulse))
+		mImpulseBuffer[count++] = impulse;
+
+	mHeader->ImpulseCount = count;
+	mHeader->ImpulseStep = mStep;
+
+	const std::uint64_t target = mStep + steps;
+	mHeader->Target.store(target, std::memory_order_release);
+
+	// If the domain is stopped mid-batch the gather plane is only partly written, so the
+	// view keeps the last complete solution.
+	for(int s = 0; s < SlabCount(); ++s)
+	{
+		const SlabControl* control = GetSlab(s);
+		const bool done = WaitUntil(mHeader->Stop, [control, target]()
+		{
+			return control->Done.load(std::memory_order_acquire) >= target;
+		});
+		if(!done)
+			return;
+	}
+
+	mStep = target;
+	mView->LoadHeights(mGather);
+}
+
+void WavesDomain::Stop()
+{
+	mHeader->Stop.store(1, std::memory_order_release);
+}
+
+std::uint64_t WavesDomain::StepIndex()const
+{
+	return mStep;
+}
+
+WavesSlab::WavesSlab(void* region, std::size_t regionSize, int slab, ThreadPool* pool)
+	: mRegion(static_cast<std::uint8_t*>(region)),
+	mRegionSize(regionSize),
+	mSlab(slab),
+	mPool(pool != nullptr ? pool : &ThreadPool::Default()),
+	mKernels(&WavesKernels::Best())
+{
+}
+
+bool WavesSlab::Run()
+{
+	typedef WavesDomain::Header Header;
+	typedef WavesDomain::SlabControl SlabControl;
+
+	if(mRegion == nullptr || mRegionSize < sizeof(Header))
+		return false;
+
+	Header* header = reinterpret_cast<Header*>(mRegion);
+	while(header->Magic.load(std::memory_order_acquire) != DomainMagic)
+	{
+		if(header->Stop.load(std::memory_order_acquire) != 0)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if(header->Version != DomainVersion || mSlab < 0 || mSlab >= header->SlabCount)
+		return false;
+
+	const int cols = header->Cols;
+	const int slabCount = header->SlabCount;
+	const Layout l = GetLayout(sizeof(Header), sizeof(SlabControl), sizeof(Waves::Impulse),
+		header->Rows, cols, slabCount, header->ImpulseCapacity);
+	if(mRegionSize < l.Size)
+		return false;
+
+	const auto slabControl = [this, &l](int s)
+	{
+		return reinterpret_cast<SlabControl*>(mRegion + l.Slabs + s*AlignUp(sizeof(SlabControl)));
+	};
+
+	SlabControl* self = slabControl(mSlab);
+	const SlabControl* above = mSlab > 0 ? slabControl(mSlab - 1) : nullptr;
+	const SlabControl* below = mSlab + 1 < slabCount ? slabControl(mSlab + 1) : nullptr;
+
+	const int row0 = self->Row0;
+	const int row1 = self->Row1;
+	mRows = row1 - row0;
+	mCols = cols;
+	mK1 = header->K1;
+	mK2 = header->K2;
+	mK3 = header->K3;
+
+	// Start at rest from the gather plane, halo rows included: the outer slabs keep
+	// the grid boundary as their halo for good.
+	float* gather = reinterpret_cast<float*>(mRegion + l.Gather);
+	const std::size_t rowBytes = cols*sizeof(float);
+	mCurrHeights.assign(gather + (std::size_t)(row0 - 1)*cols, gather + (std::size_t)(row1 + 1)*cols);
+	mPrevHeights = mCurrHeights;
+
+	const Waves::Impulse* impulses = reinterpret_cast<const Waves::Impulse*>(mRegion + l.Impulses);
+
+	// Steps count from the domain's creation; the coordinator waits for every slab, so
+	// none can have been run without this one.
+	std::uint64_t step = 0;
+	for(;;)
+	{
+		std::uint64_t target = step;
+		const bool running = WaitUntil(header->Stop, [header, step, &target]()
+		{
+			target = header->Target.load(std::memory_order_acquire);
+			return target > step;
+		});
+		if(!running)
+			return true;
+
+		for(; step < target; ++step)
+		{
+			if(step == header->ImpulseStep)
+			{
+				for(int k = 0; k < header->ImpulseCount; ++k)
+					Waves::AddImpulse(impulses[k], header->Rows, cols, row0, row1, &mCurrHeights[cols]);
+			}
+
+			// Post this step's edge rows, then take the neighbors' into the halo.  Edge
+			// rows alternate between two buffers by step parity: a slab cannot get two
+			// steps ahead of a neighbor, since it waits for the neighbor's post each step.
+			std::memcpy(EdgeRow(mRegion, l, cols, mSlab, step, 0), &mCurrHeights[cols], rowBytes);
+			std::memcpy(EdgeRow(mRegion, l, cols, mSlab, step, 1), &mCurrHeights[(std::size_t)mRows*cols], rowBytes);
+			self->Posted.store(step + 1, std::memory_order_release);
+
+			if(above != nullptr)
+			{
+				if(!WaitUntil(header->Stop, [above, step]() { return above->Posted.load(std::memory_order_acquire) > step; }))
+					return true;
+				std::memcpy(&mCurrHeights[0], EdgeRow(mRegion, l, cols, mSlab - 1, step, 1), rowBytes);
+			}
+
+			if(below != nullptr)
+			{
+				if(!WaitUntil(header->Stop, [below, step]() { return below->Posted.load(std::memory_order_acquire) > step; }))
+					return true;
+				std::memcpy(&mCurrHeights[(std::size_t)(mRows + 1)*cols], EdgeRow(mRegion, l, cols, mSlab + 1, step, 0), rowBytes);
+			}
+
+			StepRows();
+		}
+
+		std::memcpy(gather + (std::size_t)row0*cols, &mCurrHeights[cols], (std::size_t)mRows*rowBytes);
+		self->Done.store(target, std::memory_order_release);
+	}
+}
+
+void WavesSlab::StepRows()
+{
+	// Waves::StepHeights over the slab's rows; the halo rows are only read.
+	const int grain = std::max(1, 16384 / mCols);
+	mPool->ParallelFor(1, mRows + 1, grain, [this](int i0, int i1)
+	{
+		for(int i = i0; i < i1; ++i)
+		{
+			const float* curr = &mCurrHeights[(std::size_t)i*mCols];
+			mKernels->UpdateRow(&mPrevHeights[(std::size_t)i*mCols], curr, curr - mCols, curr + mCols,
+				1, mCols - 1, mK1, mK2, mK3);
+		}
+	});
+
+	std::swap(mPrevHeights, mCurrHeights);
+}
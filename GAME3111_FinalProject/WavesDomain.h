@@ -0,0 +1,130 @@
+//***************************************************************************************
+// WavesDomain.h
+//
+// Domain decomposition of a Waves grid.  The interior rows are split into horizontal
+// slabs, and each slab is stepped by a WavesSlab, normally one per worker process.
+// Before every step a slab needs one row from each neighbor (its halo): each slab
+// posts its first and last row in the shared region, marks the step as posted and
+// waits for its neighbors to do the same.  After a batch of steps every slab copies
+// its rows into a gather plane, from which the coordinator (WavesDomain) hands the
+// solution to a Waves for rendering.
+//
+// Everything the processes share lives in one block of memory laid out by the
+// coordinator: a SharedMemory region when the slabs run in other processes, or any
+// ordinary allocation when they run on threads of the same process.  Synchronization
+// is by lock-free atomics in the block, so the same code serves both.
+//
+// The slabs run the same row kernel on the same inputs as Waves, and impulses are
+// placed with the same rules, so the gathered solution matches a single Waves stepping
+// the whole grid bit for bit.
+//***************************************************************************************
+
+#ifndef WAVESDOMAIN_H
+#define WAVESDOMAIN_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Waves.h"
+#include "../Common/MpscRing.h"
+
+class ThreadPool;
+
+class WavesDomain
+{
+public:
+	// Bytes of shared memory a domain over a rows x cols grid with slabCount slabs uses.
+	static std::size_t RegionSize(int rows, int cols, int slabCount);
+
+	// Splits view's interior rows into slabCount slabs of near-equal height (at most one
+	// per interior row) and lays the domain out in region, which must hold RegionSize
+	// bytes.  The domain simulates with view's constants and starts from its current
+	// heights, at rest.  view must be dense, synchronous and explicit; from here on it only
+	// shows the gathered solution.  Start the slabs once this returns.
+	WavesDomain(Waves* view, int slabCount, void* region, std::size_t regionSize);
+	WavesDomain(const WavesDomain& rhs) = delete;
+	WavesDomain& operator=(const WavesDomain& rhs) = delete;
+
+	// Stops the slabs.
+	~WavesDomain();
+
+	int SlabCount()const;
+
+	// Interior rows [row0, row1) owned by a slab.
+	void GetSlabRows(int slab, int& row0, int& row1)const;
+
+	// Queue impulses for the next step, like Waves::Disturb (view's edge policy applies).
+	// Any thread may call these.
+	bool Disturb(int i, int j, float magnitude);
+	bool Disturb(const Waves::Impulse& impulse);
+
+	// Accumulates dt and runs the steps due, like Waves::Update in synchronous mode,
+	// then loads the gathered solution into the view.  Waits for the slabs.
+	void Update(float dt);
+
+	// Runs steps steps with no time accumulation and loads the result into the view.
+	void Step(std::uint64_t steps);
+
+	// Tells the slabs to return from WavesSlab::Run.  The domain cannot step after this.
+	void Stop();
+
+	std::uint64_t StepIndex()const;
+
+private:
+	struct Header;
+	struct SlabControl;
+
+	SlabControl* GetSlab(int slab)const;
+
+private:
+	Waves* mView = nullptr;
+	std::uint8_t* mRegion = nullptr;
+	Header* mHeader = nullptr;
+	std::uint8_t* mSlabs = nullptr;
+	Waves::Impulse* mImpulseBuffer = nullptr;
+	const float* mGather = nullptr;
+
+	std::uint64_t mStep = 0;
+	float mAccumulator = 0.0f;
+
+	static const int ImpulseCapacity = 4096;
+	MpscRing<Waves::Impulse> mImpulses;
+
+	friend class WavesSlab;
+};
+
+class WavesSlab
+{
+public:
+	// region is the domain's block as mapped in this process.  The slab's rows are
+	// stepped across pool (ThreadPool::Default() if null).
+	WavesSlab(void* region, std::size_t regionSize, int slab, ThreadPool* pool = nullptr);
+	WavesSlab(const WavesSlab& rhs) = delete;
+	WavesSlab& operator=(const WavesSlab& rhs) = delete;
+
+	// Steps the slab as the coordinator asks until the domain is stopped.  Returns false
+	// right away if the region does not hold a domain with this slab in it.
+	bool Run();
+
+private:
+	void StepRows();
+
+private:
+	std::uint8_t* mRegion = nullptr;
+	std::size_t mRegionSize = 0;
+	int mSlab = 0;
+	ThreadPool* mPool = nullptr;
+
+	int mRows = 0;
+	int mCols = 0;
+
+	// The slab's rows plus a halo row above and below; row 0 is grid row Row0 - 1.
+	std::vector<float> mPrevHeights;
+	std::vector<float> mCurrHeights;
+
+	float mK1 = 0.0f;
+	float mK2 = 0.0f;
+	float mK3 = 0.0f;
+	const WavesKernels* mKernels = nullptr;
+};
+
+#endif // WAVESDOMAIN_H
@@ -0,0 +1,141 @@
+//***************************************************************************************
+// WavesImplicit.cpp
+//
+// The implicit (ADI) integrator of Waves: its constants and its step.  See
+// Waves::Integrator.
+//***************************************************************************************
+
+#include "Waves.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+
+void Waves::BuildImplicitConstants(float dt, float e)
+{
+	// With a = 1 + mu*dt/2, b = 1 - mu*dt/2 and s = c^2*dt^2/dx^2,
+	//   a*u+ - 2*u + b*u- = s*L(u+/4 + u/2 + u-/4).
+	// In terms of the correction d = u+ - u this is
+	//   (I - beta*L) d = (b*(u - u-) + s/4*(3*L(u) + L(u-))) / a,   beta = s/(4a),
+	// and I - beta*L is replaced by (I - beta*Lx)(I - beta*Lz): one tridiagonal system
+	// per row and one per column.  The extra beta^2*Lx*Lz term only adds damping of
+	// order dt^4 and keeps the scheme stable.
+	const float a = 1.0f + 0.5f*mDamping*dt;
+	mImplicitB = 1.0f - 0.5f*mDamping*dt;
+	mImplicitQ = 0.25f*e;
+	mImplicitInvA = 1.0f / a;
+	mImplicitBeta = 0.25f*e / a;
+
+	// Thomas factors of the constant tridiagonal system (-beta, 1 + 2*beta, -beta) with
+	// zero boundary values: the forward sweep scales by Inv, the back substitution adds
+	// Gain times the next value.
+	const auto buildSweep = [this](int count, std::vector<float>& inv, std::vector<float>& gain)
+	{
+		inv.assign(count, 0.0f);
+		gain.assign(count, 0.0f);
+
+		float g = 0.0f;
+		for(int k = 1; k < count - 1; ++k)
+		{
+			inv[k] = 1.0f / (1.0f + 2.0f*mImplicitBeta - mImplicitBeta*g);
+			g = mImplicitBeta*inv[k];
+			gain[k] = g;
+		}
+	};
+	buildSweep(mNumCols, mSweepInvX, mSweepGainX);
+	buildSweep(mNumRows, mSweepInvZ, mSweepGainZ);
+}
+
+void Waves::StepImplicit()
+{
+	const int m = mNumRows;
+	const int n = mNumCols;
+	if(m < 3 || n < 3)
+		return;
+
+	if(mImplicitRhs.size() != (std::size_t)m*n)
+	{
+		// The boundary of the right-hand side is never written and stays zero, which is
+		// the boundary condition of both sweeps.
+		const int bandCount = (m - 2 + ImplicitBand - 1) / ImplicitBand;
+		mImplicitRhs.assign((std::size_t)m*n, 0.0f);
+		mImplicitBands.assign((std::size_t)bandCount*ImplicitBand*n, 0.0f);
+	}
+
+	float* const r = mImplicitRhs.data();
+	const float beta = mImplicitBeta;
+
+	mPool->ParallelFor(1, m - 1, mRowGrain, [this, r, n](int i0, int i1)
+	{
+		for(int i = i0; i < i1; ++i)
+		{
+			const float* c = &mCurrHeights[i*n];
+			const float* p = &mPrevHeights[i*n];
+			mKernels->ImplicitRhsRow(c, c - n, c + n, p, p - n, p + n, 1, n - 1,
+				mImplicitB, mImplicitQ, mImplicitInvA, r + i*n);
+		}
+	});
+
+	// Along x.  Each band of rows is transposed so that one sweep step handles the
+	// same column of every row in the band as a single vector; the transpose goes in
+	// blocks of columns so both sides stay in cache.  Unused lanes of the last band
+	// stay zero.
+	const int bandCount = (m - 2 + ImplicitBand - 1) / ImplicitBand;
+	mPool->ParallelFor(0, bandCount, 1, [this, r, m, n, beta](int b0, int b1)
+	{
+		const int B = ImplicitBand;
+		const int ColumnBlock = 16;
+
+		for(int band = b0; band < b1; ++band)
+		{
+			const int first = 1 + band*B;
+			const int rows = std::min(B, m - 1 - first);
+			float* t = &mImplicitBands[(std::size_t)band*B*n];
+
+			for(int jb = 0; jb < n; jb += ColumnBlock)
+			{
+				const int je = std::min(jb + ColumnBlock, n);
+				for(int k = 0; k < rows; ++k)
+				{
+					const float* src = r + (first + k)*n;
+					for(int j = jb; j < je; ++j)
+						t[j*B + k] = src[j];
+				}
+			}
+
+			for(int j = 1; j < n - 1; ++j)
+				mKernels->SweepRow(t + j*B, t + (j - 1)*B, 0, B, beta, mSweepInvX[j]);
+			for(int j = n - 2; j >= 1; --j)
+				mKernels->SweepRow(t + j*B, t + (j + 1)*B, 0, B, mSweepGainX[j], 1.0f);
+
+			for(int jb = 0; jb < n; jb += ColumnBlock)
+			{
+				const int je = std::min(jb + ColumnBlock, n);
+				for(int k = 0; k < rows; ++k)
+				{
+					float* dst = r + (first + k)*n;
+					for(int j = jb; j < je; ++j)
+						dst[j] = t[j*B + k];
+				}
+			}
+		}
+	});
+
+	// Along z the systems already lie side by side in memory: sweep whole rows, split
+	// into column blocks across the pool, then add the correction to the current
+	// solution.
+	const int grain = std::max(64, (n - 2) / (4 * (int)mPool->Concurrency()));
+	mPool->ParallelFor(1, n - 1, grain, [this, r, m, n, beta](int j0, int j1)
+	{
+		for(int i = 1; i < m - 1; ++i)
+			mKernels->SweepRow(r + i*n, r + (i - 1)*n, j0, j1, beta, mSweepInvZ[i]);
+		for(int i = m - 2; i >= 1; --i)
+			mKernels->SweepRow(r + i*n, r + (i + 1)*n, j0, j1, mSweepGainZ[i], 1.0f);
+		for(int i = 1; i < m - 1; ++i)
+			mKernels->SweepRow(r + i*n, &mCurrHeights[i*n], j0, j1, 1.0f, 1.0f);
+	});
+
+	// r now holds the new solution with a zero boundary: it becomes the current one,
+	// the current one the previous, and the old previous the next right-hand side.
+	// Its boundary is zero like every height boundary.
+	std::swap(mPrevHeights, mCurrHeights);
+	std::swap(mCurrHeights, mImplicitRhs);
+}
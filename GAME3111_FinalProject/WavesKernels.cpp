@@ -0,0 +1,991 @@
+//***************************************************************************************
+// WavesKernels.cpp
+//***************************************************************************************
+
+#include "WavesKernels.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// The vector kernels must round exactly like the scalar reference, so keep the
+// compiler from contracting a*b + c into fused multiply-adds.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WAVES_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define WAVES_KERNELS_X86 0
+#endif
+
+// MSVC lets any function use any intrinsic; GCC and Clang need the target enabled
+// per function so the rest of the program still runs on older CPUs.
+#if WAVES_KERNELS_X86 && (defined(__GNUC__) || defined(__clang__))
+#define WAVES_TARGET_AVX2   __attribute__((target("avx2")))
+#define WAVES_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define WAVES_TARGET_AVX2
+#define WAVES_TARGET_AVX512
+#endif
+
+namespace
+{
+	//
+	// Scalar reference.
+	//
+
+	void UpdateRowScalar(float* prev, const float* curr, const float* up, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		for(int j = j0; j < j1; ++j)
+		{
+			prev[j] =
+				k1*prev[j] +
+				k2*curr[j] +
+				k3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
+		}
+	}
+
+	void ImplicitRhsRowScalar(const float* curr, const float* currUp, const float* currDown,
+		const float* prev, const float* prevUp, const float* prevDown,
+		int j0, int j1, float b, float q, float invA, float* r)
+	{
+		for(int j = j0; j < j1; ++j)
+		{
+			const float lc = (currDown[j] + currUp[j] + curr[j+1] + curr[j-1]) - 4.0f*curr[j];
+			const float lp = (prevDown[j] + prevUp[j] + prev[j+1] + prev[j-1]) - 4.0f*prev[j];
+			r[j] = (b*(curr[j] - prev[j]) + q*(3.0f*lc + lp))*invA;
+		}
+	}
+
+	void SweepRowScalar(float* x, const float* y, int j0, int j1, float a, float scale)
+	{
+		for(int j = j0; j < j1; ++j)
+			x[j] = (x[j] + a*y[j])*scale;
+	}
+
+	void NormalRowScalar(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const float twoDxSq = twoDx*twoDx;
+
+		for(int j = j0; j < j1; ++j)
+		{
+			float l = h[j-1];
+			float r = h[j+1];
+			float t = up[j];
+			float b = down[j];
+
+			float x = l - r;
+			float z = b - t;
+			float invLen = 1.0f / std::sqrt(x*x + twoDxSq + z*z);
+			nx[j] = x*invLen;
+			ny[j] = twoDx*invLen;
+			nz[j] = z*invLen;
+
+			float y = r - l;
+			invLen = 1.0f / std::sqrt(twoDxSq + y*y);
+			tx[j] = twoDx*invLen;
+			ty[j] = y*invLen;
+		}
+	}
+
+	// Rounds a component in [-1, 1] to its 16-bit SNORM encoding (see PackSnorm8).
+	inline std::uint32_t PackSnorm16(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f)*32767.0f + 32768.5f;
+		return ((std::uint32_t)(std::int32_t)v - 32768) & 0xffff;
+	}
+
+	// The normal (x, twoDx, z) is projected onto the octahedron |x|+|y|+|z| = 1 and
+	// its x/z coordinates stored; the length cancels, so no square root is needed.
+	void NormalRowOctScalar(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		std::uint32_t* n, float* tx, float* ty)
+	{
+		const float twoDxSq = twoDx*twoDx;
+
+		for(int j = j0; j < j1; ++j)
+		{
+			float l = h[j-1];
+			float r = h[j+1];
+			float t = up[j];
+			float b = down[j];
+
+			float x = l - r;
+			float z = b - t;
+			float invL1 = 1.0f / (std::fabs(x) + twoDx + std::fabs(z));
+			n[j] = PackSnorm16(x*invL1) | PackSnorm16(z*invL1) << 16;
+
+			float y = r - l;
+			float invLen = 1.0f / std::sqrt(twoDxSq + y*y);
+			tx[j] = twoDx*invLen;
+			ty[j] = y*invLen;
+		}
+	}
+
+	// Rounds a component in [-1, 1] to its 8-bit SNORM encoding.  Biasing into the
+	// positive range lets truncation do the rounding without a branch.
+	inline std::uint32_t PackSnorm8(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f)*127.0f + 128.5f;
+		return ((std::uint32_t)(std::int32_t)v - 128) & 0xff;
+	}
+
+	void PackRowScalar(const float* h, const float* nx, const float* ny, const float* nz,
+		int j0, int j1, std::uint32_t* out)
+	{
+		for(int j = j0; j < j1; ++j)
+		{
+			std::uint32_t height;
+			std::memcpy(&height, &h[j], sizeof(height));
+
+			out[0] = height;
+			out[1] = PackSnorm8(nx[j]) | PackSnorm8(ny[j]) << 8 | PackSnorm8(nz[j]) << 16;
+			out += 2;
+		}
+	}
+
+	// Clamps the way _mm_max_ps/_mm_min_ps do, NaN included (it ends up at lo).
+	inline float ClampSample(float v, float lo, float hi)
+	{
+		v = v > lo ? v : lo;
+		return v < hi ? v : hi;
+	}
+
+	void SampleScalar(const float* h, int rows, int cols, float originX, float originZ, float invDx,
+		const float* xz, int count, float* heights, float* nx, float* ny, float* nz)
+	{
+		const float maxJ = (float)(cols - 1);
+		const float maxI = (float)(rows - 1);
+		const float lastJ0 = (float)(cols - 2);
+		const float lastI0 = (float)(rows - 2);
+		const float negInvDx = -invDx;
+
+		for(int k = 0; k < count; ++k)
+		{
+			const float j = ClampSample((xz[2*k] - originX)*invDx, 0.0f, maxJ);
+			const float i = ClampSample((originZ - xz[2*k+1])*invDx, 0.0f, maxI);
+
+			// The last row/column of points starts no cell; the point on it is reached
+			// from the cell before with a weight of 1.
+			const float j0 = std::min((float)(int)j, lastJ0);
+			const float i0 = std::min((float)(int)i, lastI0);
+			const float tj = j - j0;
+			const float ti = i - i0;
+
+			const float* p = h + (int)(i0*(float)cols + j0);
+			const float h00 = p[0];
+			const float h01 = p[1];
+			const float h10 = p[cols];
+			const float h11 = p[cols + 1];
+
+			const float dTop = h01 - h00;
+			const float dBottom = h11 - h10;
+			const float top = h00 + dTop*tj;
+			const float bottom = h10 + dBottom*tj;
+
+			if(heights != nullptr)
+				heights[k] = top + (bottom - top)*ti;
+
+			if(nx != nullptr)
+			{
+				// Gradient of the bilinear patch; rows run towards -z.
+				const float gx = (dTop + (dBottom - dTop)*ti)*negInvDx;
+				const float gz = (bottom - top)*invDx;
+				const float invLen = 1.0f / std::sqrt(gx*gx + 1.0f + gz*gz);
+				nx[k] = gx*invLen;
+				ny[k] = invLen;
+				nz[k] = gz*invLen;
+			}
+		}
+	}
+
+#if WAVES_KERNELS_X86
+
+	//
+	// SSE2, 4 columns per iteration.
+	//
+
+	void UpdateRowSSE2(float* prev, const float* curr, const float* up, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		const __m128 vk1 = _mm_set1_ps(k1);
+		const __m128 vk2 = _mm_set1_ps(k2);
+		const __m128 vk3 = _mm_set1_ps(k3);
+
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j + 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j - 1));
+
+			__m128 v = _mm_add_ps(
+				_mm_mul_ps(vk1, _mm_loadu_ps(prev + j)),
+				_mm_mul_ps(vk2, _mm_loadu_ps(curr + j)));
+			v = _mm_add_ps(v, _mm_mul_ps(vk3, sum));
+
+			_mm_storeu_ps(prev + j, v);
+		}
+
+		UpdateRowScalar(prev, curr, up, down, j, j1, k1, k2, k3);
+	}
+
+	void ImplicitRhsRowSSE2(const float* curr, const float* currUp, const float* currDown,
+		const float* prev, const float* prevUp, const float* prevDown,
+		int j0, int j1, float b, float q, float invA, float* r)
+	{
+		const __m128 vb = _mm_set1_ps(b);
+		const __m128 vq = _mm_set1_ps(q);
+		const __m128 vinvA = _mm_set1_ps(invA);
+		const __m128 four = _mm_set1_ps(4.0f);
+		const __m128 three = _mm_set1_ps(3.0f);
+
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			const __m128 c = _mm_loadu_ps(curr + j);
+			__m128 lc = _mm_add_ps(_mm_loadu_ps(currDown + j), _mm_loadu_ps(currUp + j));
+			lc = _mm_add_ps(lc, _mm_loadu_ps(curr + j + 1));
+			lc = _mm_add_ps(lc, _mm_loadu_ps(curr + j - 1));
+			lc = _mm_sub_ps(lc, _mm_mul_ps(four, c));
+
+			const __m128 p = _mm_loadu_ps(prev + j);
+			__m128 lp = _mm_add_ps(_mm_loadu_ps(prevDown + j), _mm_loadu_ps(prevUp + j));
+			lp = _mm_add_ps(lp, _mm_loadu_ps(prev + j + 1));
+			lp = _mm_add_ps(lp, _mm_loadu_ps(prev + j - 1));
+			lp = _mm_sub_ps(lp, _mm_mul_ps(four, p));
+
+			__m128 v = _mm_mul_ps(vb, _mm_sub_ps(c, p));
+			v = _mm_add_ps(v, _mm_mul_ps(vq, _mm_add_ps(_mm_mul_ps(three, lc), lp)));
+			_mm_storeu_ps(r + j, _mm_mul_ps(v, vinvA));
+		}
+
+		ImplicitRhsRowScalar(curr, currUp, currDown, prev, prevUp, prevDown, j, j1, b, q, invA, r);
+	}
+
+	void SweepRowSSE2(float* x, const float* y, int j0, int j1, float a, float scale)
+	{
+		const __m128 va = _mm_set1_ps(a);
+		const __m128 vscale = _mm_set1_ps(scale);
+
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			const __m128 v = _mm_add_ps(_mm_loadu_ps(x + j), _mm_mul_ps(va, _mm_loadu_ps(y + j)));
+			_mm_storeu_ps(x + j, _mm_mul_ps(v, vscale));
+		}
+
+		SweepRowScalar(x, y, j, j1, a, scale);
+	}
+
+	void NormalRowSSE2(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const __m128 vTwoDx = _mm_set1_ps(twoDx);
+		const __m128 vTwoDxSq = _mm_set1_ps(twoDx*twoDx);
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128 l = _mm_loadu_ps(h + j - 1);
+			__m128 r = _mm_loadu_ps(h + j + 1);
+			__m128 t = _mm_loadu_ps(up + j);
+			__m128 b = _mm_loadu_ps(down + j);
+
+			__m128 x = _mm_sub_ps(l, r);
+			__m128 z = _mm_sub_ps(b, t);
+			__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), vTwoDxSq), _mm_mul_ps(z, z));
+			__m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(lenSq));
+			_mm_storeu_ps(nx + j, _mm_mul_ps(x, invLen));
+			_mm_storeu_ps(ny + j, _mm_mul_ps(vTwoDx, invLen));
+			_mm_storeu_ps(nz + j, _mm_mul_ps(z, invLen));
+
+			__m128 y = _mm_sub_ps(r, l);
+			invLen = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(vTwoDxSq, _mm_mul_ps(y, y))));
+			_mm_storeu_ps(tx + j, _mm_mul_ps(vTwoDx, invLen));
+			_mm_storeu_ps(ty + j, _mm_mul_ps(y, invLen));
+		}
+
+		NormalRowScalar(h, up, down, j, j1, twoDx, nx, ny, nz, tx, ty);
+	}
+
+	inline __m128i PackSnorm16SSE2(__m128 v)
+	{
+		v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+		v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(32767.0f)), _mm_set1_ps(32768.5f));
+		__m128i c = _mm_sub_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(32768));
+		return _mm_and_si128(c, _mm_set1_epi32(0xffff));
+	}
+
+	void NormalRowOctSSE2(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		std::uint32_t* n, float* tx, float* ty)
+	{
+		const __m128 vTwoDx = _mm_set1_ps(twoDx);
+		const __m128 vTwoDxSq = _mm_set1_ps(twoDx*twoDx);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128 l = _mm_loadu_ps(h + j - 1);
+			__m128 r = _mm_loadu_ps(h + j + 1);
+			__m128 t = _mm_loadu_ps(up + j);
+			__m128 b = _mm_loadu_ps(down + j);
+
+			__m128 x = _mm_sub_ps(l, r);
+			__m128 z = _mm_sub_ps(b, t);
+			__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, absMask), vTwoDx), _mm_and_ps(z, absMask));
+			__m128 invL1 = _mm_div_ps(one, l1);
+			__m128i packed = _mm_or_si128(PackSnorm16SSE2(_mm_mul_ps(x, invL1)),
+				_mm_slli_epi32(PackSnorm16SSE2(_mm_mul_ps(z, invL1)), 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(n + j), packed);
+
+			__m128 y = _mm_sub_ps(r, l);
+			__m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(vTwoDxSq, _mm_mul_ps(y, y))));
+			_mm_storeu_ps(tx + j, _mm_mul_ps(vTwoDx, invLen));
+			_mm_storeu_ps(ty + j, _mm_mul_ps(y, invLen));
+		}
+
+		NormalRowOctScalar(h, up, down, j, j1, twoDx, n, tx, ty);
+	}
+
+	inline __m128i PackSnorm8SSE2(__m128 v)
+	{
+		v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+		v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(127.0f)), _mm_set1_ps(128.5f));
+		__m128i c = _mm_sub_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(128));
+		return _mm_and_si128(c, _mm_set1_epi32(0xff));
+	}
+
+	// Packing is bound by the stores, so SSE2 serves the wider levels too.
+	void PackRowSSE2(const float* h, const float* nx, const float* ny, const float* nz,
+		int j0, int j1, std::uint32_t* out)
+	{
+		int j = j0;
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128i n = PackSnorm8SSE2(_mm_loadu_ps(nx + j));
+			n = _mm_or_si128(n, _mm_slli_epi32(PackSnorm8SSE2(_mm_loadu_ps(ny + j)), 8));
+			n = _mm_or_si128(n, _mm_slli_epi32(PackSnorm8SSE2(_mm_loadu_ps(nz + j)), 16));
+
+			__m128i height = _mm_castps_si128(_mm_loadu_ps(h + j));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi32(height, n));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi32(height, n));
+			out += 8;
+		}
+
+		PackRowScalar(h, nx, ny, nz, j, j1, out);
+	}
+
+	// Four samples at a time.  SSE2 has no gathers, so the corners are loaded one by one.
+	void SampleSSE2(const float* h, int rows, int cols, float originX, float originZ, float invDx,
+		const float* xz, int count, float* heights, float* nx, float* ny, float* nz)
+	{
+		const __m128 vOriginX = _mm_set1_ps(originX);
+		const __m128 vOriginZ = _mm_set1_ps(originZ);
+		const __m128 vInvDx = _mm_set1_ps(invDx);
+		const __m128 vNegInvDx = _mm_set1_ps(-invDx);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 maxJ = _mm_set1_ps((float)(cols - 1));
+		const __m128 maxI = _mm_set1_ps((float)(rows - 1));
+		const __m128 lastJ0 = _mm_set1_ps((float)(cols - 2));
+		const __m128 lastI0 = _mm_set1_ps((float)(rows - 2));
+		const __m128 vCols = _mm_set1_ps((float)cols);
+
+		int k = 0;
+		for(; k + 4 <= count; k += 4)
+		{
+			__m128 a = _mm_loadu_ps(xz + 2*k);
+			__m128 b = _mm_loadu_ps(xz + 2*k + 4);
+			__m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 z = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+			__m128 j = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(x, vOriginX), vInvDx), zero), maxJ);
+			__m128 i = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(vOriginZ, z), vInvDx), zero), maxI);
+			__m128 j0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(j)), lastJ0);
+			__m128 i0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(i)), lastI0);
+			__m128 tj = _mm_sub_ps(j, j0);
+			__m128 ti = _mm_sub_ps(i, i0);
+
+			alignas(16) std::int32_t idx[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(idx),
+				_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(i0, vCols), j0)));
+
+			const float* p0 = h + idx[0];
+			const float* p1 = h + idx[1];
+			const float* p2 = h + idx[2];
+			const float* p3 = h + idx[3];
+			__m128 h00 = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+			__m128 h01 = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+			__m128 h10 = _mm_setr_ps(p0[cols], p1[cols], p2[cols], p3[cols]);
+			__m128 h11 = _mm_setr_ps(p0[cols + 1], p1[cols + 1], p2[cols + 1], p3[cols + 1]);
+
+			__m128 dTop = _mm_sub_ps(h01, h00);
+			__m128 dBottom = _mm_sub_ps(h11, h10);
+			__m128 top = _mm_add_ps(h00, _mm_mul_ps(dTop, tj));
+			__m128 bottom = _mm_add_ps(h10, _mm_mul_ps(dBottom, tj));
+
+			if(heights != nullptr)
+				_mm_storeu_ps(heights + k, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ti)));
+
+			if(nx != nullptr)
+			{
+				__m128 gx = _mm_mul_ps(_mm_add_ps(dTop, _mm_mul_ps(_mm_sub_ps(dBottom, dTop), ti)), vNegInvDx);
+				__m128 gz = _mm_mul_ps(_mm_sub_ps(bottom, top), vInvDx);
+				__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), one), _mm_mul_ps(gz, gz));
+				__m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(len2));
+				_mm_storeu_ps(nx + k, _mm_mul_ps(gx, invLen));
+				_mm_storeu_ps(ny + k, invLen);
+				_mm_storeu_ps(nz + k, _mm_mul_ps(gz, invLen));
+			}
+		}
+
+		SampleScalar(h, rows, cols, originX, originZ, invDx, xz + 2*k, count - k,
+			heights != nullptr ? heights + k : nullptr,
+			nx != nullptr ? nx + k : nullptr, ny != nullptr ? ny + k : nullptr, nz != nullptr ? nz + k : nullptr);
+	}
+
+	//
+	// AVX2, 8 columns per iteration.
+	//
+
+	WAVES_TARGET_AVX2
+	void UpdateRowAVX2(float* prev, const float* curr, const float* up, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+
+		int j = j0;
+		for(; j + 8 <= j1; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j + 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j - 1));
+
+			__m256 v = _mm256_add_ps(
+				_mm256_mul_ps(vk1, _mm256_loadu_ps(prev + j)),
+				_mm256_mul_ps(vk2, _mm256_loadu_ps(curr + j)));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vk3, sum));
+
+			_mm256_storeu_ps(prev + j, v);
+		}
+
+		UpdateRowScalar(prev, curr, up, down, j, j1, k1, k2, k3);
+	}
+
+	WAVES_TARGET_AVX2
+	void ImplicitRhsRowAVX2(const float* curr, const float* currUp, const float* currDown,
+		const float* prev, const float* prevUp, const float* prevDown,
+		int j0, int j1, float b, float q, float invA, float* r)
+	{
+		const __m256 vb = _mm256_set1_ps(b);
+		const __m256 vq = _mm256_set1_ps(q);
+		const __m256 vinvA = _mm256_set1_ps(invA);
+		const __m256 four = _mm256_set1_ps(4.0f);
+		const __m256 three = _mm256_set1_ps(3.0f);
+
+		int j = j0;
+		for(; j + 8 <= j1; j += 8)
+		{
+			const __m256 c = _mm256_loadu_ps(curr + j);
+			__m256 lc = _mm256_add_ps(_mm256_loadu_ps(currDown + j), _mm256_loadu_ps(currUp + j));
+			lc = _mm256_add_ps(lc, _mm256_loadu_ps(curr + j + 1));
+			lc = _mm256_add_ps(lc, _mm256_loadu_ps(curr + j - 1));
+			lc = _mm256_sub_ps(lc, _mm256_mul_ps(four, c));
+
+			const __m256 p = _mm256_loadu_ps(prev + j);
+			__m256 lp = _mm256_add_ps(_mm256_loadu_ps(prevDown + j), _mm256_loadu_ps(prevUp + j));
+			lp = _mm256_add_ps(lp, _mm256_loadu_ps(prev + j + 1));
+			lp = _mm256_add_ps(lp, _mm256_loadu_ps(prev + j - 1));
+			lp = _mm256_sub_ps(lp, _mm256_mul_ps(four, p));
+
+			__m256 v = _mm256_mul_ps(vb, _mm256_sub_ps(c, p));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vq, _mm256_add_ps(_mm256_mul_ps(three, lc), lp)));
+			_mm256_storeu_ps(r + j, _mm256_mul_ps(v, vinvA));
+		}
+
+		ImplicitRhsRowScalar(curr, currUp, currDown, prev, prevUp, prevDown, j, j1, b, q, invA, r);
+	}
+
+	WAVES_TARGET_AVX2
+	void SweepRowAVX2(float* x, const float* y, int j0, int j1, float a, float scale)
+	{
+		const __m256 va = _mm256_set1_ps(a);
+		const __m256 vscale = _mm256_set1_ps(scale);
+
+		int j = j0;
+		for(; j + 8 <= j1; j += 8)
+		{
+			const __m256 v = _mm256_add_ps(_mm256_loadu_ps(x + j), _mm256_mul_ps(va, _mm256_loadu_ps(y + j)));
+			_mm256_storeu_ps(x + j, _mm256_mul_ps(v, vscale));
+		}
+
+		SweepRowScalar(x, y, j, j1, a, scale);
+	}
+
+	WAVES_TARGET_AVX2
+	void NormalRowAVX2(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const __m256 vTwoDx = _mm256_set1_ps(twoDx);
+		const __m256 vTwoDxSq = _mm256_set1_ps(twoDx*twoDx);
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		int j = j0;
+		for(; j + 8 <= j1; j += 8)
+		{
+			__m256 l = _mm256_loadu_ps(h + j - 1);
+			__m256 r = _mm256_loadu_ps(h + j + 1);
+			__m256 t = _mm256_loadu_ps(up + j);
+			__m256 b = _mm256_loadu_ps(down + j);
+
+			__m256 x = _mm256_sub_ps(l, r);
+			__m256 z = _mm256_sub_ps(b, t);
+			__m256 lenSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), vTwoDxSq), _mm256_mul_ps(z, z));
+			__m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(lenSq));
+			_mm256_storeu_ps(nx + j, _mm256_mul_ps(x, invLen));
+			_mm256_storeu_ps(ny + j, _mm256_mul_ps(vTwoDx, invLen));
+			_mm256_storeu_ps(nz + j, _mm256_mul_ps(z, invLen));
+
+			__m256 y = _mm256_sub_ps(r, l);
+			invLen = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(vTwoDxSq, _mm256_mul_ps(y, y))));
+			_mm256_storeu_ps(tx + j, _mm256_mul_ps(vTwoDx, invLen));
+			_mm256_storeu_ps(ty + j, _mm256_mul_ps(y, invLen));
+		}
+
+		NormalRowScalar(h, up, down, j, j1, twoDx, nx, ny, nz, tx, ty);
+	}
+
+	WAVES_TARGET_AVX2
+	inline __m256i PackSnorm16AVX2(__m256 v)
+	{
+		v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+		v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(32767.0f)), _mm256_set1_ps(32768.5f));
+		__m256i c = _mm256_sub_epi32(_mm256_cvttps_epi32(v), _mm256_set1_epi32(32768));
+		return _mm256_and_si256(c, _mm256_set1_epi32(0xffff));
+	}
+
+	WAVES_TARGET_AVX2
+	void NormalRowOctAVX2(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		std::uint32_t* n, float* tx, float* ty)
+	{
+		const __m256 vTwoDx = _mm256_set1_ps(twoDx);
+		const __m256 vTwoDxSq = _mm256_set1_ps(twoDx*twoDx);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+		int j = j0;
+		for(; j + 8 <= j1; j += 8)
+		{
+			__m256 l = _mm256_loadu_ps(h + j - 1);
+			__m256 r = _mm256_loadu_ps(h + j + 1);
+			__m256 t = _mm256_loadu_ps(up + j);
+			__m256 b = _mm256_loadu_ps(down + j);
+
+			__m256 x = _mm256_sub_ps(l, r);
+			__m256 z = _mm256_sub_ps(b, t);
+			__m256 l1 = _mm256_add_ps(_mm256_add_ps(_mm256_and_ps(x, absMask), vTwoDx), _mm256_and_ps(z, absMask));
+			__m256 invL1 = _mm256_div_ps(one, l1);
+			__m256i packed = _mm256_or_si256(PackSnorm16AVX2(_mm256_mul_ps(x, invL1)),
+				_mm256_slli_epi32(PackSnorm16AVX2(_mm256_mul_ps(z, invL1)), 16));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(n + j), packed);
+
+			__m256 y = _mm256_sub_ps(r, l);
+			__m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(vTwoDxSq, _mm256_mul_ps(y, y))));
+			_mm256_storeu_ps(tx + j, _mm256_mul_ps(vTwoDx, invLen));
+			_mm256_storeu_ps(ty + j, _mm256_mul_ps(y, invLen));
+		}
+
+		NormalRowOctScalar(h, up, down, j, j1, twoDx, n, tx, ty);
+	}
+
+	// Eight samples at a time, with the corners gathered.  Also used for AVX-512: the
+	// gathers dominate and do not get faster at 16 lanes.
+	WAVES_TARGET_AVX2
+	void SampleAVX2(const float* h, int rows, int cols, float originX, float originZ, float invDx,
+		const float* xz, int count, float* heights, float* nx, float* ny, float* nz)
+	{
+		const __m256 vOriginX = _mm256_set1_ps(originX);
+		const __m256 vOriginZ = _mm256_set1_ps(originZ);
+		const __m256 vInvDx = _mm256_set1_ps(invDx);
+		const __m256 vNegInvDx = _mm256_set1_ps(-invDx);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 maxJ = _mm256_set1_ps((float)(cols - 1));
+		const __m256 maxI = _mm256_set1_ps((float)(rows - 1));
+		const __m256 lastJ0 = _mm256_set1_ps((float)(cols - 2));
+		const __m256 lastI0 = _mm256_set1_ps((float)(rows - 2));
+		const __m256 vCols = _mm256_set1_ps((float)cols);
+
+		int k = 0;
+		for(; k + 8 <= count; k += 8)
+		{
+			// (x0 z0 x1 z1 x2 z2 x3 z3), (x4 z4 ...) --> x0..x7, z0..z7.  The in-lane
+			// shuffle leaves the pairs of lanes swapped in the middle.
+			__m256 a = _mm256_loadu_ps(xz + 2*k);
+			__m256 b = _mm256_loadu_ps(xz + 2*k + 8);
+			__m256 x = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 z = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			x = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x), _MM_SHUFFLE(3, 1, 2, 0)));
+			z = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(z), _MM_SHUFFLE(3, 1, 2, 0)));
+
+			__m256 j = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(x, vOriginX), vInvDx), zero), maxJ);
+			__m256 i = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(vOriginZ, z), vInvDx), zero), maxI);
+			__m256 j0 = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(j)), lastJ0);
+			__m256 i0 = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(i)), lastI0);
+			__m256 tj = _mm256_sub_ps(j, j0);
+			__m256 ti = _mm256_sub_ps(i, i0);
+
+			__m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(i0, vCols), j0));
+			__m256 h00 = _mm256_i32gather_ps(h, idx, 4);
+			__m256 h01 = _mm256_i32gather_ps(h + 1, idx, 4);
+			__m256 h10 = _mm256_i32gather_ps(h + cols, idx, 4);
+			__m256 h11 = _mm256_i32gather_ps(h + cols + 1, idx, 4);
+
+			__m256 dTop = _mm256_sub_ps(h01, h00);
+			__m256 dBottom = _mm256_sub_ps(h11, h10);
+			__m256 top = _mm256_add_ps(h00, _mm256_mul_ps(dTop, tj));
+			__m256 bottom = _mm256_add_ps(h10, _mm256_mul_ps(dBottom, tj));
+
+			if(heights != nullptr)
+				_mm256_storeu_ps(heights + k, _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), ti)));
+
+			if(nx != nullptr)
+			{
+				__m256 gx = _mm256_mul_ps(_mm256_add_ps(dTop, _mm256_mul_ps(_mm256_sub_ps(dBottom, dTop), ti)), vNegInvDx);
+				__m256 gz = _mm256_mul_ps(_mm256_sub_ps(bottom, top), vInvDx);
+				__m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), one), _mm256_mul_ps(gz, gz));
+				__m256 invLen = _mm256_div_ps(one, _mm256_sqrt_ps(len2));
+				_mm256_storeu_ps(nx + k, _mm256_mul_ps(gx, invLen));
+				_mm256_storeu_ps(ny + k, invLen);
+				_mm256_storeu_ps(nz + k, _mm256_mul_ps(gz, invLen));
+			}
+		}
+
+		SampleSSE2(h, rows, cols, originX, originZ, invDx, xz + 2*k, count - k,
+			heights != nullptr ? heights + k : nullptr,
+			nx != nullptr ? nx + k : nullptr, ny != nullptr ? ny + k : nullptr, nz != nullptr ? nz + k : nullptr);
+	}
+
+	//
+	// AVX-512, 16 columns per iteration.
+	//
+
+	WAVES_TARGET_AVX512
+	void UpdateRowAVX512(float* prev, const float* curr, const float* up, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		const __m512 vk1 = _mm512_set1_ps(k1);
+		const __m512 vk2 = _mm512_set1_ps(k2);
+		const __m512 vk3 = _mm512_set1_ps(k3);
+
+		int j = j0;
+		for(; j + 16 <= j1; j += 16)
+		{
+			__m512 sum = _mm512_add_ps(_mm512_loadu_ps(down + j), _mm512_loadu_ps(up + j));
+			sum = _mm512_add_ps(sum, _mm512_loadu_ps(curr + j + 1));
+			sum = _mm512_add_ps(sum, _mm512_loadu_ps(curr + j - 1));
+
+			__m512 v = _mm512_add_ps(
+				_mm512_mul_ps(vk1, _mm512_loadu_ps(prev + j)),
+				_mm512_mul_ps(vk2, _mm512_loadu_ps(curr + j)));
+			v = _mm512_add_ps(v, _mm512_mul_ps(vk3, sum));
+
+			_mm512_storeu_ps(prev + j, v);
+		}
+
+		UpdateRowScalar(prev, curr, up, down, j, j1, k1, k2, k3);
+	}
+
+	WAVES_TARGET_AVX512
+	void ImplicitRhsRowAVX512(const float* curr, const float* currUp, const float* currDown,
+		const float* prev, const float* prevUp, const float* prevDown,
+		int j0, int j1, float b, float q, float invA, float* r)
+	{
+		const __m512 vb = _mm512_set1_ps(b);
+		const __m512 vq = _mm512_set1_ps(q);
+		const __m512 vinvA = _mm512_set1_ps(invA);
+		const __m512 four = _mm512_set1_ps(4.0f);
+		const __m512 three = _mm512_set1_ps(3.0f);
+
+		int j = j0;
+		for(; j + 16 <= j1; j += 16)
+		{
+			const __m512 c = _mm512_loadu_ps(curr + j);
+			__m512 lc = _mm512_add_ps(_mm512_loadu_ps(currDown + j), _mm512_loadu_ps(currUp + j));
+			lc = _mm512_add_ps(lc, _mm512_loadu_ps(curr + j + 1));
+			lc = _mm512_add_ps(lc, _mm512_loadu_ps(curr + j - 1));
+			lc = _mm512_sub_ps(lc, _mm512_mul_ps(four, c));
+
+			const __m512 p = _mm512_loadu_ps(prev + j);
+			__m512 lp = _mm512_add_ps(_mm512_loadu_ps(prevDown + j), _mm512_loadu_ps(prevUp + j));
+			lp = _mm512_add_ps(lp, _mm512_loadu_ps(prev + j + 1));
+			lp = _mm512_add_ps(lp, _mm512_loadu_ps(prev + j - 1));
+			lp = _mm512_sub_ps(lp, _mm512_mul_ps(four, p));
+
+			__m512 v = _mm512_mul_ps(vb, _mm512_sub_ps(c, p));
+			v = _mm512_add_ps(v, _mm512_mul_ps(vq, _mm512_add_ps(_mm512_mul_ps(three, lc), lp)));
+			_mm512_storeu_ps(r + j, _mm512_mul_ps(v, vinvA));
+		}
+
+		ImplicitRhsRowScalar(curr, currUp, currDown, prev, prevUp, prevDown, j, j1, b, q, invA, r);
+	}
+
+	WAVES_TARGET_AVX512
+	void SweepRowAVX512(float* x, const float* y, int j0, int j1, float a, float scale)
+	{
+		const __m512 va = _mm512_set1_ps(a);
+		const __m512 vscale = _mm512_set1_ps(scale);
+
+		int j = j0;
+		for(; j + 16 <= j1; j += 16)
+		{
+			const __m512 v = _mm512_add_ps(_mm512_loadu_ps(x + j), _mm512_mul_ps(va, _mm512_loadu_ps(y + j)));
+			_mm512_storeu_ps(x + j, _mm512_mul_ps(v, vscale));
+		}
+
+		SweepRowScalar(x, y, j, j1, a, scale);
+	}
+
+	WAVES_TARGET_AVX512
+	void NormalRowAVX512(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const __m512 vTwoDx = _mm512_set1_ps(twoDx);
+		const __m512 vTwoDxSq = _mm512_set1_ps(twoDx*twoDx);
+		const __m512 one = _mm512_set1_ps(1.0f);
+
+		int j = j0;
+		for(; j + 16 <= j1; j += 16)
+		{
+			__m512 l = _mm512_loadu_ps(h + j - 1);
+			__m512 r = _mm512_loadu_ps(h + j + 1);
+			__m512 t = _mm512_loadu_ps(up + j);
+			__m512 b = _mm512_loadu_ps(down + j);
+
+			__m512 x = _mm512_sub_ps(l, r);
+			__m512 z = _mm512_sub_ps(b, t);
+			__m512 lenSq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), vTwoDxSq), _mm512_mul_ps(z, z));
+			__m512 invLen = _mm512_div_ps(one, _mm512_sqrt_ps(lenSq));
+			_mm512_storeu_ps(nx + j, _mm512_mul_ps(x, invLen));
+			_mm512_storeu_ps(ny + j, _mm512_mul_ps(vTwoDx, invLen));
+			_mm512_storeu_ps(nz + j, _mm512_mul_ps(z, invLen));
+
+			__m512 y = _mm512_sub_ps(r, l);
+			invLen = _mm512_div_ps(one, _mm512_sqrt_ps(_mm512_add_ps(vTwoDxSq, _mm512_mul_ps(y, y))));
+			_mm512_storeu_ps(tx + j, _mm512_mul_ps(vTwoDx, invLen));
+			_mm512_storeu_ps(ty + j, _mm512_mul_ps(y, invLen));
+		}
+
+		NormalRowScalar(h, up, down, j, j1, twoDx, nx, ny, nz, tx, ty);
+	}
+
+	WAVES_TARGET_AVX512
+	inline __m512i PackSnorm16AVX512(__m512 v)
+	{
+		v = _mm512_min_ps(_mm512_max_ps(v, _mm512_set1_ps(-1.0f)), _mm512_set1_ps(1.0f));
+		v = _mm512_add_ps(_mm512_mul_ps(v, _mm512_set1_ps(32767.0f)), _mm512_set1_ps(32768.5f));
+		__m512i c = _mm512_sub_epi32(_mm512_cvttps_epi32(v), _mm512_set1_epi32(32768));
+		return _mm512_and_si512(c, _mm512_set1_epi32(0xffff));
+	}
+
+	WAVES_TARGET_AVX512
+	void NormalRowOctAVX512(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		std::uint32_t* n, float* tx, float* ty)
+	{
+		const __m512 vTwoDx = _mm512_set1_ps(twoDx);
+		const __m512 vTwoDxSq = _mm512_set1_ps(twoDx*twoDx);
+		const __m512 one = _mm512_set1_ps(1.0f);
+
+		int j = j0;
+		for(; j + 16 <= j1; j += 16)
+		{
+			__m512 l = _mm512_loadu_ps(h + j - 1);
+			__m512 r = _mm512_loadu_ps(h + j + 1);
+			__m512 t = _mm512_loadu_ps(up + j);
+			__m512 b = _mm512_loadu_ps(down + j);
+
+			__m512 x = _mm512_sub_ps(l, r);
+			__m512 z = _mm512_sub_ps(b, t);
+			__m512 l1 = _mm512_add_ps(_mm512_add_ps(_mm512_abs_ps(x), vTwoDx), _mm512_abs_ps(z));
+			__m512 invL1 = _mm512_div_ps(one, l1);
+			__m512i packed = _mm512_or_si512(PackSnorm16AVX512(_mm512_mul_ps(x, invL1)),
+				_mm512_slli_epi32(PackSnorm16AVX512(_mm512_mul_ps(z, invL1)), 16));
+			_mm512_storeu_si512(n + j, packed);
+
+			__m512 y = _mm512_sub_ps(r, l);
+			__m512 invLen = _mm512_div_ps(one, _mm512_sqrt_ps(_mm512_add_ps(vTwoDxSq, _mm512_mul_ps(y, y))));
+			_mm512_storeu_ps(tx + j, _mm512_mul_ps(vTwoDx, invLen));
+			_mm512_storeu_ps(ty + j, _mm512_mul_ps(y, invLen));
+		}
+
+		NormalRowOctScalar(h, up, down, j, j1, twoDx, n, tx, ty);
+	}
+
+	//
+	// CPU feature detection.
+	//
+
+	void CpuId(int leaf, int subleaf, unsigned regs[4])
+	{
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for(int i = 0; i < 4; ++i)
+			regs[i] = (unsigned)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// Returns the OS-enabled register state (XCR0).
+	unsigned long long ReadXcr0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((unsigned long long)hi << 32) | lo;
+#endif
+	}
+
+#endif // WAVES_KERNELS_X86
+
+	const WavesKernels* BuildTable()
+	{
+		static WavesKernels table[(int)SimdLevel::Count];
+
+		table[(int)SimdLevel::Scalar].Level = SimdLevel::Scalar;
+		table[(int)SimdLevel::Scalar].UpdateRow = UpdateRowScalar;
+		table[(int)SimdLevel::Scalar].NormalRow = NormalRowScalar;
+		table[(int)SimdLevel::Scalar].NormalRowOct = NormalRowOctScalar;
+		table[(int)SimdLevel::Scalar].PackRow = PackRowScalar;
+		table[(int)SimdLevel::Scalar].ImplicitRhsRow = ImplicitRhsRowScalar;
+		table[(int)SimdLevel::Scalar].SweepRow = SweepRowScalar;
+		table[(int)SimdLevel::Scalar].Sample = SampleScalar;
+
+#if WAVES_KERNELS_X86
+		table[(int)SimdLevel::SSE2].Level = SimdLevel::SSE2;
+		table[(int)SimdLevel::SSE2].UpdateRow = UpdateRowSSE2;
+		table[(int)SimdLevel::SSE2].NormalRow = NormalRowSSE2;
+		table[(int)SimdLevel::SSE2].NormalRowOct = NormalRowOctSSE2;
+		table[(int)SimdLevel::SSE2].PackRow = PackRowSSE2;
+		table[(int)SimdLevel::SSE2].ImplicitRhsRow = ImplicitRhsRowSSE2;
+		table[(int)SimdLevel::SSE2].SweepRow = SweepRowSSE2;
+		table[(int)SimdLevel::SSE2].Sample = SampleSSE2;
+
+		table[(int)SimdLevel::AVX2].Level = SimdLevel::AVX2;
+		table[(int)SimdLevel::AVX2].UpdateRow = UpdateRowAVX2;
+		table[(int)SimdLevel::AVX2].NormalRow = NormalRowAVX2;
+		table[(int)SimdLevel::AVX2].NormalRowOct = NormalRowOctAVX2;
+		table[(int)SimdLevel::AVX2].PackRow = PackRowSSE2;
+		table[(int)SimdLevel::AVX2].ImplicitRhsRow = ImplicitRhsRowAVX2;
+		table[(int)SimdLevel::AVX2].SweepRow = SweepRowAVX2;
+		table[(int)SimdLevel::AVX2].Sample = SampleAVX2;
+
+		table[(int)SimdLevel::AVX512].Level = SimdLevel::AVX512;
+		table[(int)SimdLevel::AVX512].UpdateRow = UpdateRowAVX512;
+		table[(int)SimdLevel::AVX512].NormalRow = NormalRowAVX512;
+		table[(int)SimdLevel::AVX512].NormalRowOct = NormalRowOctAVX512;
+		table[(int)SimdLevel::AVX512].PackRow = PackRowSSE2;
+		table[(int)SimdLevel::AVX512].ImplicitRhsRow = ImplicitRhsRowAVX512;
+		table[(int)SimdLevel::AVX512].SweepRow = SweepRowAVX512;
+		table[(int)SimdLevel::AVX512].Sample = SampleAVX2;
+#else
+		for(int i = 1; i < (int)SimdLevel::Count; ++i)
+			table[i] = table[(int)SimdLevel::Scalar];
+#endif
+
+		return table;
+	}
+}
+
+SimdLevel WavesKernels::DetectSimdLevel()
+{
+#if WAVES_KERNELS_X86
+	unsigned regs[4];
+	CpuId(0, 0, regs);
+	const unsigned maxLeaf = regs[0];
+
+	CpuId(1, 0, regs);
+	const bool sse2 = (regs[3] & (1u << 26)) != 0;
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+	const bool avx = (regs[2] & (1u << 28)) != 0;
+
+	if(!sse2)
+		return SimdLevel::Scalar;
+
+	if(!osxsave || !avx || maxLeaf < 7)
+		return SimdLevel::SSE2;
+
+	// The OS must save the YMM (and for AVX-512 the opmask/ZMM) state on context switches.
+	const unsigned long long xcr0 = ReadXcr0();
+	const bool osYmm = (xcr0 & 0x6) == 0x6;
+	const bool osZmm = (xcr0 & 0xe6) == 0xe6;
+
+	CpuId(7, 0, regs);
+	const bool avx2 = (regs[1] & (1u << 5)) != 0;
+	const bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+	// The AVX-512 table still runs AVX2 kernels (Sample), so that tier needs AVX2 as well.
+	if(avx512f && osZmm && avx2 && osYmm)
+		return SimdLevel::AVX512;
+	if(avx2 && osYmm)
+		return SimdLevel::AVX2;
+	return SimdLevel::SSE2;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+const WavesKernels& WavesKernels::Get(SimdLevel level)
+{
+	static const WavesKernels* table = BuildTable();
+	static const SimdLevel supported = DetectSimdLevel();
+
+	if((int)level > (int)supported)
+		level = supported;
+
+	return table[(int)level];
+}
+
+const WavesKernels& WavesKernels::Best()
+{
+	// Get clamps to the level it detected on first use; no CPUID here.
+	return Get(SimdLevel::AVX512);
+}
+
+const char* WavesKernels::LevelName(SimdLevel level)
+{
+	switch(level)
+	{
+	case SimdLevel::SSE2:   return "SSE2";
+	case SimdLevel::AVX2:   return "AVX2";
+	case SimdLevel::AVX512: return "AVX-512";
+	default:                return "Scalar";
+	}
+}
@@ -0,0 +1,101 @@
+//***************************************************************************************
+// WavesKernels.h
+//
+// Row kernels for the Waves finite difference solver.  Each kernel works on one row of
+// the structure-of-arrays height field and is provided as a scalar reference plus hand
+// vectorized SSE2, AVX2 and AVX-512 versions.  The best version for the running CPU is
+// picked at startup from CPUID.
+//
+// All versions perform exactly the same IEEE operations in the same order (no fused
+// multiply-add, no approximate reciprocals), so their results are bit-identical to the
+// scalar reference.
+//***************************************************************************************
+
+#ifndef WAVESKERNELS_H
+#define WAVESKERNELS_H
+
+#include <cstdint>
+
+enum class SimdLevel : int
+{
+	Scalar = 0,
+	SSE2,
+	AVX2,
+	AVX512,
+	Count
+};
+
+struct WavesKernels
+{
+	// Computes the new heights of columns [j0, j1) of one row, in place into prev:
+	//   prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1])
+	// up/down are the current solution of the rows above and below.
+	typedef void (*UpdateRowFn)(float* prev, const float* curr, const float* up, const float* down,
+		int j0, int j1, float k1, float k2, float k3);
+
+	// Computes the unit normal and unit x-tangent of columns [j0, j1) of one row from the
+	// central differences of the heights h (with rows up/down above and below).
+	// twoDx is twice the spatial step.  The x-tangent z component is always zero.
+	typedef void (*NormalRowFn)(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty);
+
+	// Same as NormalRowFn, but stores each normal octahedrally encoded as two 16-bit snorm
+	// values (u in the low half, v in the high half) instead of as three floats.  The
+	// octahedron is oriented around +y; height field normals always point up, so the
+	// lower-hemisphere fold is never needed here.
+	typedef void (*NormalRowOctFn)(const float* h, const float* up, const float* down,
+		int j0, int j1, float twoDx,
+		std::uint32_t* n, float* tx, float* ty);
+
+	// Packs columns [j0, j1) of one row into the dynamic water vertex stream: per column
+	// the height bits followed by the normal as R8G8B8A8_SNORM (w = 0).  out receives two
+	// words per column, starting with column j0.
+	typedef void (*PackRowFn)(const float* h, const float* nx, const float* ny, const float* nz,
+		int j0, int j1, std::uint32_t* out);
+
+	// Bilinearly samples the height field h (rows x cols points, rows, cols >= 2) at
+	// count points given as interleaved (x, z) pairs.  Point (x, z) lies at column
+	// (x - originX)*invDx and row (originZ - z)*invDx and is clamped to the grid.
+	// Writes the heights and/or the unit normals of the interpolated surface; pass null
+	// for the outputs that are not needed (nx, ny and nz go together).  Grids must have
+	// fewer than 2^24 points.
+	typedef void (*SampleFn)(const float* h, int rows, int cols, float originX, float originZ, float invDx,
+		const float* xz, int count, float* heights, float* nx, float* ny, float* nz);
+
+	// Right-hand side of the implicit (ADI) step for columns [j0, j1) of one row, from the
+	// current and previous solutions and the rows above/below each:
+	//   r[j] = (b*(curr[j] - prev[j]) + q*(3*L(curr)[j] + L(prev)[j])) * invA
+	// where L is the five point Laplacian (neighbor sum minus four times the center).
+	typedef void (*ImplicitRhsRowFn)(const float* curr, const float* currUp, const float* currDown,
+		const float* prev, const float* prevUp, const float* prevDown,
+		int j0, int j1, float b, float q, float invA, float* r);
+
+	// One step of a tridiagonal (Thomas) sweep applied to many systems at once, one per
+	// column [j0, j1): x[j] = (x[j] + a*y[j]) * scale, where y is the neighboring line of
+	// the sweep.  The forward elimination and the back substitution are both this form.
+	typedef void (*SweepRowFn)(float* x, const float* y, int j0, int j1, float a, float scale);
+
+	SimdLevel Level = SimdLevel::Scalar;
+	UpdateRowFn UpdateRow = nullptr;
+	NormalRowFn NormalRow = nullptr;
+	NormalRowOctFn NormalRowOct = nullptr;
+	PackRowFn PackRow = nullptr;
+	ImplicitRhsRowFn ImplicitRhsRow = nullptr;
+	SweepRowFn SweepRow = nullptr;
+	SampleFn Sample = nullptr;
+
+	// Highest level supported by both the CPU/OS and this build.
+	static SimdLevel DetectSimdLevel();
+
+	// Returns the kernels for the requested level, or for the highest supported level
+	// below it if the CPU cannot run the requested one.
+	static const WavesKernels& Get(SimdLevel level);
+
+	// Kernels for DetectSimdLevel(), detected once.
+	static const WavesKernels& Best();
+
+	static const char* LevelName(SimdLevel level);
+};
+
+#endif // WAVESKERNELS_H
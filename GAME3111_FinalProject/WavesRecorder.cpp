@@ -0,0 +1,329 @@
+//***************************************************************************************
+// WavesRecorder.cpp
+//
+// Recording and replay of Waves runs: state snapshots, the impulse log and its file
+// format, and Replay.
+//***************************************************************************************
+
+#include "Waves.h"
+#include "../Common/MappedFile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace
+{
+	// Snapshot header layout (see Waves::SaveSnapshot): sixteen 32-bit fields and the
+	// 64-bit step.
+	const std::size_t SnapshotHeaderBytes = 16*4 + 8;
+
+	// Impulse log layout (see Waves::SaveImpulseLog).
+	const std::size_t ImpulseLogHeaderBytes = 3*4;
+	const std::size_t ImpulseLogEntryBytes = 8 + 5*4;
+
+	void PutU32(std::uint8_t*& out, std::uint32_t v)
+	{
+		for(int b = 0; b < 4; ++b)
+			*out++ = (std::uint8_t)(v >> 8*b);
+	}
+
+	void PutU64(std::uint8_t*& out, std::uint64_t v)
+	{
+		PutU32(out, (std::uint32_t)v);
+		PutU32(out, (std::uint32_t)(v >> 32));
+	}
+
+	void PutF32(std::uint8_t*& out, float v)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		PutU32(out, bits);
+	}
+
+	std::uint32_t GetU32(const std::uint8_t*& in)
+	{
+		std::uint32_t v = 0;
+		for(int b = 0; b < 4; ++b)
+			v |= (std::uint32_t)*in++ << 8*b;
+		return v;
+	}
+
+	std::uint64_t GetU64(const std::uint8_t*& in)
+	{
+		const std::uint64_t lo = GetU32(in);
+		return lo | (std::uint64_t)GetU32(in) << 32;
+	}
+
+	float GetF32(const std::uint8_t*& in)
+	{
+		const std::uint32_t bits = GetU32(in);
+		float v;
+		std::memcpy(&v, &bits, sizeof(v));
+		return v;
+	}
+
+	void PutSnapshotHeader(std::uint8_t*& out, const Waves::SnapshotHeader& header)
+	{
+		PutU32(out, header.Magic);
+		PutU32(out, header.Version);
+		PutU32(out, (std::uint32_t)header.Rows);
+		PutU32(out, (std::uint32_t)header.Cols);
+		PutF32(out, header.SpatialStep);
+		PutF32(out, header.TimeStep);
+		PutF32(out, header.K1);
+		PutF32(out, header.K2);
+		PutF32(out, header.K3);
+		PutF32(out, header.Accumulator);
+		PutU32(out, (std::uint32_t)header.Integrator);
+		PutU32(out, (std::uint32_t)header.Reserved);
+		PutU64(out, header.Step);
+		PutU32(out, (std::uint32_t)header.Sparse);
+		PutU32(out, (std::uint32_t)header.TileSize);
+		PutF32(out, header.SleepThreshold);
+		PutU32(out, (std::uint32_t)header.TileCount);
+	}
+
+	Waves::SnapshotHeader GetSnapshotHeader(const std::uint8_t*& in)
+	{
+		Waves::SnapshotHeader header;
+		header.Magic = GetU32(in);
+		header.Version = GetU32(in);
+		header.Rows = (std::int32_t)GetU32(in);
+		header.Cols = (std::int32_t)GetU32(in);
+		header.SpatialStep = GetF32(in);
+		header.TimeStep = GetF32(in);
+		header.K1 = GetF32(in);
+		header.K2 = GetF32(in);
+		header.K3 = GetF32(in);
+		header.Accumulator = GetF32(in);
+		header.Integrator = (std::int32_t)GetU32(in);
+		header.Reserved = (std::int32_t)GetU32(in);
+		header.Step = GetU64(in);
+		header.Sparse = (std::int32_t)GetU32(in);
+		header.TileSize = (std::int32_t)GetU32(in);
+		header.SleepThreshold = GetF32(in);
+		header.TileCount = (std::int32_t)GetU32(in);
+		return header;
+	}
+}
+
+std::vector<std::uint8_t> Waves::SaveSnapshot()const
+{
+	assert(!mAsync);
+
+	SnapshotHeader header;
+	header.Magic = SnapshotMagic;
+	header.Version = SnapshotVersion;
+	header.Rows = mNumRows;
+	header.Cols = mNumCols;
+	header.SpatialStep = mSpatialStep;
+	header.TimeStep = mTimeStep;
+	header.K1 = mK1;
+	header.K2 = mK2;
+	header.K3 = mK3;
+	header.Accumulator = mAccumulator;
+	header.Integrator = (std::int32_t)mIntegrator;
+	header.Reserved = 0;
+	header.Step = mStep;
+	header.Sparse = mSparse ? 1 : 0;
+	header.TileSize = mTileSize;
+	header.SleepThreshold = mSleepThreshold;
+	header.TileCount = TileCount();
+
+	const std::size_t planeBytes = (std::size_t)mNumRows*mNumCols*sizeof(float);
+	std::vector<std::uint8_t> data(SnapshotHeaderBytes + 2*planeBytes + 2*(std::size_t)TileCount());
+
+	std::uint8_t* out = data.data();
+	PutSnapshotHeader(out, header);
+	std::memcpy(out, mPrevHeights.data(), planeBytes);
+	out += planeBytes;
+	std::memcpy(out, mCurrHeights.data(), planeBytes);
+	out += planeBytes;
+	std::memcpy(out, mTileAwake.data(), TileCount());
+	out += TileCount();
+	std::memcpy(out, mTileQuietSteps.data(), TileCount());
+
+	return data;
+}
+
+std::future<bool> Waves::SaveSnapshotAsync(const std::string& filename)const
+{
+	// Only the capture has to happen now; the simulation can move on while the file is
+	// written.
+	auto data = std::make_shared<std::vector<std::uint8_t>>(SaveSnapshot());
+
+	return std::async(std::launch::async, [data, filename]()
+	{
+		std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)data->data(), (std::streamsize)data->size());
+		fout.close();
+		return !fout.fail();
+	});
+}
+
+bool Waves::LoadSnapshot(const void* data, std::size_t size)
+{
+	assert(!mAsync);
+
+	if(data == nullptr || size < SnapshotHeaderBytes)
+		return false;
+
+	const std::uint8_t* in = static_cast<const std::uint8_t*>(data);
+	const SnapshotHeader header = GetSnapshotHeader(in);
+
+	// The solution only carries over to a grid with exactly the same constants, stepped
+	// the same way.
+	if(header.Magic != SnapshotMagic || header.Version != SnapshotVersion ||
+		header.Rows != mNumRows || header.Cols != mNumCols ||
+		header.SpatialStep != mSpatialStep || header.TimeStep != mTimeStep ||
+		header.K1 != mK1 || header.K2 != mK2 || header.K3 != mK3 ||
+		header.Integrator != (std::int32_t)mIntegrator ||
+		header.TileSize < 1 || header.TileCount < 0)
+	{
+		return false;
+	}
+
+	const int interiorRows = std::max(mNumRows - 2, 0);
+	const int interiorCols = std::max(mNumCols - 2, 0);
+	const int tileCount = ((interiorRows + header.TileSize - 1) / header.TileSize)*
+		((interiorCols + header.TileSize - 1) / header.TileSize);
+
+	const std::size_t planeBytes = (std::size_t)mNumRows*mNumCols*sizeof(float);
+	if(header.TileCount != tileCount || size != SnapshotHeaderBytes + 2*planeBytes + 2*(std::size_t)tileCount)
+		return false;
+
+	if(header.TileSize != mTileSize)
+		BuildTiles(header.TileSize);
+
+	mSparse = header.Sparse != 0;
+	mSleepThreshold = header.SleepThreshold;
+	mAccumulator = header.Accumulator;
+	mStep = header.Step;
+
+	std::memcpy(mPrevHeights.data(), in, planeBytes);
+	in += planeBytes;
+	std::memcpy(mCurrHeights.data(), in, planeBytes);
+	in += planeBytes;
+	std::memcpy(mTileAwake.data(), in, TileCount());
+	in += TileCount();
+	std::memcpy(mTileQuietSteps.data(), in, TileCount());
+
+	// Normals as the simulation would have left them: sleeping tiles keep the flat
+	// normals they were put to sleep with.
+	ComputeNormals();
+	for(int t = 0; t < TileCount(); ++t)
+	{
+		if(!mTileAwake[t])
+			FlattenTileNormals(t);
+	}
+
+	for(std::uint32_t& version : mTileVersion)
+		++version;
+
+	ViewSimulation();
+	return true;
+}
+
+bool Waves::LoadSnapshot(const std::string& filename)
+{
+	MappedFile file;
+	if(!file.Open(filename))
+		return false;
+
+	return LoadSnapshot(file.Data(), file.Size());
+}
+
+void Waves::SetImpulseLogging(bool enable)
+{
+	assert(!mAsync);
+	mLogImpulses = enable;
+	mImpulseLog.clear();
+}
+
+bool Waves::ImpulseLoggingEnabled()const
+{
+	return mLogImpulses;
+}
+
+const std::vector<Waves::LoggedImpulse>& Waves::ImpulseLog()const
+{
+	return mImpulseLog;
+}
+
+bool Waves::SaveImpulseLog(const std::string& filename)const
+{
+	const std::uint32_t count = (std::uint32_t)mImpulseLog.size();
+
+	std::vector<std::uint8_t> data(ImpulseLogHeaderBytes + count*ImpulseLogEntryBytes);
+	std::uint8_t* out = data.data();
+	PutU32(out, ImpulseLogMagic);
+	PutU32(out, ImpulseLogVersion);
+	PutU32(out, count);
+
+	for(const LoggedImpulse& entry : mImpulseLog)
+	{
+		PutU64(out, entry.Step);
+		PutF32(out, entry.Value.Row);
+		PutF32(out, entry.Value.Col);
+		PutF32(out, entry.Value.Magnitude);
+		PutF32(out, entry.Value.Radius);
+		PutU32(out, (std::uint32_t)entry.Value.Shape);
+	}
+
+	std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+	fout.write((const char*)data.data(), (std::streamsize)data.size());
+	fout.close();
+	return !fout.fail();
+}
+
+bool Waves::LoadImpulseLog(const std::string& filename, std::vector<LoggedImpulse>& log)
+{
+	MappedFile file;
+	if(!file.Open(filename) || file.Size() < ImpulseLogHeaderBytes)
+		return false;
+
+	const std::uint8_t* in = static_cast<const std::uint8_t*>(file.Data());
+	const std::uint32_t magic = GetU32(in);
+	const std::uint32_t version = GetU32(in);
+	const std::uint32_t count = GetU32(in);
+	if(magic != ImpulseLogMagic || version != ImpulseLogVersion ||
+		file.Size() != ImpulseLogHeaderBytes + (std::size_t)count*ImpulseLogEntryBytes)
+	{
+		return false;
+	}
+
+	std::vector<LoggedImpulse> entries(count);
+	for(LoggedImpulse& entry : entries)
+	{
+		entry.Step = GetU64(in);
+		entry.Value.Row = GetF32(in);
+		entry.Value.Col = GetF32(in);
+		entry.Value.Magnitude = GetF32(in);
+		entry.Value.Radius = GetF32(in);
+
+		const std::uint32_t shape = GetU32(in);
+		if(shape > (std::uint32_t)ImpulseShape::Disk)
+			return false;
+		entry.Value.Shape = (ImpulseShape)shape;
+	}
+
+	log.swap(entries);
+	return true;
+}
+
+void Waves::Replay(const LoggedImpulse* log, int count, std::uint64_t stepCount)
+{
+	assert(!mAsync);
+	if(stepCount == 0)
+		return;
+
+	mReplayNext = log;
+	mReplayEnd = log + count;
+	RunSteps(stepCount);
+	mReplayNext = nullptr;
+	mReplayEnd = nullptr;
+
+	ViewSimulation();
+}
@@ -7,8 +7,15 @@
 #include "../Common/UploadBuffer.h"
 #include "../Common/GeometryGenerator.h"
 #include "../Common/Camera.h"
+#include "../Common/MeshOptimizer.h"
+#include "../Common/MeshSimplifier.h"
+#include "../Common/MeshClusterizer.h"
+#include "../Common/ThreadPool.h"
 #include "FrameResource.h"
-#include "Waves.h"
+#include "WaterSystem.h"
+#include "BuoyancySystem.h"
+#include <map>
+#include <random>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -52,6 +59,17 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Levels of detail, full mesh first.  When there are any, UpdateLods copies the
+	// draw parameters of the level picked for the frame into the ones above.
+	std::vector<SubmeshGeometry> Lods;
+
+	// Clusters of the full-detail mesh, if it was split into any, and where that mesh
+	// starts in the index buffer.  UpdateClusterCulling fills DrawRanges with the
+	// (start, count) index runs to draw this frame.
+	const MeshClusterizer::ClusterSet* Clusters = nullptr;
+	UINT ClusterIndexStart = 0;
+	std::vector<std::pair<UINT, UINT>> DrawRanges;
 };
 
 enum class RenderLayer : int
@@ -60,6 +78,7 @@ enum class RenderLayer : int
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	Water,
 	Count
 };
 
@@ -89,6 +108,10 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateLods();
+	void UpdateClusterCulling();
+	void StartWaveRecording();
+	void SaveWaveRecording();
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -98,6 +121,11 @@ private:
     void BuildWavesGeometry();
 	void BuildBoxGeometry();
 	void BuildTreeSpritesGeometry();
+	void OptimizeMesh(const char* name, GeometryGenerator::MeshData& mesh);
+	void ClusterMesh(const std::string& name, GeometryGenerator::MeshData& mesh);
+	void AppendLods(const std::string& name, const GeometryGenerator::MeshData& mesh,
+		const SubmeshGeometry& submesh, std::vector<std::uint16_t>& indices,
+		std::unordered_map<std::string, SubmeshGeometry>& drawArgs);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
@@ -106,6 +134,8 @@ private:
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 	void CreateItem(const char* item, XMMATRIX p, XMMATRIX q, XMMATRIX r, UINT ObjIndex, const char* material);
 	void CreateItemT(const char* item, XMMATRIX p, XMMATRIX q, XMMATRIX r, UINT ObjIndex, const char* material);
+	void AssignLods(RenderItem* ritem, const std::string& item);
+	void AssignClusters(RenderItem* ritem, const std::string& item);
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
     float GetHillsHeight(float x, float z)const;
@@ -131,8 +161,14 @@ private:
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mWaterInputLayout;
+
+    // One render item per water patch (in WaterSystem patch order); the patches of a
+    // body share that body's ObjCB slot.
+    std::vector<RenderItem*> mWavesRitems;
 
-    RenderItem* mWavesRitem = nullptr;
+    // Scratch list of the patches UpdateWaves rewrites this frame.
+    std::vector<int> mWavesPatchesToWrite;
 
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
@@ -140,13 +176,49 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
-	std::unique_ptr<Waves> mWaves;
+	// Pool of the lake's simulation thread, kept apart from ThreadPool::Default() so the
+	// frame's own parallel work never waits on lake rows or the other way round.  It
+	// must outlive mWater, which stops the lake's thread.
+	std::unique_ptr<ThreadPool> mLakePool;
+
+	std::unique_ptr<WaterSystem> mWater;
+
+	// Where each water body sits in the world, by body index.
+	std::vector<XMFLOAT3> mWaterPositions;
+
+	// Props floating on the lake; they move the World of their render items.
+	std::unique_ptr<BuoyancySystem> mBuoyancy;
+
+	// Random impulses come from a fixed seed so that runs can be repeated.
+	std::mt19937 mWaveRandom{ 1 };
+
+	// Lake recording (F5 starts, F6 saves).
+	std::future<bool> mWaveSnapshotWrite;
+	bool mWaveRecordKeyDown = false;
+	bool mWaveSaveKeyDown = false;
 
     PassConstants mMainPassCB;
 	Camera mCamera;
 	float mCameraSpeed = 10.f;
 	BoundingBox mCameraBoundbox;
 	bool mIsWireframe = false;
+
+	// Reorder the generated meshes for the vertex cache before they are uploaded.  The
+	// ACMR/ATVR of each mesh go to the debug output.
+	bool mOptimizeMeshes = true;
+
+	// Simplified levels built for each shape, and the screen-space error, in pixels,
+	// UpdateLods accepts when it picks one.  A negative error keeps full detail.
+	UINT mLodLevelCount = 4;
+	float mLodPixelError = 1.0f;
+
+	// Clusters of the full-detail meshes by DrawArgs name, and whether items made of them
+	// draw only the clusters that pass the frustum and back-face tests.
+	std::unordered_map<std::string, MeshClusterizer::ClusterSet> mClusterSets;
+	bool mClusterCulling = true;
+
+	// Scratch list of the clusters of one item that passed.
+	std::vector<std::uint32_t> mVisibleClusters;
 	/*XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
@@ -204,6 +276,8 @@ void TreeBillboardsApp::CreateItem(const char* item, XMMATRIX p, XMMATRIX q,XMMA
     RightWall->IndexCount = RightWall->Geo->DrawArgs[item].IndexCount;
     RightWall->StartIndexLocation = RightWall->Geo->DrawArgs[item].StartIndexLocation;
     RightWall->BaseVertexLocation = RightWall->Geo->DrawArgs[item].BaseVertexLocation;
+    AssignLods(RightWall.get(), item);
+    AssignClusters(RightWall.get(), item);
     //mAllRitems.push_back(std::move(RightWall));
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(RightWall.get());
 	mAllRitems.push_back(std::move(RightWall));
@@ -221,10 +295,36 @@ void TreeBillboardsApp::CreateItemT(const char* item, XMMATRIX p, XMMATRIX q, XM
 	RightWall->IndexCount = RightWall->Geo->DrawArgs[item].IndexCount;
 	RightWall->StartIndexLocation = RightWall->Geo->DrawArgs[item].StartIndexLocation;
 	RightWall->BaseVertexLocation = RightWall->Geo->DrawArgs[item].BaseVertexLocation;
+	AssignLods(RightWall.get(), item);
+	AssignClusters(RightWall.get(), item);
 	//mAllRitems.push_back(std::move(RightWall));
 	mRitemLayer[(int)RenderLayer::Transparent].push_back(RightWall.get());
 	mAllRitems.push_back(std::move(RightWall));
 }
+void TreeBillboardsApp::AssignLods(RenderItem* ritem, const std::string& item)
+{
+	// BuildBoxGeometry registers the levels of a shape as item_lod1, item_lod2, ...
+	auto& drawArgs = ritem->Geo->DrawArgs;
+	for(int level = 1; ; ++level)
+	{
+		auto lod = drawArgs.find(item + "_lod" + std::to_string(level));
+		if(lod == drawArgs.end())
+			break;
+
+		if(ritem->Lods.empty())
+			ritem->Lods.push_back(drawArgs[item]);
+		ritem->Lods.push_back(lod->second);
+	}
+}
+void TreeBillboardsApp::AssignClusters(RenderItem* ritem, const std::string& item)
+{
+	auto clusters = mClusterSets.find(item);
+	if(clusters == mClusterSets.end())
+		return;
+
+	ritem->Clusters = &clusters->second;
+	ritem->ClusterIndexStart = ritem->Geo->DrawArgs[item].StartIndexLocation;
+}
 bool TreeBillboardsApp::Initialize()
 {
     if(!D3DApp::Initialize())
@@ -242,7 +342,16 @@ bool TreeBillboardsApp::Initialize()
 	mCameraBoundbox.Center = mCamera.GetPosition3f();
 	mCameraBoundbox.Extents = XMFLOAT3(1.1f, 1.1f, 1.1f);
 
-    mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+    // Every body of water in the level.  More ponds or pools are one AddBody each.
+    mWater = std::make_unique<WaterSystem>();
+    {
+        auto lake = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+        lake->SetSparseTiles(true);
+        lake->SetNormalFormat(Waves::NormalFormat::Octahedral);
+        mWater->AddBody(std::move(lake));
+        mWaterPositions.push_back(XMFLOAT3(0.0f, 0.0f, 0.0f));
+    }
+    mBuoyancy = std::make_unique<BuoyancySystem>(&mWater->GetBody(0), mWaterPositions[0], gNumFrameResources);
  
 	LoadTextures();
     BuildRootSignature();
@@ -265,6 +374,13 @@ bool TreeBillboardsApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+    // From here on the lake steps on its own thread, with its own few workers;
+    // UpdateWaves only hands over the frame time and uploads whatever solution was
+    // finished last.
+    mLakePool = std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency() / 4, 1u));
+    mWater->GetBody(0).SetThreadPool(mLakePool.get());
+    mWater->GetBody(0).StartAsync();
+
     return true;
 }
  
@@ -300,6 +416,8 @@ void TreeBillboardsApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
+	UpdateLods();
+	UpdateClusterCulling();
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
@@ -351,6 +469,17 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
 
+	// The water items bind their static stream to slot 0; the per-frame heights and
+	// normals go in slot 1 for all of them.
+	D3D12_VERTEX_BUFFER_VIEW wavesVBV;
+	wavesVBV.BufferLocation = mCurrFrameResource->WavesVB->Resource()->GetGPUVirtualAddress();
+	wavesVBV.StrideInBytes = sizeof(WaterDynamicVertex);
+	wavesVBV.SizeInBytes = mWater->TotalVertexCount()*sizeof(WaterDynamicVertex);
+
+	mCommandList->SetPipelineState(mPSOs["water"].Get());
+	mCommandList->IASetVertexBuffers(1, 1, &wavesVBV);
+	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Water]);
+
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
@@ -426,6 +555,17 @@ void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
  
 void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
 {
+	// F5 snapshots the lake and starts logging its impulses; F6 saves the log.  The two
+	// files replay the run with Waves::LoadSnapshot and Waves::Replay.
+	const bool recordKey = (GetAsyncKeyState(VK_F5) & 0x8000) != 0;
+	if(recordKey && !mWaveRecordKeyDown)
+		StartWaveRecording();
+	mWaveRecordKeyDown = recordKey;
+
+	const bool saveKey = (GetAsyncKeyState(VK_F6) & 0x8000) != 0;
+	if(saveKey && !mWaveSaveKeyDown)
+		SaveWaveRecording();
+	mWaveSaveKeyDown = saveKey;
 	
 	
 	if (GetAsyncKeyState('1') & 0x8000)
@@ -578,6 +718,85 @@ void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
 	}
 }
 
+void TreeBillboardsApp::UpdateLods()
+{
+	// A level's error covers error * scale / distance * pixelsPerUnit pixels on screen at
+	// the nearest point of the item's bounds.  Take the coarsest level that stays under
+	// mLodPixelError.
+	const float pixelsPerUnit = 0.5f * mClientHeight / tanf(0.5f * mCamera.GetFovY());
+	const XMVECTOR eyePos = mCamera.GetPosition();
+
+	for(auto& e : mAllRitems)
+	{
+		if(e->Lods.empty())
+			continue;
+
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		BoundingBox bounds;
+		e->Bounds.Transform(bounds, world);
+
+		const float scale = sqrtf(std::max(XMVectorGetX(XMVector3LengthSq(world.r[0])),
+			std::max(XMVectorGetX(XMVector3LengthSq(world.r[1])), XMVectorGetX(XMVector3LengthSq(world.r[2])))));
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+		const float distance = std::max(
+			XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - eyePos)) - radius, mCamera.GetNearZ());
+		const float pixelsPerError = scale * pixelsPerUnit / distance;
+
+		size_t level = 0;
+		while(level + 1 < e->Lods.size() && e->Lods[level + 1].LodError * pixelsPerError <= mLodPixelError)
+			++level;
+
+		e->IndexCount = e->Lods[level].IndexCount;
+		e->StartIndexLocation = e->Lods[level].StartIndexLocation;
+		e->BaseVertexLocation = e->Lods[level].BaseVertexLocation;
+	}
+}
+
+void TreeBillboardsApp::UpdateClusterCulling()
+{
+	XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
+
+	for(auto& e : mAllRitems)
+	{
+		if(e->Clusters == nullptr)
+			continue;
+
+		e->DrawRanges.clear();
+
+		// The clusters only cover the full mesh, so coarser levels of detail draw whole.
+		// A mirroring world matrix flips the winding the cones were built for.
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		XMVECTOR det = XMMatrixDeterminant(world);
+		if(!mClusterCulling || e->StartIndexLocation != e->ClusterIndexStart || XMVectorGetX(det) <= 0.0f)
+		{
+			e->DrawRanges.push_back(std::make_pair(e->StartIndexLocation, e->IndexCount));
+			continue;
+		}
+
+		// Both tests run in the mesh's own space.
+		XMFLOAT4 planes[6];
+		MeshClusterizer::ExtractFrustumPlanes(XMMatrixMultiply(world, viewProj), planes);
+		XMMATRIX invWorld = XMMatrixInverse(&det, world);
+		XMVECTOR eyePos = XMVector3TransformCoord(mCamera.GetPosition(), invWorld);
+
+		const auto& clusters = e->Clusters->Clusters;
+		mVisibleClusters.resize(clusters.size());
+		const size_t visibleCount = MeshClusterizer::Cull(*e->Clusters, planes, eyePos, mVisibleClusters.data());
+
+		// Neighboring clusters are neighboring index ranges, so runs of them draw together.
+		for(size_t i = 0; i < visibleCount; ++i)
+		{
+			const MeshClusterizer::Cluster& c = clusters[mVisibleClusters[i]];
+			const UINT start = e->ClusterIndexStart + c.IndexOffset;
+			const UINT count = c.TriangleCount * 3;
+			if(!e->DrawRanges.empty() && e->DrawRanges.back().first + e->DrawRanges.back().second == start)
+				e->DrawRanges.back().second += count;
+			else
+				e->DrawRanges.push_back(std::make_pair(start, count));
+		}
+	}
+}
+
 void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
 {
 	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
@@ -656,36 +875,101 @@ void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 	{
 		t_base += 0.25f;
 
-		int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
-		int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+		for(int b = 0; b < mWater->BodyCount(); ++b)
+		{
+			Waves& waves = mWater->GetBody(b);
+			int i = std::uniform_int_distribution<int>(4, waves.RowCount() - 5)(mWaveRandom);
+			int j = std::uniform_int_distribution<int>(4, waves.ColumnCount() - 5)(mWaveRandom);
 
-		float r = MathHelper::RandF(0.2f, 0.5f);
+			float r = std::uniform_real_distribution<float>(0.2f, 0.5f)(mWaveRandom);
 
-		mWaves->Disturb(i, j, r);
+			waves.Disturb(i, j, r);
+		}
 	}
 
-	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
+	// Update the wave simulation of every body in one batch.  The lake does not wait for
+	// its simulation worker; see Waves::GetTimings for what it costs on either thread.
+	mWater->Update(gt.DeltaTime());
+
+	// Float the props on the solution just picked up.  Their object constants follow on
+	// the next frame's UpdateObjectCBs.
+	mBuoyancy->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
+	// Update the dynamic wave stream (heights and packed normals) with the new solution.
+	// Each body writes its slice straight into the mapped upload memory, in patch-major
+	// order.
+	static_assert(sizeof(WaterDynamicVertex) == Waves::DynamicVertexStride, "Waves writes WaterDynamicVertex-shaped data");
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
+
+	// The first time a frame resource is used it gets every patch; after that only the
+	// patches that changed since it was last written and that the camera can see.
+	// Hidden patches keep their old version and are caught up once they come into view.
+	auto& patchVersions = mCurrFrameResource->WavesPatchVersions;
+	mWavesPatchesToWrite.clear();
+	if(patchVersions.empty())
+	{
+		patchVersions.resize(mWater->TotalPatchCount());
+		for(int p = 0; p < mWater->TotalPatchCount(); ++p)
+		{
+			const int body = mWater->PatchBody(p);
+			mWavesPatchesToWrite.push_back(p);
+			patchVersions[p] = mWater->GetBody(body).PatchVersion(p - mWater->BasePatch(body));
+		}
+	}
+	else
 	{
-		Vertex v;
+		XMMATRIX view = mCamera.GetView();
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+		BoundingFrustum frustum;
+		BoundingFrustum::CreateFromMatrix(frustum, mCamera.GetProj());
+		frustum.Transform(frustum, invView);
 
-		currWavesVB->CopyData(i, v);
+		for(int p = 0; p < mWater->TotalPatchCount(); ++p)
+		{
+			const int body = mWater->PatchBody(p);
+			const std::uint32_t version = mWater->GetBody(body).PatchVersion(p - mWater->BasePatch(body));
+			if(patchVersions[p] == version)
+				continue;
+
+			// Patch bounds are in the body's local space.
+			BoundingBox bounds;
+			mWavesRitems[p]->Bounds.Transform(bounds, XMLoadFloat4x4(&mWavesRitems[p]->World));
+			if(frustum.Contains(bounds) == DISJOINT)
+				continue;
+
+			mWavesPatchesToWrite.push_back(p);
+			patchVersions[p] = version;
+		}
+	}
+
+	if(!mWavesPatchesToWrite.empty())
+	{
+		mWater->WriteDynamicVertices(currWavesVB->MappedData(),
+			mWavesPatchesToWrite.data(), (int)mWavesPatchesToWrite.size());
 	}
+}
 
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+void TreeBillboardsApp::StartWaveRecording()
+{
+	// Snapshots need the simulation to hold still; the file is written in the background.
+	Waves& lake = mWater->GetBody(0);
+	lake.StopAsync();
+	mWaveSnapshotWrite = lake.SaveSnapshotAsync("lake.wavesnap");
+	lake.SetImpulseLogging(true);
+	lake.StartAsync();
+}
+
+void TreeBillboardsApp::SaveWaveRecording()
+{
+	Waves& lake = mWater->GetBody(0);
+	if(!lake.ImpulseLoggingEnabled())
+		return;
+
+	lake.StopAsync();
+	lake.SaveImpulseLog("lake.impulselog");
+	lake.SetImpulseLogging(false);
+	lake.StartAsync();
 }
 
 void TreeBillboardsApp::LoadTextures()
@@ -970,6 +1254,8 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
 	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
 	
+	mShaders["waterVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "WaterVS", "vs_5_1");
+
 	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
 	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
@@ -986,12 +1272,21 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+
+	mWaterInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "HEIGHT", 0, DXGI_FORMAT_R32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 4, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 }
 
 void TreeBillboardsApp::BuildLandGeometry()
 {
     GeometryGenerator geoGen;
     GeometryGenerator::MeshData grid = geoGen.CreateGrid(80.0f, 120.0f, 10, 10);
+	OptimizeMesh("land", grid);
 
     //
     // Extract the vertex elements we are interested and apply the height function to
@@ -1023,6 +1318,11 @@ void TreeBillboardsApp::BuildLandGeometry()
 		vMax = XMVectorMax(vMax, P);
     }
 
+	// Cluster on the final positions.
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
+		grid.Vertices[i].Position = vertices[i].Pos;
+	ClusterMesh("grid", grid);
+
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
     std::vector<std::uint16_t> indices = grid.GetIndices16();
@@ -1067,57 +1367,96 @@ void TreeBillboardsApp::BuildLandGeometry()
 
 void TreeBillboardsApp::BuildWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
-
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for(int i = 0; i < m - 1; ++i)
-    {
-        for(int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i*n + j;
-            indices[k + 1] = i*n + j + 1;
-            indices[k + 2] = (i + 1)*n + j;
-
-            indices[k + 3] = (i + 1)*n + j;
-            indices[k + 4] = i*n + j + 1;
-            indices[k + 5] = (i + 1)*n + j + 1;
-
-            k += 6; // next quad
-        }
-    }
-
-	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	// The water is drawn as patches so that no single draw needs more than 16-bit
+	// indices.  Patches of the same shape share one index range, across all bodies; the
+	// indices are local to a patch and BaseVertexLocation moves them to the patch's
+	// vertex block in the shared buffer.
+	std::vector<std::uint32_t> indices;
+	std::map<std::pair<int, int>, UINT> shapeStart;
+	int maxPatchVertices = 0;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
 
-	// Set dynamically.
-	geo->VertexBufferCPU = nullptr;
-	geo->VertexBufferGPU = nullptr;
+	for(int p = 0; p < mWater->TotalPatchCount(); ++p)
+	{
+		const int body = mWater->PatchBody(p);
+		const Waves& waves = mWater->GetBody(body);
+		const Waves::Patch& patch = waves.GetPatch(p - mWater->BasePatch(body));
+		const int m = patch.Row1 - patch.Row0;
+		const int n = patch.Col1 - patch.Col0;
+		maxPatchVertices = std::max(maxPatchVertices, patch.VertexCount);
+
+		auto shape = shapeStart.find(std::make_pair(m, n));
+		if(shape == shapeStart.end())
+		{
+			shape = shapeStart.emplace(std::make_pair(m, n), (UINT)indices.size()).first;
+
+			// Iterate over each quad.
+			for(int i = 0; i < m - 1; ++i)
+			{
+				for(int j = 0; j < n - 1; ++j)
+				{
+					indices.push_back(i*n + j);
+					indices.push_back(i*n + j + 1);
+					indices.push_back((i + 1)*n + j);
+
+					indices.push_back((i + 1)*n + j);
+					indices.push_back(i*n + j + 1);
+					indices.push_back((i + 1)*n + j + 1);
+				}
+			}
+		}
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = 6 * (m - 1)*(n - 1);
+		submesh.StartIndexLocation = shape->second;
+		submesh.BaseVertexLocation = mWater->BaseVertex(body) + patch.VertexStart;
+
+		// The surface moves, so give the patch some vertical room around y = 0.
+		const float maxWaveHeight = 2.0f;
+		XMFLOAT3 p0 = waves.Position(patch.Row0*waves.ColumnCount() + patch.Col0);
+		XMFLOAT3 p1 = waves.Position((patch.Row1 - 1)*waves.ColumnCount() + patch.Col1 - 1);
+		BoundingBox::CreateFromPoints(submesh.Bounds,
+			XMVectorSet(p0.x, -maxWaveHeight, p0.z, 1.0f),
+			XMVectorSet(p1.x, +maxWaveHeight, p1.z, 1.0f));
+
+		geo->DrawArgs["patch" + std::to_string(p)] = submesh;
+	}
+
+	// Fall back to 32-bit indices only when a patch is too big for 16-bit ones.
+	const bool use32 = maxPatchVertices > 0x0000ffff;
+	std::vector<std::uint16_t> indices16;
+	if(!use32)
+		indices16.assign(indices.begin(), indices.end());
+
+	const void* indexData = use32 ? (const void*)indices.data() : (const void*)indices16.data();
+	UINT vbByteSize = mWater->TotalVertexCount()*sizeof(WaterStaticVertex);
+	UINT ibByteSize = (UINT)indices.size()*(use32 ? sizeof(std::uint32_t) : sizeof(std::uint16_t));
+
+	// The geometry holds the static stream (x, z and texture coordinates); heights and
+	// normals live in the frame resources' WavesVB.
+	static_assert(sizeof(WaterStaticVertex) == Waves::StaticVertexStride, "Waves writes WaterStaticVertex-shaped data");
+	std::vector<WaterStaticVertex> vertices(mWater->TotalVertexCount());
+	mWater->WriteStaticVertices(vertices.data());
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData, ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(WaterStaticVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = use32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
 	mGeometries["waterGeo"] = std::move(geo);
 }
 
@@ -1134,6 +1473,26 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	GeometryGenerator::MeshData triangularPrism = geoGen.CreateTriangularPrism(1.0f, 1.0f, 1.0f, 2);
 	GeometryGenerator::MeshData torus = geoGen.CreateTorus(1.0f, 0.2f, 16, 16);
 
+	OptimizeMesh("box", box);
+	OptimizeMesh("sphere", sphere);
+	OptimizeMesh("cylinder", cylinder);
+	OptimizeMesh("cone", cone);
+	OptimizeMesh("pyramid", pyramid);
+	OptimizeMesh("wedge", wedge);
+	OptimizeMesh("diamond", diamond);
+	OptimizeMesh("triangularPrism", triangularPrism);
+	OptimizeMesh("torus", torus);
+
+	ClusterMesh("box", box);
+	ClusterMesh("sphere", sphere);
+	ClusterMesh("cylinder", cylinder);
+	ClusterMesh("cone", cone);
+	ClusterMesh("pyramid", pyramid);
+	ClusterMesh("wedge", wedge);
+	ClusterMesh("diamond", diamond);
+	ClusterMesh("triangularPrism", triangularPrism);
+	ClusterMesh("torus", torus);
+
 	// Vertex Cache
 	UINT boxVertexOffset = 0;
 	UINT sphereVertexOffset = boxVertexOffset + (UINT)box.Vertices.size();
@@ -1401,6 +1760,19 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
 	indices.insert(indices.end(), std::begin(triangularPrism.GetIndices16()), std::end(triangularPrism.GetIndices16()));
 	indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
+
+	// Simplified levels of each shape go after all the full meshes and draw from the
+	// full mesh's vertices.
+	std::unordered_map<std::string, SubmeshGeometry> lodDrawArgs;
+	AppendLods("box", box, boxSubmesh, indices, lodDrawArgs);
+	AppendLods("sphere", sphere, sphereSubmesh, indices, lodDrawArgs);
+	AppendLods("cylinder", cylinder, cylinderSubmesh, indices, lodDrawArgs);
+	AppendLods("cone", cone, coneSubmesh, indices, lodDrawArgs);
+	AppendLods("pyramid", pyramid, pyramidSubmesh, indices, lodDrawArgs);
+	AppendLods("wedge", wedge, wedgeSubmesh, indices, lodDrawArgs);
+	AppendLods("diamond", diamond, diamondSubmesh, indices, lodDrawArgs);
+	AppendLods("triangularPrism", triangularPrism, triangularPrismSubmesh, indices, lodDrawArgs);
+	AppendLods("torus", torus, torusSubmesh, indices, lodDrawArgs);
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
 
@@ -1442,10 +1814,92 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	geo->DrawArgs["diamond"] = diamondSubmesh;
 	geo->DrawArgs["triangularPrism"] = triangularPrismSubmesh;
 	geo->DrawArgs["torus"] = torusSubmesh;
+	geo->DrawArgs.insert(lodDrawArgs.begin(), lodDrawArgs.end());
 
 	mGeometries[geo->Name] = std::move(geo);
 }
 
+void TreeBillboardsApp::OptimizeMesh(const char* name, GeometryGenerator::MeshData& mesh)
+{
+	if(!mOptimizeMeshes)
+		return;
+
+	const MeshOptimizer::Report report = MeshOptimizer::Optimize(mesh);
+
+	char text[160];
+	snprintf(text, sizeof(text), "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name,
+		report.Before.Acmr, report.After.Acmr, report.Before.Atvr, report.After.Atvr);
+	::OutputDebugStringA(text);
+}
+
+void TreeBillboardsApp::ClusterMesh(const std::string& name, GeometryGenerator::MeshData& mesh)
+{
+	// The triangles are reordered cluster by cluster, which undoes the order OptimizeMesh
+	// chose, so each cluster is put back in cache order on its own.  The cluster's
+	// vertices are numbered locally for that, so the cost follows the cluster size.
+	MeshClusterizer::ClusterSet& clusters = mClusterSets[name];
+	clusters = MeshClusterizer::Build(mesh);
+
+	if(mOptimizeMeshes)
+	{
+		std::vector<std::uint32_t> local(mesh.Vertices.size(), ~0u);
+		std::vector<std::uint32_t> global;
+		std::vector<std::uint32_t> indices;
+
+		for(const auto& cluster : clusters.Clusters)
+		{
+			std::uint32_t* range = clusters.Indices.data() + cluster.IndexOffset;
+			const size_t indexCount = cluster.TriangleCount*3;
+
+			global.clear();
+			indices.resize(indexCount);
+			for(size_t i = 0; i < indexCount; ++i)
+			{
+				if(local[range[i]] == ~0u)
+				{
+					local[range[i]] = (std::uint32_t)global.size();
+					global.push_back(range[i]);
+				}
+				indices[i] = local[range[i]];
+			}
+
+			MeshOptimizer::OptimizeVertexCache(indices.data(), indices.data(), indexCount, global.size());
+
+			for(size_t i = 0; i < indexCount; ++i)
+				range[i] = global[indices[i]];
+			for(auto v : global)
+				local[v] = ~0u;
+		}
+	}
+
+	mesh.Indices32 = clusters.Indices;
+}
+
+void TreeBillboardsApp::AppendLods(const std::string& name, const GeometryGenerator::MeshData& mesh,
+	const SubmeshGeometry& submesh, std::vector<std::uint16_t>& indices,
+	std::unordered_map<std::string, SubmeshGeometry>& drawArgs)
+{
+	std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLods(mesh, mLodLevelCount);
+	for(size_t level = 0; level < lods.size(); ++level)
+	{
+		MeshSimplifier::Lod& lod = lods[level];
+		if(mOptimizeMeshes)
+		{
+			MeshOptimizer::OptimizeVertexCache(lod.Indices.data(), lod.Indices.data(),
+				lod.Indices.size(), mesh.Vertices.size());
+		}
+
+		SubmeshGeometry lodSubmesh = submesh;
+		lodSubmesh.IndexCount = (UINT)lod.Indices.size();
+		lodSubmesh.StartIndexLocation = (UINT)indices.size();
+		lodSubmesh.LodError = lod.Error;
+		for(auto i : lod.Indices)
+			indices.push_back(static_cast<std::uint16_t>(i));
+
+		drawArgs[name + "_lod" + std::to_string(level + 1)] = lodSubmesh;
+	}
+}
+
 void TreeBillboardsApp::BuildTreeSpritesGeometry()
 {
 	//step5
@@ -1576,6 +2030,18 @@ void TreeBillboardsApp::BuildPSOs()
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
+	//
+	// PSO for the water, blended like other transparent objects but fed from two streams
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC waterPsoDesc = transparentPsoDesc;
+	waterPsoDesc.InputLayout = { mWaterInputLayout.data(), (UINT)mWaterInputLayout.size() };
+	waterPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["waterVS"]->GetBufferPointer()),
+		mShaders["waterVS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&waterPsoDesc, IID_PPV_ARGS(&mPSOs["water"])));
+
 	//
 	// PSO for alpha tested objects
 	//
@@ -1621,7 +2087,7 @@ void TreeBillboardsApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWater->TotalVertexCount()));
     }
 }
 
@@ -1756,20 +2222,31 @@ void TreeBillboardsApp::BuildMaterials()
 void TreeBillboardsApp::BuildRenderItems()
 {
 	UINT objCBIndex = 0;
-    auto wavesRitem = std::make_unique<RenderItem>();
-    wavesRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->ObjCBIndex = objCBIndex;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-    mWavesRitem = wavesRitem.get();
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+	// The patches of a water body use the same object constants, so they share one ObjCB
+	// slot; body b gets slot b.
+	for(int p = 0; p < mWater->TotalPatchCount(); ++p)
+	{
+		const std::string patch = "patch" + std::to_string(p);
+		const int body = mWater->PatchBody(p);
+		const XMFLOAT3& position = mWaterPositions[body];
+
+		auto wavesRitem = std::make_unique<RenderItem>();
+		XMStoreFloat4x4(&wavesRitem->World, XMMatrixTranslation(position.x, position.y, position.z));
+		XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
+		wavesRitem->ObjCBIndex = objCBIndex + body;
+		wavesRitem->Mat = mMaterials["water"].get();
+		wavesRitem->Geo = mGeometries["waterGeo"].get();
+		wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		wavesRitem->Bounds = wavesRitem->Geo->DrawArgs[patch].Bounds;
+		wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs[patch].IndexCount;
+		wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs[patch].StartIndexLocation;
+		wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs[patch].BaseVertexLocation;
+
+		mWavesRitems.push_back(wavesRitem.get());
+		mRitemLayer[(int)RenderLayer::Water].push_back(wavesRitem.get());
+		mAllRitems.push_back(std::move(wavesRitem));
+	}
+	objCBIndex += mWater->BodyCount() - 1;
 
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
@@ -1784,6 +2261,7 @@ void TreeBillboardsApp::BuildRenderItems()
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	AssignClusters(gridRitem.get(), "grid");
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 	//UINT objCBIndex = 0;
@@ -1890,10 +2368,63 @@ void TreeBillboardsApp::BuildRenderItems()
 
 	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
 
-    mAllRitems.push_back(std::move(wavesRitem));
     mAllRitems.push_back(std::move(gridRitem));
 	//mAllRitems.push_back(std::move(boxRitem));
 	mAllRitems.push_back(std::move(treeSpritesRitem));
+
+	// Crates and balls dropped into the open water on either side of the land.  The
+	// meshes are sized by the world matrix, so the buoyancy bodies carry the same scale.
+	std::vector<XMFLOAT3> crateHull;
+	std::vector<XMFLOAT3> ballHull;
+	const float crateHullRadius = BuoyancySystem::BoxHull(XMFLOAT3(0.75f, 0.75f, 0.75f), 3, crateHull);
+	const float ballHullRadius = BuoyancySystem::SphereHull(1.0f, 4, ballHull);
+
+	for(int k = 0; k < 26; ++k)
+	{
+		const bool crate = (k % 2) == 0;
+		const float x = k < 13 ? -52.0f : 52.0f;
+		const float z = -48.0f + 8.0f*(k % 13);
+		const float yaw = 0.6f*k;
+
+		BuoyancySystem::BodyDesc body;
+		body.Position = XMFLOAT3(x, 2.0f, z);
+		XMStoreFloat4(&body.Orientation, XMQuaternionRotationRollPitchYaw(0.0f, yaw, 0.0f));
+		if(crate)
+		{
+			// 1.5 m wooden crate.
+			body.Volume = 1.5f*1.5f*1.5f;
+			body.Mass = 600.0f*body.Volume;
+			const float inertia = body.Mass*(1.5f*1.5f + 1.5f*1.5f)/12.0f;
+			body.Inertia = XMFLOAT3(inertia, inertia, inertia);
+			body.HullPoints = crateHull.data();
+			body.HullPointCount = (int)crateHull.size();
+			body.HullPointRadius = crateHullRadius;
+			body.RenderScale = XMFLOAT3(1.0f, 0.1f, 1.0f);
+		}
+		else
+		{
+			// 1 m radius float.
+			body.Volume = 4.0f/3.0f*MathHelper::Pi;
+			body.Mass = 300.0f*body.Volume;
+			const float inertia = 0.4f*body.Mass;
+			body.Inertia = XMFLOAT3(inertia, inertia, inertia);
+			body.HullPoints = ballHull.data();
+			body.HullPointCount = (int)ballHull.size();
+			body.HullPointRadius = ballHullRadius;
+			body.RenderScale = XMFLOAT3(2.0f, 2.0f, 2.0f);
+		}
+		body.LinearDrag = 2.0f*body.Mass;
+		body.AngularDrag = 2.0f;
+
+		objCBIndex++;
+		CreateItem(crate ? "box" : "sphere",
+			XMMatrixScaling(body.RenderScale.x, body.RenderScale.y, body.RenderScale.z),
+			XMMatrixRotationRollPitchYaw(0.0f, yaw, 0.0f), XMMatrixTranslation(x, 2.0f, z),
+			objCBIndex, crate ? "stair" : "ball");
+
+		RenderItem* ritem = mAllRitems.back().get();
+		mBuoyancy->AddBody(body, &ritem->World, &ritem->NumFramesDirty);
+	}
 }
 bool TreeBillboardsApp::CheckCameraCollision(FXMVECTOR predictPos)
 {
@@ -1932,6 +2463,10 @@ void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, cons
     {
         auto ri = ritems[i];
 
+		// Every cluster was culled.
+		if(ri->Clusters != nullptr && ri->DrawRanges.empty())
+			continue;
+
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		//step3
@@ -1947,7 +2482,15 @@ void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, cons
         cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
         cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		if(ri->Clusters != nullptr)
+		{
+			for(const auto& range : ri->DrawRanges)
+				cmdList->DrawIndexedInstanced(range.second, 1, range.first, ri->BaseVertexLocation, 0);
+		}
+		else
+		{
+			cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		}
     }
 }
 